@@ -35,6 +35,13 @@
 #include <dnscpp/printable.h>
 #include <dnscpp/hosts.h>
 #include <dnscpp/operation.h>
+#include <dnscpp/options.h>
+#include <dnscpp/batch.h>
+#include <dnscpp/cache.h>
+#include <dnscpp/sharedcache.h>
+#include <dnscpp/epollloop.h>
+#include <dnscpp/resolverpool.h>
+#include <dnscpp/channel.h>
 #include <dnscpp/request.h>
 #include <dnscpp/question.h>
 #include <dnscpp/reverse.h>
@@ -0,0 +1,178 @@
+/**
+ *  ActiveCache.h
+ *
+ *  The cache that a context uses: its own cache, or a cache that is shared
+ *  with contexts on other threads. The two caches are different classes
+ *  (the shared cache is not derived from the regular cache), so there is
+ *  no virtual dispatch: every call is forwarded to the cache that is in use
+ *  with a simple (and well predictable) branch.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "cache.h"
+#include "sharedcache.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class ActiveCache
+{
+private:
+    /**
+     *  The own cache of the context
+     *  @var Cache
+     */
+    Cache *_cache;
+
+    /**
+     *  The shared cache (if one is in use)
+     *  @var SharedCache
+     */
+    SharedCache *_shared;
+
+public:
+    /**
+     *  Constructor
+     *  @param  cache       the own cache of the context
+     *  @param  shared      the shared cache (nullptr to use the own cache)
+     */
+    ActiveCache(Cache &cache, SharedCache *shared) : _cache(&cache), _shared(shared) {}
+
+    /**
+     *  Destructor
+     */
+    ~ActiveCache() = default;
+
+    /**
+     *  Is the cache enabled?
+     *  @return bool
+     */
+    bool enabled() const { return _shared ? _shared->enabled() : _cache->enabled(); }
+
+    /**
+     *  Max number of bytes to use
+     *  @return size_t
+     */
+    size_t capacity() const { return _shared ? _shared->capacity() : _cache->capacity(); }
+
+    /**
+     *  Number of bytes in use (approximately)
+     *  @return size_t
+     */
+    size_t bytes() const { return _shared ? _shared->bytes() : _cache->bytes(); }
+
+    /**
+     *  Number of cached responses
+     *  @return size_t
+     */
+    size_t size() const { return _shared ? _shared->size() : _cache->size(); }
+
+    /**
+     *  Number of lookups that were answered from the cache
+     *  @return size_t
+     */
+    size_t hits() const { return _shared ? _shared->hits() : _cache->hits(); }
+
+    /**
+     *  Number of lookups that could not be answered from the cache
+     *  @return size_t
+     */
+    size_t misses() const { return _shared ? _shared->misses() : _cache->misses(); }
+
+    /**
+     *  Number of lookups that were answered with an expired response
+     *  @return size_t
+     */
+    size_t stale() const { return _shared ? _shared->stale() : _cache->stale(); }
+
+    /**
+     *  Number of seconds that expired responses are kept
+     *  @return double
+     */
+    double retention() const { return _shared ? _shared->retention() : _cache->retention(); }
+
+    /**
+     *  Change the number of seconds that expired responses are kept
+     *  @param  value       the new retention
+     */
+    void retention(double value) { if (_shared) _shared->retention(value); else _cache->retention(value); }
+
+    /**
+     *  Store a response
+     *  @param  key         the key under which it is stored
+     *  @param  response    the response to store
+     *  @param  now         current time
+     *  @return bool        was the response stored?
+     */
+    bool insert(const std::string &key, const Response &response, double now) { return _shared ? _shared->insert(key, response, now) : _cache->insert(key, response, now); }
+
+    /**
+     *  Look up a response
+     *  @param  key         the key to look for
+     *  @param  now         current time
+     *  @param  result      buffer that is filled with the response (with decremented TTLs)
+     *  @param  remaining   optional variable that is filled with the part of the TTL that is left (between 0 and 1)
+     *  @return bool        was the response found?
+     */
+    bool lookup(const std::string &key, double now, std::vector<unsigned char> &result, double *remaining = nullptr) { return _shared ? _shared->lookup(key, now, result, remaining) : _cache->lookup(key, now, result, remaining); }
+
+    /**
+     *  Look up a response that can be stored under two keys
+     *  @param  key         the key to look for first
+     *  @param  fallback    the key to look for next
+     *  @param  now         current time
+     *  @param  result      buffer that is filled with the response (with decremented TTLs)
+     *  @return bool        was the response found?
+     */
+    bool lookup(const std::string &key, const std::string &fallback, double now, std::vector<unsigned char> &result) { return _shared ? _shared->lookup(key, fallback, now, result) : _cache->lookup(key, fallback, now, result); }
+
+    /**
+     *  Look up a response that has expired, but that is still retained
+     *  @param  key         the key to look for
+     *  @param  now         current time
+     *  @param  result      buffer that is filled with the response (with the TTLs set to 30 seconds)
+     *  @return bool        was an expired response found?
+     */
+    bool expired(const std::string &key, double now, std::vector<unsigned char> &result) { return _shared ? _shared->expired(key, now, result) : _cache->expired(key, now, result); }
+
+    /**
+     *  Remove all responses
+     */
+    void clear() { if (_shared) _shared->clear(); else _cache->clear(); }
+
+    /**
+     *  Write all responses to a snapshot file
+     *  @param  filename    the file to write
+     *  @return bool        was the snapshot written?
+     */
+    bool save(const char *filename) const { return _shared ? _shared->save(filename) : _cache->save(filename); }
+
+    /**
+     *  Load the responses from a snapshot file
+     *  @param  filename    the file to read
+     *  @param  now         current time
+     *  @return size_t      number of responses that were loaded
+     */
+    size_t load(const char *filename, double now) { return _shared ? _shared->load(filename, now) : _cache->load(filename, now); }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -0,0 +1,176 @@
+/**
+ *  Batch.h
+ *
+ *  A batch of queries that can be submitted to a context with a single
+ *  call to Context::query(). This is cheaper than submitting the queries
+ *  one by one (the timer of the context is only armed once), and it
+ *  allows you to install a callback that is called when all queries in
+ *  the batch are completed.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <vector>
+#include <functional>
+#include <arpa/nameser.h>
+#include "bits.h"
+#include "options.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Handler;
+class Operation;
+
+/**
+ *  Class definition
+ */
+class Batch
+{
+public:
+    /**
+     *  A single query in the batch
+     */
+    struct Entry
+    {
+        /**
+         *  The domain to look up (the batch does not copy the string, so it
+         *  should stay valid until the batch is submitted)
+         *  @var const char *
+         */
+        const char *domain;
+
+        /**
+         *  The record type
+         *  @var ns_type
+         */
+        ns_type type;
+
+        /**
+         *  Bits to include in the query
+         *  @var Bits
+         */
+        Bits bits;
+
+        /**
+         *  Options that control how the query is scheduled
+         *  @var Options
+         */
+        Options options;
+
+        /**
+         *  Object that will be notified when the query is ready
+         *  @var Handler
+         */
+        Handler *handler;
+
+        /**
+         *  The operation that was started for this entry (set when the batch is
+         *  submitted, nullptr if the query could not be started)
+         *  @var Operation
+         */
+        Operation *operation = nullptr;
+
+        /**
+         *  Constructor
+         *  @param  domain
+         *  @param  type
+         *  @param  bits
+         *  @param  options
+         *  @param  handler
+         */
+        Entry(const char *domain, ns_type type, const Bits &bits, const Options &options, Handler *handler) :
+            domain(domain), type(type), bits(bits), options(options), handler(handler) {}
+    };
+
+private:
+    /**
+     *  The queries in the batch
+     *  @var std::vector<Entry>
+     */
+    std::vector<Entry> _entries;
+
+    /**
+     *  Callback that is called when all queries are completed
+     *  @var std::function
+     */
+    std::function<void()> _completed;
+
+public:
+    /**
+     *  Constructor
+     *  @param  size        number of queries to reserve room for
+     */
+    Batch(size_t size = 0) { _entries.reserve(size); }
+
+    /**
+     *  Destructor
+     */
+    virtual ~Batch() = default;
+
+    /**
+     *  Add a query to the batch
+     *  @param  domain      the record name to look for (not copied, see Entry::domain)
+     *  @param  type        type of record
+     *  @param  bits        bits to include in the query
+     *  @param  options     options that control how the query is scheduled
+     *  @param  handler     object that will be notified when the query is ready
+     */
+    void add(const char *domain, ns_type type, const Bits &bits, const Options &options, Handler *handler) { _entries.emplace_back(domain, type, bits, options, handler); }
+    void add(const char *domain, ns_type type, const Bits &bits, Handler *handler) { _entries.emplace_back(domain, type, bits, Options(), handler); }
+
+    /**
+     *  Install the callback that is called when all queries in the batch are
+     *  completed (this is called after the handler of the last query was notified)
+     *  @param  callback
+     */
+    void onCompleted(const std::function<void()> &callback) { _completed = callback; }
+
+    /**
+     *  Expose the completion callback
+     *  @return std::function
+     */
+    const std::function<void()> &completed() const { return _completed; }
+
+    /**
+     *  Reserve room for a number of queries
+     *  @param  size
+     */
+    void reserve(size_t size) { _entries.reserve(size); }
+
+    /**
+     *  Number of queries in the batch
+     *  @return size_t
+     */
+    size_t size() const { return _entries.size(); }
+
+    /**
+     *  Access to the queries
+     *  @return Entry
+     */
+    Entry *begin() { return _entries.data(); }
+    Entry *end() { return _entries.data() + _entries.size(); }
+    const Entry *begin() const { return _entries.data(); }
+    const Entry *end() const { return _entries.data() + _entries.size(); }
+    Entry &operator[](size_t index) { return _entries[index]; }
+    const Entry &operator[](size_t index) const { return _entries[index]; }
+};
+
+/**
+ *  End of namespace
+ */
+}
+
@@ -0,0 +1,108 @@
+/**
+ *  Bucket.h
+ *
+ *  Token bucket that limits the rate of an activity. The bucket is filled
+ *  at a fixed rate, and every time the activity takes place one token is
+ *  taken out of it. The bucket holds at most one second worth of tokens
+ *  (but at least one token), so that short bursts are possible.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <algorithm>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Bucket
+{
+private:
+    /**
+     *  Number of tokens added per second (zero when the activity is not allowed at all)
+     *  @var double
+     */
+    double _rate = 0.0;
+
+    /**
+     *  Number of tokens in the bucket
+     *  @var double
+     */
+    double _tokens = 0.0;
+
+    /**
+     *  Time at which the bucket was last filled
+     *  @var double
+     */
+    double _filled = 0.0;
+
+public:
+    /**
+     *  Constructor
+     *  @param  rate        number of tokens per second
+     */
+    Bucket(double rate = 0.0) : _rate(rate) {}
+
+    /**
+     *  Destructor
+     */
+    virtual ~Bucket() = default;
+
+    /**
+     *  The rate
+     *  @return double
+     */
+    double rate() const { return _rate; }
+
+    /**
+     *  Change the rate
+     *  @param  value       number of tokens per second
+     */
+    void rate(double value) { _rate = std::max(value, 0.0); _tokens = std::min(_tokens, size()); }
+
+    /**
+     *  Max number of tokens in the bucket
+     *  @return double
+     */
+    double size() const { return std::max(_rate, 1.0); }
+
+    /**
+     *  Take a token out of the bucket
+     *  @param  now         current time
+     *  @return bool        was there a token?
+     */
+    bool take(double now)
+    {
+        // fill the bucket for the time that passed (but not beyond its size)
+        _tokens = std::min(_tokens + (now - _filled) * _rate, size()); _filled = now;
+
+        // check if there is a token
+        if (_tokens < 1.0) return false;
+
+        // take it out
+        _tokens -= 1.0;
+
+        // done
+        return true;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
+
@@ -0,0 +1,411 @@
+/**
+ *  Cache.h
+ *
+ *  Memory-bounded cache of responses. The responses are stored in wire
+ *  format, and when they are taken out of the cache the TTLs of the records
+ *  are decremented by the time that the response spent in the cache.
+ *
+ *  Negative responses (responses without answers) are cached as described
+ *  in RFC 2308: only when the authority section holds a SOA record, and no
+ *  longer than the minimum field of that SOA record allows.
+ *
+ *  Entries are evicted with the S3-FIFO algorithm: new entries go to a small
+ *  queue first, and they are only promoted to the main queue when they are
+ *  used again before they fall out of it. A burst of names that are looked
+ *  up only once (a scan) therefore cannot push the popular names out of the
+ *  cache. Names that fell out of the small queue are remembered for a while
+ *  (the ghost queue), so that they go straight to the main queue when they
+ *  are stored again.
+ *
+ *  Optionally, expired responses are kept for a while longer (RFC 8767).
+ *  They are not used for regular lookups, but they can be used as a last
+ *  resort when the nameservers do not respond.
+ *
+ *  The cache can be written to a snapshot file, and loaded from it again,
+ *  so that a restarted process does not start with an empty cache. The
+ *  snapshot holds the responses in wire format with their absolute expire
+ *  times, in the byte order of the machine that wrote it (files that were
+ *  written by a machine with a different byte order are not loaded). Loading
+ *  does not parse the responses, but every entry is still copied into the
+ *  cache, which costs a handful of allocations per entry.
+ *
+ *  A cache belongs to a single thread. To share responses between contexts
+ *  that run on different threads, use a SharedCache instead.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <algorithm>
+#include <iosfwd>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Response;
+class SharedCache;
+
+/**
+ *  Class definition
+ */
+class Cache
+{
+private:
+    /**
+     *  A single cached response
+     */
+    struct Entry
+    {
+        /**
+         *  The key under which it is stored
+         *  @var std::string
+         */
+        std::string key;
+
+        /**
+         *  The response in wire format
+         *  @var std::vector
+         */
+        std::vector<unsigned char> data;
+
+        /**
+         *  Offsets of the TTL fields of the records in the response
+         *  @var std::vector
+         */
+        std::vector<uint16_t> ttls;
+
+        /**
+         *  Time at which the response was stored
+         *  @var double
+         */
+        double stored;
+
+        /**
+         *  Time at which the response expires
+         *  @var double
+         */
+        double expires;
+
+        /**
+         *  Upper limit for the TTLs of the records (for negative responses this is
+         *  the negative TTL, so that the SOA record does not live longer than that)
+         *  @var uint32_t
+         */
+        uint32_t limit = UINT32_MAX;
+
+        /**
+         *  Number of times the entry was used since it was last looked at by the eviction (max 3)
+         *  @var uint8_t
+         */
+        uint8_t frequency = 0;
+
+        /**
+         *  Is the entry in the main queue?
+         *  @var bool
+         */
+        bool main = false;
+
+        /**
+         *  Number of bytes that the entry takes (approximately)
+         *  @return size_t
+         */
+        size_t bytes() const { return sizeof(Entry) + 2 * key.size() + data.size() + ttls.size() * sizeof(uint16_t); }
+    };
+
+    /**
+     *  Part of the capacity that is used for the small queue (in percent)
+     *  @var size_t
+     */
+    static const size_t SMALL = 10;
+
+    /**
+     *  TTL of the records in an expired response (in seconds, as recommended by RFC 8767)
+     *  @var uint32_t
+     */
+    static const uint32_t STALE = 30;
+
+    /**
+     *  Max number of bytes to use
+     *  @var size_t
+     */
+    size_t _capacity = 0;
+
+    /**
+     *  Number of bytes in use, and in use by the small queue
+     *  @var size_t
+     */
+    size_t _bytes = 0;
+    size_t _small = 0;
+
+    /**
+     *  Number of seconds that expired responses are kept
+     *  @var double
+     */
+    double _retention = 0.0;
+
+    /**
+     *  The queues, new entries are added to the front and evicted from the back
+     *  @var std::list<Entry>
+     */
+    std::list<Entry> _smallqueue;
+    std::list<Entry> _mainqueue;
+
+    /**
+     *  Index to find an entry by its key
+     *  @var std::unordered_map
+     */
+    std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+
+    /**
+     *  Keys of the entries that were recently evicted from the small queue
+     *  @var std::list
+     */
+    std::list<std::string> _ghostqueue;
+
+    /**
+     *  Index to find a ghost by its key
+     *  @var std::unordered_map
+     */
+    std::unordered_map<std::string, std::list<std::string>::iterator> _ghosts;
+
+    /**
+     *  Statistics
+     *  @var size_t
+     */
+    size_t _hits = 0;
+    size_t _misses = 0;
+    size_t _stale = 0;
+
+    /**
+     *  Remove an entry from the cache
+     *  @param  iter        the entry
+     */
+    void erase(std::list<Entry>::iterator iter);
+
+    /**
+     *  Find an entry that has not yet expired (entries that expired too long ago are removed)
+     *  @param  key         the key to look for
+     *  @param  now         current time
+     *  @return Entry       the entry (or nullptr if there is no such entry)
+     */
+    Entry *find(const std::string &key, double now);
+
+    /**
+     *  Copy the response of an entry, and mark the entry as used
+     *  @param  entry       the entry
+     *  @param  now         current time
+     *  @param  result      buffer that is filled with the response (with decremented TTLs)
+     */
+    void copy(Entry &entry, double now, std::vector<unsigned char> &result);
+
+    /**
+     *  Remember the key of an entry that is evicted from the small queue
+     *  @param  key
+     */
+    void haunt(const std::string &key);
+
+    /**
+     *  Evict entries until the cache fits in its capacity
+     */
+    void shrink();
+
+    /**
+     *  Find the ttls of the records in a response
+     *  @param  response    the response
+     *  @param  ttls        vector that is filled with the offsets of the ttls
+     *  @return uint32_t    the lowest ttl (zero if the response should not be cached)
+     */
+    static uint32_t parse(const Response &response, std::vector<uint16_t> &ttls);
+
+    /**
+     *  Number of seconds that a response spent in the cache
+     *  @param  stored      time at which the response was stored
+     *  @param  now         current time
+     *  @return uint32_t
+     */
+    static uint32_t age(double stored, double now);
+
+    /**
+     *  Copy a cached response with decremented ttls
+     *  @param  data        the cached response
+     *  @param  ttls        offsets of the ttls in the response
+     *  @param  limit       upper limit for the ttls
+     *  @param  age         number of seconds that the response spent in the cache
+     *  @param  result      buffer that is filled with the response
+     */
+    static void expose(const std::vector<unsigned char> &data, const std::vector<uint16_t> &ttls, uint32_t limit, uint32_t age, std::vector<unsigned char> &result);
+
+    /**
+     *  Copy an expired response (with the ttls set to 30 seconds)
+     *  @param  data        the cached response
+     *  @param  ttls        offsets of the ttls in the response
+     *  @param  limit       upper limit for the ttls
+     *  @param  result      buffer that is filled with the response
+     */
+    static void exposestale(const std::vector<unsigned char> &data, const std::vector<uint16_t> &ttls, uint32_t limit, std::vector<unsigned char> &result);
+
+    /**
+     *  The shared cache uses the same helpers
+     */
+    friend class SharedCache;
+
+public:
+    /**
+     *  Constructor
+     *  @param  capacity    max number of bytes to use (zero to disable the cache)
+     */
+    Cache(size_t capacity = 0) : _capacity(capacity) {}
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Cache(const Cache &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    ~Cache() = default;
+
+    /**
+     *  Is the cache enabled?
+     *  @return bool
+     */
+    bool enabled() const { return _capacity > 0; }
+
+    /**
+     *  Max number of bytes to use
+     *  @return size_t
+     */
+    size_t capacity() const { return _capacity; }
+
+    /**
+     *  Change the max number of bytes to use (entries are evicted if the cache is too big)
+     *  @param  value       the new capacity (zero to disable the cache)
+     */
+    void capacity(size_t value) { _capacity = value; shrink(); }
+
+    /**
+     *  Number of bytes in use (approximately)
+     *  @return size_t
+     */
+    size_t bytes() const { return _bytes; }
+
+    /**
+     *  Number of cached responses
+     *  @return size_t
+     */
+    size_t size() const { return _index.size(); }
+
+    /**
+     *  Number of lookups that were answered from the cache
+     *  @return size_t
+     */
+    size_t hits() const { return _hits; }
+
+    /**
+     *  Number of lookups that could not be answered from the cache
+     *  @return size_t
+     */
+    size_t misses() const { return _misses; }
+
+    /**
+     *  Number of lookups that were answered with an expired response
+     *  @return size_t
+     */
+    size_t stale() const { return _stale; }
+
+    /**
+     *  Number of seconds that expired responses are kept
+     *  @return double
+     */
+    double retention() const { return _retention; }
+
+    /**
+     *  Change the number of seconds that expired responses are kept
+     *  @param  value       the new retention (zero to remove responses as soon as they expire)
+     */
+    void retention(double value) { _retention = std::max(value, 0.0); }
+
+    /**
+     *  Store a response
+     *  @param  key         the key under which it is stored
+     *  @param  response    the response to store
+     *  @param  now         current time
+     *  @return bool        was the response stored? (not if it has no records, no SOA record when it is negative, or a zero TTL)
+     */
+    bool insert(const std::string &key, const Response &response, double now);
+
+    /**
+     *  Look up a response
+     *  @param  key         the key to look for
+     *  @param  now         current time
+     *  @param  result      buffer that is filled with the response (with decremented TTLs)
+     *  @param  remaining   optional variable that is filled with the part of the TTL that is left (between 0 and 1)
+     *  @return bool        was the response found?
+     */
+    bool lookup(const std::string &key, double now, std::vector<unsigned char> &result, double *remaining = nullptr);
+
+    /**
+     *  Look up a response that can be stored under two keys (this counts as a single lookup)
+     *  @param  key         the key to look for first
+     *  @param  fallback    the key to look for next
+     *  @param  now         current time
+     *  @param  result      buffer that is filled with the response (with decremented TTLs)
+     *  @return bool        was the response found?
+     */
+    bool lookup(const std::string &key, const std::string &fallback, double now, std::vector<unsigned char> &result);
+
+    /**
+     *  Look up a response that has expired, but that is still retained
+     *  @param  key         the key to look for
+     *  @param  now         current time
+     *  @param  result      buffer that is filled with the response (with the TTLs set to 30 seconds)
+     *  @return bool        was an expired response found?
+     */
+    bool expired(const std::string &key, double now, std::vector<unsigned char> &result);
+
+    /**
+     *  Remove all responses
+     */
+    void clear();
+
+    /**
+     *  Write all responses to a snapshot file (the file is replaced atomically)
+     *  @param  filename    the file to write
+     *  @return bool        was the snapshot written?
+     */
+    bool save(const char *filename) const;
+
+    /**
+     *  Load the responses from a snapshot file (responses that already expired are skipped,
+     *  and responses that are already in the cache are not replaced)
+     *  @param  filename    the file to read
+     *  @param  now         current time
+     *  @return size_t      number of responses that were loaded
+     */
+    size_t load(const char *filename, double now);
+};
+
+/**
+ *  End of namespace
+ */
+}
+
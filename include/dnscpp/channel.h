@@ -0,0 +1,137 @@
+/**
+ *  Channel.h
+ *
+ *  Connection between a thread of the application and a resolver pool. A
+ *  resolver pool can be used from many threads at the same time, as long as
+ *  every thread creates its own channel (with the event loop of that thread).
+ *  Submitting a query through a channel does not take a lock: the query is
+ *  pushed onto the lock-free queue of a worker, and the worker is woken up.
+ *  The results come back in the inbox of the channel, that has a separate
+ *  single-producer queue for every worker, and they are reported in the
+ *  thread of the channel, via its event loop.
+ *
+ *  A channel is not thread-safe itself: it should only be used by the thread
+ *  that created it. The resolver pool must outlive its channels.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <memory>
+#include <unordered_set>
+#include <arpa/nameser.h>
+#include "monitor.h"
+#include "watchable.h"
+#include "bits.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Loop;
+class Handler;
+class Operation;
+class ResolverPool;
+class Ticket;
+class Inbox;
+
+/**
+ *  Class definition
+ */
+class Channel : private Monitor, private Watchable
+{
+private:
+    /**
+     *  The pool to which queries are submitted
+     *  @var ResolverPool
+     */
+    ResolverPool *_pool;
+
+    /**
+     *  The event loop of the thread that owns the channel
+     *  @var Loop
+     */
+    Loop *_loop;
+
+    /**
+     *  The inbox in which the workers put the results (shared with the lookups that are running)
+     *  @var std::shared_ptr
+     */
+    std::shared_ptr<Inbox> _inbox;
+
+    /**
+     *  Identifier of the doorbell of the inbox in the event loop
+     *  @var void*
+     */
+    void *_identifier = nullptr;
+
+    /**
+     *  The operations of this channel that did not yet get their result
+     *  @var std::unordered_set
+     */
+    std::unordered_set<Ticket*> _tickets;
+
+    /**
+     *  Method that is called when results were posted
+     */
+    virtual void notify() override;
+
+    /**
+     *  Submit a query to a worker
+     *  @param  domain      the domain to look up
+     *  @param  type        type of records to look for
+     *  @param  bits        bits to include in the query
+     *  @param  defaults    should the default bits of the context be used instead?
+     *  @param  handler     object that will be notified when the query is ready
+     *  @return Operation   object to interact with the operation while it is in progress
+     */
+    Operation *query(const char *domain, ns_type type, const Bits &bits, bool defaults, Handler *handler);
+
+public:
+    /**
+     *  Constructor
+     *  @param  pool        the pool to submit queries to
+     *  @param  loop        the event loop of the calling thread (through which results are reported)
+     *  @throws std::runtime_error
+     */
+    Channel(ResolverPool *pool, Loop *loop);
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Channel(const Channel &that) = delete;
+
+    /**
+     *  Destructor
+     *  The operations that are still in progress are cancelled
+     */
+    virtual ~Channel();
+
+    /**
+     *  Do a dns lookup
+     *  @param  domain      the record name to look for
+     *  @param  type        type of record (normally you ask for an 'a' record)
+     *  @param  bits        bits to include in the query
+     *  @param  handler     object that will be notified when the query is ready
+     *  @return Operation   object to interact with the operation while it is in progress (or nullptr when the domain is invalid)
+     */
+    Operation *query(const char *domain, ns_type type, const Bits &bits, Handler *handler) { return query(domain, type, bits, false, handler); }
+    Operation *query(const char *domain, ns_type type, Handler *handler) { return query(domain, type, Bits(), true, handler); }
+};
+
+/**
+ *  End of namespace
+ */
+}
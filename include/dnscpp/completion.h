@@ -0,0 +1,92 @@
+/**
+ *  Completion.h
+ *
+ *  Object that keeps track of the number of lookups of a batch that are
+ *  still in progress, and that calls the completion callback of the batch
+ *  when the last one is done. The object destructs itself after that.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <functional>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Completion
+{
+private:
+    /**
+     *  The callback to call when all lookups are done
+     *  @var std::function
+     */
+    std::function<void()> _callback;
+
+    /**
+     *  Number of lookups that are still in progress
+     *  @var size_t
+     */
+    size_t _pending = 0;
+
+    /**
+     *  Private destructor, the object destructs itself
+     */
+    virtual ~Completion() = default;
+
+public:
+    /**
+     *  Constructor
+     *  @param  callback
+     */
+    Completion(const std::function<void()> &callback) : _callback(callback) {}
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Completion(const Completion &that) = delete;
+
+    /**
+     *  Register one more lookup
+     */
+    void add() { _pending += 1; }
+
+    /**
+     *  Register that a lookup is done (this may call the callback and destruct the object)
+     */
+    void done()
+    {
+        // wait for the other lookups
+        if (--_pending > 0) return;
+
+        // the callback may destruct all sorts of things, so we move it out of the object first
+        auto callback = std::move(_callback);
+
+        // we no longer need the object
+        delete this;
+
+        // notify userspace
+        if (callback) callback();
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
+
@@ -18,7 +18,10 @@
 #include <vector>
 #include "type.h"
 #include "core.h"
+#include "options.h"
+#include "batch.h"
 #include "callbacks.h"
+#include "sharedcache.h"
 
 /**
  *  Begin of namespace
@@ -36,6 +39,48 @@ class Operation;
  */
 class Context : private Core
 {
+private:
+    /**
+     *  Create a lookup object
+     *  @param  key         the key under which identical lookups are cached and shared
+     *  @param  name        the record name to look for
+     *  @param  type        type of record
+     *  @param  bits        bits to include in the query
+     *  @param  options     options that control how the query is scheduled
+     *  @param  handler     object that will be notified when the query is ready
+     *  @return Lookup      the lookup (or nullptr when the parameters were invalid)
+     */
+    Lookup *create(const std::string &key, const char *domain, ns_type type, const Bits &bits, const Options &options, Handler *handler);
+
+    /**
+     *  Share the result of an identical lookup that is already in progress
+     *  @param  key         the key under which identical lookups are shared
+     *  @param  name        the record name to look for
+     *  @param  type        type of record
+     *  @param  bits        bits to include in the query
+     *  @param  options     options that control how the query is scheduled
+     *  @param  handler     object that will be notified when the query is ready
+     *  @return Operation   the operation (or nullptr when there is no lookup to share)
+     */
+    Operation *join(const std::string &key, const char *domain, ns_type type, const Bits &bits, const Options &options, Handler *handler);
+
+    /**
+     *  Refresh a cached response in the background
+     *  @param  key         the key under which the response is cached
+     *  @param  name        the record name to look for
+     *  @param  type        type of record
+     *  @param  bits        bits to include in the query
+     *  @param  now         current time
+     */
+    void refresh(const std::string &key, const char *domain, ns_type type, const Bits &bits, double now);
+
+    /**
+     *  Is an identical lookup in progress that already reported an expired response?
+     *  @param  key         the key under which identical lookups are shared
+     *  @return bool
+     */
+    bool stale(const std::string &key) const;
+
 public:
     /**
      *  Constructor
@@ -80,11 +125,12 @@ public:
     /**
      *  Add a nameserver
      *  @param  ip
+     *  @param  port        the port on which it listens (only other than 53 for testing)
      */
-    void nameserver(const Ip &ip)
+    void nameserver(const Ip &ip, uint16_t port = 53)
     {
         // add to the member in the base class
-        _nameservers.emplace_back(static_cast<Core*>(this), ip);
+        _nameservers.emplace_back(static_cast<Core*>(this), ip, port);
     }
 
     /**
@@ -97,6 +143,30 @@ public:
         // store the property
         _buffersize = size;
     }
+
+    /**
+     *  The number of udp sockets per nameserver. Each socket has its own source port,
+     *  so more queries can be in flight without their ids colliding, and the kernel
+     *  buffers more responses. Queries are spread over the sockets.
+     *  @param  count     number of sockets (the default is 1)
+     */
+    void sockets(size_t count)
+    {
+        // store the property
+        _sockets = std::max(count, size_t(1));
+    }
+
+    /**
+     *  Use io_uring for the udp sockets: responses are then received without a
+     *  system call per datagram, and the queries of one iteration are sent with
+     *  a single system call. This requires Linux 6.0 or higher (and a library
+     *  that was built with recent enough kernel headers), on other systems the
+     *  sockets keep using the regular system calls.
+     *  @param  enable    should io_uring be used?
+     *                    only gets applied to new sockets.
+     *  @return bool      is io_uring used for new sockets?
+     */
+    bool uring(bool enable);
     
     /**
      *  Set max time to wait for a response
@@ -145,7 +215,10 @@ public:
     }
 
     /**
-     *  Set the capacity: number of operations to run at the same time
+     *  Set the capacity: number of operations to run at the same time. This is
+     *  an upper limit, each nameserver also has an adaptive window that limits
+     *  the number of operations that are sent to it, based on the number of 
+     *  responses that got lost.
      *  @param  value       the new value
      */
     void capacity(size_t value)
@@ -154,6 +227,79 @@ public:
         _capacity = std::max(size_t(1), value);
     }
     
+    /**
+     *  Set the capacity per tenant: number of operations to run at the same time
+     *  for a single tenant (see Options::tenant()). Zero means that there is no
+     *  limit other than the capacity of the context itself.
+     *  @param  value       the new value
+     */
+    void tenantcapacity(size_t value) { _tenantcapacity = value; }
+    
+    /**
+     *  Set the size of the response cache. Responses are cached for as long as
+     *  the TTLs of their records allow, and identical queries are answered from
+     *  the cache (in a later tick of the event loop). The cache is disabled by
+     *  default; the statistics are available via cache().
+     *  @param  bytes       max number of bytes to use (zero to disable the cache)
+     */
+    void cache(size_t bytes) { _cache.capacity(bytes); }
+    
+    /**
+     *  Set the size of the cache for negative responses (RFC 2308). NXDOMAIN
+     *  responses are cached for all record types of the name, NODATA responses
+     *  (no error, but no records either) only for the type that was asked. The
+     *  responses are cached for as long as the SOA record in the response allows.
+     *  The cache is disabled by default; the statistics are available via 
+     *  negativecache().
+     *  @param  bytes       max number of bytes to use (zero to disable the cache)
+     */
+    void negativecache(size_t bytes) { _negativecache.capacity(bytes); }
+    
+    /**
+     *  Refresh the cached responses of popular names before they expire. When a
+     *  name that is looked up often is answered from the cache during the last
+     *  part of its TTL, a lookup is started in the background that refreshes the
+     *  cache, so that the response never actually expires. These prefetches are
+     *  only started when the context has capacity to spare, and never more 
+     *  often than the rate allows. Prefetching is disabled by default.
+     *  @param  rate        max number of prefetches per second (zero to disable prefetching)
+     *  @param  window      part of the TTL during which responses are refreshed (for example 0.1 for the last 10%)
+     */
+    void prefetch(double rate, double window = 0.1)
+    {
+        // store the properties
+        _prefetches.rate(rate); _prefetchwindow = std::min(std::max(window, 0.0), 1.0);
+    }
+
+    /**
+     *  Serve expired responses when the nameservers do not respond (RFC 8767).
+     *  Expired responses are then kept in the cache for a while longer. When a
+     *  lookup is not answered within the timeout, and an expired response is
+     *  available, that response is reported (with TTLs of 30 seconds). The lookup
+     *  itself keeps running in the background to refresh the cache. This only
+     *  has effect when the response cache is enabled, and it is off by default.
+     *  @param  window      number of seconds that expired responses are kept (zero to disable)
+     *  @param  timeout     number of seconds to wait for the nameservers before an expired response is reported
+     */
+    void servestale(double window, double timeout = 1.8)
+    {
+        // store the properties
+        cache().retention(window); _staletimeout = std::max(timeout, 0.0);
+    }
+    
+    /**
+     *  Use caches that are shared with contexts on other threads, instead of the
+     *  caches of this context. The shared caches must outlive the context. The
+     *  setting of servestale() applies to the cache that is in use when it is called.
+     *  @param  cache           the shared cache of responses (nullptr to use our own cache again)
+     *  @param  negativecache   the shared cache of negative responses (nullptr to use our own)
+     */
+    void attach(SharedCache *cache, SharedCache *negativecache = nullptr)
+    {
+        // store the pointers
+        _sharedcache = cache; _sharednegativecache = negativecache;
+    }
+
     /**
      *  Enable or disable certain bits
      *  @param  value
@@ -179,54 +325,81 @@ public:
      *  @param  name        the record name to look for
      *  @param  type        type of record (normally you ask for an 'a' record)
      *  @param  bits        bits to include in the query
+     *  @param  options     options that control how the query is scheduled
      *  @param  handler     object that will be notified when the query is ready
      *  @return operation   object to interact with the operation while it is in progress
      */
-    Operation *query(const char *domain, ns_type type, const Bits &bits, Handler *handler);
-    Operation *query(const char *domain, ns_type type, Handler *handler) { return query(domain, type, _bits, handler); }
+    Operation *query(const char *domain, ns_type type, const Bits &bits, const Options &options, Handler *handler);
+    Operation *query(const char *domain, ns_type type, const Bits &bits, Handler *handler) { return query(domain, type, bits, Options(), handler); }
+    Operation *query(const char *domain, ns_type type, const Options &options, Handler *handler) { return query(domain, type, _bits, options, handler); }
+    Operation *query(const char *domain, ns_type type, Handler *handler) { return query(domain, type, _bits, Options(), handler); }
     
+    /**
+     *  Submit a batch of queries. This is cheaper than calling query() for each
+     *  query separately. The operation that was started for each query is stored
+     *  in the batch entries (nullptr if the parameters of the query were invalid).
+     *  If the batch has a completion callback, it is called when all queries
+     *  are done (right away if none of the queries could be started).
+     *  @param  batch       the queries to submit
+     *  @return size_t      number of queries that were started
+     */
+    size_t query(Batch &batch);
+
     /**
      *  Do a reverse IP lookup, this is only meaningful for PTR lookups
      *  @param  ip          the ip address to lookup
      *  @param  bits        bits to include in the query
+     *  @param  options     options that control how the query is scheduled
      *  @param  handler     object that will be notified when the query is ready
      *  @return operation   object to interact with the operation while it is in progress
      */
-    Operation *query(const Ip &ip, const Bits &bits, Handler *handler);
-    Operation *query(const Ip &ip, Handler *handler) { return query(ip, _bits, handler); }
+    Operation *query(const Ip &ip, const Bits &bits, const Options &options, Handler *handler);
+    Operation *query(const Ip &ip, const Bits &bits, Handler *handler) { return query(ip, bits, Options(), handler); }
+    Operation *query(const Ip &ip, const Options &options, Handler *handler) { return query(ip, _bits, options, handler); }
+    Operation *query(const Ip &ip, Handler *handler) { return query(ip, _bits, Options(), handler); }
     
     /**
      *  Do a dns lookup and pass the result to callbacks
      *  @param  name        the record name to look for
      *  @param  type        type of record (normally you ask for an 'a' record)
      *  @param  bits        bits to include in the query
+     *  @param  options     options that control how the query is scheduled
      *  @param  success     function that will be called on success
      *  @param  failure     function that will be called on failure
      *  @return operation   object to interact with the operation while it is in progress
      */
-    Operation *query(const char *domain, ns_type type, const Bits &bits, const SuccessCallback &success, const FailureCallback &failure);
-    Operation *query(const char *domain, ns_type type, const SuccessCallback &success, const FailureCallback &failure) { return query(domain, type, _bits, success, failure); }
+    Operation *query(const char *domain, ns_type type, const Bits &bits, const Options &options, const SuccessCallback &success, const FailureCallback &failure);
+    Operation *query(const char *domain, ns_type type, const Bits &bits, const SuccessCallback &success, const FailureCallback &failure) { return query(domain, type, bits, Options(), success, failure); }
+    Operation *query(const char *domain, ns_type type, const Options &options, const SuccessCallback &success, const FailureCallback &failure) { return query(domain, type, _bits, options, success, failure); }
+    Operation *query(const char *domain, ns_type type, const SuccessCallback &success, const FailureCallback &failure) { return query(domain, type, _bits, Options(), success, failure); }
 
     /**
      *  Do a reverse dns lookup and pass the result to callbacks
      *  @param  ip          the ip address to lookup
      *  @param  bits        bits to include in the query
+     *  @param  options     options that control how the query is scheduled
      *  @param  success     function that will be called on success
      *  @param  failure     function that will be called on failure
      *  @return operation   object to interact with the operation while it is in progress
      */
-    Operation *query(const DNS::Ip &ip, const Bits &bits, const SuccessCallback &success, const FailureCallback &failure);
-    Operation *query(const DNS::Ip &ip, const SuccessCallback &success, const FailureCallback &failure) { return query(ip, _bits, success, failure); }
+    Operation *query(const DNS::Ip &ip, const Bits &bits, const Options &options, const SuccessCallback &success, const FailureCallback &failure);
+    Operation *query(const DNS::Ip &ip, const Bits &bits, const SuccessCallback &success, const FailureCallback &failure) { return query(ip, bits, Options(), success, failure); }
+    Operation *query(const DNS::Ip &ip, const Options &options, const SuccessCallback &success, const FailureCallback &failure) { return query(ip, _bits, options, success, failure); }
+    Operation *query(const DNS::Ip &ip, const SuccessCallback &success, const FailureCallback &failure) { return query(ip, _bits, Options(), success, failure); }
     
     /**
      *  Expose some getters from core
      */
     using Core::buffersize;
+    using Core::sockets;
     using Core::bits;
     using Core::rotate;
     using Core::expire;
     using Core::interval;
     using Core::capacity;
+    using Core::tenantcapacity;
+    using Core::cache;
+    using Core::negativecache;
 };
     
 /**
@@ -24,9 +24,17 @@
 #include "bits.h"
 #include "now.h"
 #include "lookup.h"
+#include "queue.h"
+#include "flows.h"
+#include "wheel.h"
+#include "activecache.h"
+#include "sketch.h"
+#include "bucket.h"
+#include "random.h"
 #include <list>
-#include <deque>
 #include <memory>
+#include <string>
+#include <unordered_map>
 
 /**
  *  Begin of namespace
@@ -37,6 +45,8 @@ namespace DNS {
  *  Forward declarations
  */
 class Loop;
+class RemoteLookup;
+class Uring;
 
 /**
  *  Class definition
@@ -50,6 +60,25 @@ protected:
      */
     Loop *_loop;
 
+    /**
+     *  The io_uring instance for the udp sockets (it is declared before the nameservers,
+     *  because their sockets use it until they are destructed)
+     *  @var std::unique_ptr<Uring>
+     */
+    std::unique_ptr<Uring> _uring;
+
+    /**
+     *  Should new sockets use io_uring?
+     *  @var bool
+     */
+    bool _useuring = false;
+
+    /**
+     *  Generator for the query ids
+     *  @var Random
+     */
+    Random _random;
+
     /**
      *  The IP addresses of the servers that can be accessed
      *  @var std::list<Nameserver>
@@ -61,33 +90,81 @@ protected:
      *  @var Hosts
      */
     Hosts _hosts;
+    
+    /**
+     *  Number of lookups in flight per tenant (only tracked when there is a per-tenant limit)
+     *  @var std::unordered_map
+     */
+    std::unordered_map<uint64_t,size_t> _tenants;
+    
+    /**
+     *  Lookups that are in progress and that can be shared with identical lookups
+     *  that are started later, indexed by their name, type and bits
+     *  @var std::unordered_map
+     */
+    std::unordered_map<std::string,RemoteLookup*> _pending;
+    
+    /**
+     *  Cache of responses (disabled by default)
+     *  @var Cache
+     */
+    Cache _cache;
+    
+    /**
+     *  Cache of NXDOMAIN and NODATA responses, this has its own budget so that
+     *  lookups for names that do not exist cannot push the other responses
+     *  out of the cache (disabled by default)
+     *  @var Cache
+     */
+    Cache _negativecache;
+    
+    /**
+     *  Caches that are shared with contexts on other threads (when set, they are used instead of our own caches)
+     *  @var SharedCache
+     */
+    SharedCache *_sharedcache = nullptr;
+    SharedCache *_sharednegativecache = nullptr;
+    
+    /**
+     *  Estimates how often names were looked up recently (to find the names that should be prefetched)
+     *  @var Sketch
+     */
+    Sketch _sketch;
+    
+    /**
+     *  Limits the rate of prefetches (prefetching is disabled when the rate is zero)
+     *  @var Bucket
+     */
+    Bucket _prefetches;
+    
+    /**
+     *  Part of the TTL during which cached responses of popular names are refreshed
+     *  @var double
+     */
+    double _prefetchwindow = 0.1;
 
     /**
-     *  All operations that are in progress and that are waiting for the next 
-     *  (possibly first) attempt. Note that we use multiple queues so that we do
-     *  not have to use a slow (priority) queue.
-     *  @var std::deque<std::shared_ptr<Lookup>>
+     *  All operations that are in progress, stored in a timer wheel that is keyed
+     *  on the time at which each operation wants to run again (either to send the
+     *  next datagram, or to check whether it expired)
+     *  @var Wheel
      */
-    std::deque<std::shared_ptr<Lookup>> _lookups;
+    Wheel _wheel;
     
     /**
      *  To avoid that external DNS servers, or our own response-buffer, is flooded
      *  with data, there is a limit on the number of operations that can run. If
      *  there are more operations than we can handle, this buffer is used for 
-     *  overflow (is not supposed to happen often!)
-     *  @var std::deque<std::shared_ptr<Lookup>>
-     */
-    std::deque<std::shared_ptr<Lookup>> _scheduled;
-    
-    /**
-     *  Lookups for which the max number of attempts have been reached (no further
-     *  messages will be sent) and that are waiting for response or expiration
-     *  @var std::deque<std::shared_ptr<Lookup>>
+     *  overflow (is not supposed to happen often!) Lookups with a higher priority
+     *  are taken from this buffer first, and within each priority class the
+     *  tenants take turns.
+     *  @var Queue
      */
-    std::deque<std::shared_ptr<Lookup>> _ready;
+    Queue<Flows> _scheduled;
     
     /**
-     *  The next timer to run
+     *  The timer that is used for running the next job (this timer is re-armed
+     *  every time, and only released when there is nothing left to do)
      *  @var void *
      */
     void *_timer = nullptr;
@@ -105,6 +182,12 @@ protected:
      */
     int32_t _buffersize = 0;
 
+    /**
+     *  Number of udp sockets per nameserver
+     *  @var size_t
+     */
+    size_t _sockets = 1;
+
     /**
      *  Max time that we wait for a response
      *  @var double
@@ -122,6 +205,12 @@ protected:
      *  @var double
      */
     double _interval = 2.0;
+
+    /**
+     *  Time after which an expired response from the cache is reported when the nameservers do not answer
+     *  @var double
+     */
+    double _staletimeout = 1.8;
     
     /**
      *  Default bits to include in queries
@@ -141,6 +230,12 @@ protected:
      */
     size_t _capacity = 100;
     
+    /**
+     *  Max number of operations to run at the same time for a single tenant (zero for no limit)
+     *  @var size_t
+     */
+    size_t _tenantcapacity = 0;
+    
     /**
      *  The max number of calls to be made to userspace in one iteration
      *  @var size_t
@@ -154,6 +249,18 @@ protected:
      */
     double delay(double now);
 
+    /**
+     *  Make sure that the timer expires right away
+     */
+    void wakeup();
+
+    /**
+     *  Try to admit a lookup (the tenant and the nameserver must both have room for it)
+     *  @param  lookup      the lookup to admit
+     *  @return bool        was the lookup admitted?
+     */
+    bool admit(Lookup *lookup);
+
     /**
      *  Proceed with more operations
      *  @param  now
@@ -165,21 +272,43 @@ protected:
      *  Process a lookup
      *  @param  lookup      the lookup to process
      *  @param  now         current time
-     *  @return bool        was this lookup indeed processable (false if processed too early)
      */
-    bool process(const std::shared_ptr<Lookup> &lookup, double now);
+    void process(Lookup *lookup, double now);
+
+    /**
+     *  Store a lookup in the wheel, at the time when it wants to run again
+     *  @param  lookup      the lookup to store
+     *  @param  now         current time
+     */
+    void schedule(Lookup *lookup, double now);
 
     /**
      *  Notify the timer that it expired
      */
     virtual void expire() override;
     
+    /**
+     *  Add a new lookup to the wheel or to the overflow buffer, without arming the timer
+     *  @param  lookup
+     *  @return bool        can the lookup run right away? (then the timer should be armed)
+     */
+    bool enqueue(Lookup *lookup);
+
     /**
      *  Add a new lookup to the list
      *  @param  lookup
      *  @return Operation
      */
     Operation *add(Lookup *lookup);
+
+    /**
+     *  Move a lookup that is still waiting to be admitted to a higher priority class, because
+     *  an identical query of that class shares its result (otherwise that query would wait
+     *  behind the backlog of the lower class, and outside the limit of its own tenant)
+     *  @param  lookup      the lookup that is shared
+     *  @param  options     the options of the query that shares it
+     */
+    void promote(Lookup *lookup, const Options &options);
     
     /**
      *  Protected constructor, only the derived class may construct it
@@ -216,11 +345,30 @@ public:
      */
     Loop *loop() { return _loop; }
 
+    /**
+     *  The io_uring instance that new sockets should use (if any)
+     *  @return Uring
+     */
+    Uring *uring() { return _useuring ? _uring.get() : nullptr; }
+
     /**
      *  The send and receive buffer size 
      *  @return int32_t
      */
     int32_t buffersize() const { return _buffersize; }
+
+    /**
+     *  Number of udp sockets per nameserver
+     *  @return size_t
+     */
+    size_t sockets() const { return _sockets; }
+
+    /**
+     *  The random number generator (this is an internal method)
+     *  @return Random
+     *  @internal
+     */
+    Random &random() { return _random; }
     
     /**
      *  The period between sending the datagram again
@@ -233,6 +381,12 @@ public:
      *  @return double
      */
     double timeout() const { return _timeout; }
+
+    /**
+     *  The time after which an expired response is reported when no answer came in
+     *  @return double
+     */
+    double staletimeout() const { return _staletimeout; }
     
     /**
      *  Max number of attempts / number of requests to send
@@ -246,6 +400,12 @@ public:
      */
     size_t capacity() const { return _capacity; }
     
+    /**
+     *  The capacity per tenant: number of operations to run at the same time for a single tenant
+     *  @return size_t
+     */
+    size_t tenantcapacity() const { return _tenantcapacity; }
+    
     /**
      *  Default bits that are sent with each query
      *  @return Bits
@@ -271,6 +431,43 @@ public:
      */
     void reschedule(double now);
 
+    /**
+     *  Method that is called when a socket that was full can send again, the lookups that were held back can be admitted now
+     */
+    void unblocked() { if (!_scheduled.empty()) wakeup(); }
+
+    /**
+     *  Remove a lookup that is finished or cancelled (after this call the core no
+     *  longer owns the lookup, and the caller is responsible for destructing it)
+     *  @param  lookup      the lookup to remove
+     */
+    void remove(Lookup *lookup);
+
+    /**
+     *  Release the resources that an admitted lookup held (lookups call this before
+     *  they report to userspace, because userspace may destruct the core)
+     *  @param  lookup      the lookup that is finished
+     */
+    void release(Lookup *lookup);
+
+    /**
+     *  Expose the lookups that can be shared
+     *  @return std::unordered_map
+     */
+    std::unordered_map<std::string,RemoteLookup*> &pending() { return _pending; }
+    
+    /**
+     *  Expose the cache that is in use (our own, or the shared cache)
+     *  @return ActiveCache
+     */
+    ActiveCache cache() { return ActiveCache(_cache, _sharedcache); }
+    
+    /**
+     *  Expose the cache of negative responses that is in use (our own, or the shared cache)
+     *  @return ActiveCache
+     */
+    ActiveCache negativecache() { return ActiveCache(_negativecache, _sharednegativecache); }
+
     /**
      *  Expose the nameservers
      *  @return std::list<Nameserver>
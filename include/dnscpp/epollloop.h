@@ -0,0 +1,253 @@
+/**
+ *  EpollLoop.h
+ *
+ *  Event loop implementation based on the Linux epoll api, for programs
+ *  that do not already have an event loop of their own. Filedescriptors are
+ *  monitored edge-triggered, and the timers are kept in a heap inside the
+ *  loop. Watchers and timers are stored in blocks that are recycled, so
+ *  adding a filedescriptor or setting a timer normally does not allocate.
+ *
+ *  Because the filedescriptors are edge-triggered, a monitor is only
+ *  notified again after new data arrived. The objects in this library keep
+ *  reading until the socket would block (or ask the loop to look again via
+ *  update() when they stop earlier).
+ *
+ *  The loop is not thread-safe: it should only be used by the thread that
+ *  runs it.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "loop.h"
+#include <deque>
+#include <vector>
+#include <sys/epoll.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class EpollLoop : public Loop
+{
+private:
+    /**
+     *  A filedescriptor that is monitored
+     */
+    struct Watch
+    {
+        /**
+         *  The filedescriptor
+         *  @var int
+         */
+        int fd;
+
+        /**
+         *  The object to notify (nullptr when the watch was removed)
+         *  @var Monitor
+         */
+        Monitor *monitor;
+    };
+
+    /**
+     *  A timer
+     */
+    struct Alarm
+    {
+        /**
+         *  Time at which it expires
+         *  @var double
+         */
+        double expires;
+
+        /**
+         *  The object to notify
+         *  @var Timer
+         */
+        Timer *timer;
+
+        /**
+         *  Position in the heap (or npos when it is not pending)
+         *  @var size_t
+         */
+        size_t position;
+
+        /**
+         *  Is it about to be notified in the current iteration?
+         *  @var bool
+         */
+        bool due;
+    };
+
+    /**
+     *  Value for alarms that are not in the heap
+     *  @var size_t
+     */
+    static const size_t npos = size_t(-1);
+
+    /**
+     *  The epoll filedescriptor
+     *  @var int
+     */
+    int _fd;
+
+    /**
+     *  Storage for the watches and the alarms (a deque never moves its elements,
+     *  so their addresses are used as identifiers)
+     *  @var std::deque
+     */
+    std::deque<Watch> _watches;
+    std::deque<Alarm> _alarms;
+
+    /**
+     *  Watches and alarms that can be recycled
+     *  @var std::vector
+     */
+    std::vector<Watch *> _unused;
+    std::vector<Alarm *> _spare;
+
+    /**
+     *  Watches that were removed in the current iteration (they can only be recycled
+     *  in the next iteration, because there may still be events for them)
+     *  @var std::vector
+     */
+    std::vector<Watch *> _removed;
+
+    /**
+     *  Number of watches that are in use
+     *  @var size_t
+     */
+    size_t _active = 0;
+
+    /**
+     *  The pending alarms, ordered by the time they expire
+     *  @var std::vector
+     */
+    std::vector<Alarm *> _heap;
+
+    /**
+     *  Buffers that are reused in each iteration
+     *  @var std::vector
+     */
+    std::vector<struct epoll_event> _events;
+    std::vector<Alarm *> _due;
+
+    /**
+     *  Put an alarm on a position in the heap
+     *  @param  alarm       the alarm
+     *  @param  position    the position
+     */
+    void place(Alarm *alarm, size_t position) { _heap[position] = alarm; alarm->position = position; }
+
+    /**
+     *  Move an alarm to its right place in the heap
+     *  @param  alarm       the alarm
+     */
+    void sift(Alarm *alarm);
+
+    /**
+     *  Add an alarm to the heap, or remove it from the heap
+     *  @param  alarm       the alarm
+     */
+    void push(Alarm *alarm);
+    void erase(Alarm *alarm);
+
+public:
+    /**
+     *  Constructor
+     *  @param  events      max number of events that are handled per iteration
+     *  @throws std::runtime_error
+     */
+    EpollLoop(size_t events = 256);
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    EpollLoop(const EpollLoop &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~EpollLoop();
+
+    /**
+     *  Add a filedescriptor to the loop
+     *  @param  fd          the filedescriptor
+     *  @param  events      the events to monitor for (1 for readability, 2 for writability)
+     *  @param  monitor     the object to notify
+     *  @return void*       identifier of the watch
+     */
+    virtual void *add(int fd, int events, Monitor *monitor) override;
+
+    /**
+     *  Change the events that are monitored (the filedescriptor is also checked again for activity)
+     *  @param  identifier  identifier of the watch
+     *  @param  fd          the filedescriptor
+     *  @param  events      the events to monitor for
+     *  @param  monitor     the object to notify
+     *  @return void*       new identifier of the watch
+     */
+    virtual void *update(void *identifier, int fd, int events, Monitor *monitor) override;
+
+    /**
+     *  Stop monitoring a filedescriptor
+     *  @param  identifier  identifier of the watch
+     *  @param  fd          the filedescriptor
+     *  @param  monitor     the object that was notified
+     */
+    virtual void remove(void *identifier, int fd, Monitor *monitor) override;
+
+    /**
+     *  Set a timer
+     *  @param  timeout     number of seconds after which the timer expires
+     *  @param  timer       the object to notify
+     *  @return void*       identifier of the timer
+     */
+    virtual void *timer(double timeout, Timer *timer) override;
+
+    /**
+     *  Cancel a timer
+     *  @param  identifier  identifier of the timer
+     *  @param  timer       the object that would have been notified
+     */
+    virtual void cancel(void *identifier, Timer *timer) override;
+
+    /**
+     *  Re-arm a timer (the identifier stays the same)
+     *  @param  identifier  identifier of the timer (or nullptr)
+     *  @param  timeout     number of seconds after which the timer expires
+     *  @param  timer       the object to notify
+     *  @return void*       identifier of the timer
+     */
+    virtual void *reset(void *identifier, double timeout, Timer *timer) override;
+
+    /**
+     *  Run a single iteration: wait for activity on the filedescriptors or for a
+     *  timer to expire (but no longer than the timeout), and notify the objects
+     *  @param  timeout     max number of seconds to wait (negative to wait until something happens)
+     *  @return bool        is there still something to wait for?
+     */
+    bool step(double timeout = -1.0);
+
+    /**
+     *  Run the loop until there is nothing left to wait for
+     */
+    void run() { while (step()) {} }
+};
+
+/**
+ *  End of namespace
+ */
+}
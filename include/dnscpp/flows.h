@@ -0,0 +1,248 @@
+/**
+ *  Flows.h
+ *
+ *  Set of lookups that are waiting to be admitted, grouped in one flow per
+ *  tenant. Lookups are taken out with deficit-round-robin: every flow gets
+ *  a quantum of lookups per turn, so that one tenant with a large backlog
+ *  cannot starve the others. Flows whose first lookup cannot be admitted
+ *  (for example because the tenant already has too many lookups in flight)
+ *  are skipped until their next turn.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "lookups.h"
+#include "lookup.h"
+#include <stdint.h>
+#include <list>
+#include <unordered_map>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Flows
+{
+private:
+    /**
+     *  Number of lookups that a flow may take out per turn
+     *  @var size_t
+     */
+    static const size_t QUANTUM = 4;
+
+    /**
+     *  The lookups of a single tenant
+     */
+    struct Flow
+    {
+        /**
+         *  The tenant
+         *  @var uint64_t
+         */
+        uint64_t tenant;
+
+        /**
+         *  The waiting lookups
+         *  @var Lookups
+         */
+        Lookups lookups;
+
+        /**
+         *  Number of lookups that may still be taken out in this turn
+         *  @var size_t
+         */
+        size_t deficit = 0;
+
+        /**
+         *  Constructor
+         *  @param  tenant
+         */
+        Flow(uint64_t tenant) : tenant(tenant) {}
+    };
+
+    /**
+     *  The flows that have waiting lookups, in the order in which they get their turn
+     *  @var std::list<Flow>
+     */
+    std::list<Flow> _flows;
+
+    /**
+     *  Index to find the flow of a tenant
+     *  @var std::unordered_map
+     */
+    std::unordered_map<uint64_t, std::list<Flow>::iterator> _index;
+
+    /**
+     *  The flow whose turn it is
+     *  @var std::list<Flow>::iterator
+     */
+    std::list<Flow>::iterator _current = _flows.end();
+
+    /**
+     *  Number of waiting lookups
+     *  @var size_t
+     */
+    size_t _size = 0;
+
+    /**
+     *  Move on to the next flow
+     */
+    void advance()
+    {
+        // the flow has to wait for its next turn
+        _current->deficit = 0;
+
+        // the list is circular
+        if (++_current == _flows.end()) _current = _flows.begin();
+    }
+
+    /**
+     *  Forget a flow that no longer has waiting lookups
+     *  @param  iter        the flow
+     */
+    void erase(std::list<Flow>::iterator iter)
+    {
+        // if this was the current flow, the next flow gets its turn
+        if (iter == _current) advance();
+
+        // forget the flow
+        _index.erase(iter->tenant);
+
+        // if this was the only flow, there is no current flow any more
+        if (_current == iter) _current = _flows.end();
+
+        // remove the flow
+        _flows.erase(iter);
+    }
+
+public:
+    /**
+     *  Constructor
+     */
+    Flows() = default;
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Flows(const Flows &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Flows() = default;
+
+    /**
+     *  Is the set empty?
+     *  @return bool
+     */
+    bool empty() const { return _size == 0; }
+
+    /**
+     *  Number of waiting lookups
+     *  @return size_t
+     */
+    size_t size() const { return _size; }
+
+    /**
+     *  Add a lookup to the flow of its tenant
+     *  @param  lookup
+     */
+    void push_back(Lookup *lookup)
+    {
+        // the tenant of the lookup
+        uint64_t tenant = lookup->options().tenant();
+
+        // find the flow
+        auto iter = _index.find(tenant);
+
+        // new flows are added at the end of the round
+        if (iter == _index.end()) iter = _index.emplace(tenant, _flows.emplace(_current == _flows.end() ? _flows.end() : _current, tenant)).first;
+
+        // if there was no current flow, this is the one
+        if (_current == _flows.end()) _current = iter->second;
+
+        // add the lookup to the flow
+        iter->second->lookups.push_back(lookup);
+        _size += 1;
+    }
+
+    /**
+     *  Remove a lookup
+     *  @param  lookup
+     *  @return bool        was it indeed part of this set?
+     */
+    bool remove(Lookup *lookup)
+    {
+        // find the flow of the tenant
+        auto iter = _index.find(lookup->options().tenant());
+
+        // the lookup must be part of the flow
+        if (iter == _index.end() || !iter->second->lookups.remove(lookup)) return false;
+
+        // one lookup less
+        _size -= 1;
+
+        // forget the flow if it became empty
+        if (iter->second->lookups.empty()) erase(iter->second);
+
+        // done
+        return true;
+    }
+
+    /**
+     *  Take out the next lookup that can be admitted
+     *  @param  admit       function that is called to admit the first lookup of a flow
+     *  @return Lookup      the admitted lookup (or nullptr if no lookup could be admitted)
+     */
+    template <typename ADMIT>
+    Lookup *pop_front(const ADMIT &admit)
+    {
+        // every flow gets at most one chance
+        for (size_t visited = 0; visited < _flows.size(); ++visited)
+        {
+            // a flow that starts a new turn gets a new quantum
+            if (_current->deficit == 0) _current->deficit = QUANTUM;
+
+            // the first lookup of the flow
+            auto *lookup = _current->lookups.front();
+
+            // if it cannot be admitted, the next flow gets its turn
+            if (!admit(lookup)) { advance(); continue; }
+
+            // take it out
+            _current->lookups.remove(lookup);
+            _size -= 1;
+
+            // forget the flow if it became empty, or move on when its turn is over
+            if (_current->lookups.empty()) erase(_current);
+            else if (--_current->deficit == 0) advance();
+
+            // expose the lookup
+            return lookup;
+        }
+
+        // no lookup could be admitted
+        return nullptr;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
+
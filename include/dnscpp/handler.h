@@ -68,6 +68,16 @@ public:
      */
     virtual void onTimeout(const Operation *operation);
     
+    /**
+     *  Method that is called when an operation is given up because its deadline
+     *  passed (see Options::deadline()).
+     * 
+     *  The default implementation passes the call on to Handler::onTimeout().
+     * 
+     *  @param  operation       the operation that expired
+     */
+    virtual void onExpired(const Operation *operation);
+    
     /**
      *  Method that is called when a raw response is received. This includes
      *  successful responses, error responses and truncated responses.
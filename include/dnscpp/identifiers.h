@@ -0,0 +1,152 @@
+/**
+ *  Identifiers.h
+ *
+ *  Flat table with the query ids that are in flight on a socket, and the
+ *  objects that wait for the responses to them. A response is dispatched
+ *  with a single lookup in the table. New ids are drawn at random (so that
+ *  they cannot be guessed), but never one that is already in use, so that
+ *  every response can be matched to exactly one query.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "random.h"
+#include <vector>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+template <typename TYPE>
+class Identifiers
+{
+private:
+    /**
+     *  The owner of each id that is in use (allocated when the first id is claimed)
+     *  @var std::vector
+     */
+    std::vector<TYPE*> _slots;
+
+    /**
+     *  Number of ids in use
+     *  @var size_t
+     */
+    size_t _size = 0;
+
+public:
+    /**
+     *  Constructor
+     */
+    Identifiers() = default;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Identifiers() = default;
+
+    /**
+     *  Number of ids that are in use, and the number that exist
+     *  @return size_t
+     */
+    size_t size() const { return _size; }
+    static size_t capacity() { return 65536; }
+
+    /**
+     *  Are all ids in use?
+     *  @return bool
+     */
+    bool full() const { return _size == capacity(); }
+
+    /**
+     *  The owner of an id
+     *  @param  id
+     *  @return TYPE        the owner, or nullptr if the id is not in use
+     */
+    TYPE *find(uint16_t id) const { return _slots.empty() ? nullptr : _slots[id]; }
+
+    /**
+     *  Claim a specific id
+     *  @param  id
+     *  @param  owner       the object that waits for the response
+     *  @return bool        false if the id was already in use
+     */
+    bool claim(uint16_t id, TYPE *owner)
+    {
+        // check if it is in use
+        if (find(id) != nullptr) return false;
+
+        // allocate the table the first time
+        if (_slots.empty()) _slots.resize(capacity(), nullptr);
+
+        // store the owner
+        _slots[id] = owner; _size += 1;
+
+        // done
+        return true;
+    }
+
+    /**
+     *  Claim a random id that is not yet in use (this should not be called when all ids are in use)
+     *  @param  random      the random number generator
+     *  @param  owner       the object that waits for the response
+     *  @return uint16_t
+     */
+    uint16_t allocate(Random &random, TYPE *owner)
+    {
+        // try a couple of random ids (this almost always succeeds at the first attempt)
+        for (size_t i = 0; i < 16; ++i)
+        {
+            // pick an id
+            uint16_t id = random.u16();
+
+            // use it if it is free
+            if (claim(id, owner)) return id;
+        }
+
+        // the id space is crowded, we take the first free id after a random one
+        uint16_t id = random.u16();
+
+        // look for it (this wraps around)
+        while (!claim(id, owner)) id += 1;
+
+        // expose the id
+        return id;
+    }
+
+    /**
+     *  Give back an id
+     *  @param  id
+     *  @param  owner       the object that claimed it
+     *  @return bool        false if the id was not claimed by this owner
+     */
+    bool release(uint16_t id, const TYPE *owner)
+    {
+        // nothing to do if the id belongs to someone else
+        if (owner == nullptr || find(id) != owner) return false;
+
+        // clear the slot
+        _slots[id] = nullptr; _size -= 1;
+
+        // done
+        return true;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -17,6 +17,7 @@
  */
 #include "monitor.h"
 #include "timer.h"
+#include <vector>
 
 /**
  *  Begin of namespace
@@ -40,6 +41,35 @@ private:
      *  @var bool
      */
     bool _persist;
+    
+    /**
+     *  Watchers that are no longer in use, and that can be recycled (this saves
+     *  a malloc() and free() for each filedescriptor and timer that is added)
+     *  @var std::vector
+     */
+    std::vector<ev_io *> _ios;
+    std::vector<ev_timer *> _timers;
+    
+    /**
+     *  Get a watcher from the pool, or allocate a new one if the pool is empty
+     *  @param  pool        the pool to get it from
+     *  @return T*
+     */
+    template <typename T>
+    static T *allocate(std::vector<T *> &pool)
+    {
+        // allocate a new watcher if there is nothing to recycle
+        if (pool.empty()) return (T *)malloc(sizeof(T));
+        
+        // take the last watcher from the pool
+        T *watcher = pool.back();
+        
+        // it is no longer in the pool
+        pool.pop_back();
+        
+        // expose the watcher
+        return watcher;
+    }
 
     /**
      *  Callback method that is called when a filedescriptor becomes active
@@ -92,7 +122,12 @@ public:
     /**
      *  Destructor
      */
-    virtual ~LibEv() = default;
+    virtual ~LibEv()
+    {
+        // deallocate the recycled watchers
+        for (auto *watcher : _ios) free(watcher);
+        for (auto *watcher : _timers) free(watcher);
+    }
     
     /**
      *  Add a filedescriptor to the event loop
@@ -103,8 +138,8 @@ public:
      */
     virtual void *add(int fd, int events, Monitor *monitor) override
     {
-        // construct the watcher object
-        ev_io *watcher = (ev_io *)malloc(sizeof(ev_io));
+        // construct the watcher object (or recycle one)
+        ev_io *watcher = allocate(_ios);
         
         // associate the monitor with the watcher
         watcher->data = monitor;
@@ -135,11 +170,26 @@ public:
         // the identifier is a watcher
         ev_io *watcher = (ev_io *)identifier;
         
+        // restore refcount (the watcher is restarted below)
+        if (!_persist) ev_ref(_loop);
+        
+        // the events can only be changed when the watcher is stopped
+        ev_io_stop(_loop, watcher);
+        
         // we update the monitor too (in reality the monitor object never changes)
         watcher->data = monitor;
         
         // change the events 
         ev_io_set(watcher, fd, events);
+        
+        // start monitoring again
+        ev_io_start(_loop, watcher);
+        
+        // dont affect refcount
+        if (!_persist) ev_unref(_loop);
+        
+        // the identifier remains the same
+        return watcher;
     }
     
     /**
@@ -160,8 +210,8 @@ public:
         // remove the watcher from the event loop
         ev_io_stop(_loop, watcher);
         
-        // we no longer need the watcher
-        free(watcher);
+        // we no longer need the watcher, it can be recycled
+        _ios.push_back(watcher);
     }
     
     /**
@@ -172,8 +222,8 @@ public:
      */
     virtual void *timer(double timeout, Timer *timer) override
     {
-        // construct the watcher object
-        ev_timer *watcher = (ev_timer *)malloc(sizeof(ev_timer));
+        // construct the watcher object (or recycle one)
+        ev_timer *watcher = allocate(_timers);
         
         // associate the timer with the watcher
         watcher->data = timer;
@@ -212,8 +262,45 @@ public:
         // remove the watcher from the event loop
         ev_timer_stop(_loop, watcher);
         
-        // we no longer need the watcher
-        free(watcher);
+        // we no longer need the watcher, it can be recycled
+        _timers.push_back(watcher);
+    }
+    
+    /**
+     *  Re-arm a timer so that it expires after a new timeout. The watcher
+     *  is reused, so this does not allocate anything.
+     * 
+     *  @param  void*   identifier of the timer (returned by timer() or reset(), or nullptr)
+     *  @param  timeout number of seconds after which the timer expires
+     *  @param  Timer   the object that should be notified when the timer expired
+     *  @return void*   identifier for the timer
+     */
+    virtual void *reset(void *identifier, double timeout, Timer *timer) override
+    {
+        // if there is no timer yet, we create one
+        if (identifier == nullptr) return this->timer(timeout, timer);
+        
+        // the identifier is a watcher
+        ev_timer *watcher = (ev_timer *)identifier;
+        
+        // restore refcount (also when the timer already expired, the unref is still in effect)
+        if (!_persist) ev_ref(_loop);
+        
+        // stop the watcher (in case it is still running)
+        ev_timer_stop(_loop, watcher);
+        
+        // associate the timer with the watcher
+        watcher->data = timer;
+        
+        // set the new timeout and start it again
+        ev_timer_set(watcher, timeout, 0.0);
+        ev_timer_start(_loop, watcher);
+        
+        // dont affect refcount
+        if (!_persist) ev_unref(_loop);
+        
+        // the identifier remains the same
+        return watcher;
     }
 };
     
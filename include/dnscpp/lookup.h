@@ -17,6 +17,9 @@
  *  Dependencies
  */
 #include "operation.h"
+#include "options.h"
+#include "lookups.h"
+#include <stdint.h>
 
 /**
  *  Begin of namespace
@@ -26,16 +29,59 @@ namespace DNS {
 /**
  *  Forward declarations
  */
-//class Handler;
+class Core;
 
 /**
  *  Class definition
  */
 class Lookup : public Operation
 {
+private:
+    /**
+     *  The list that holds the lookup, and the neighbours in that list
+     *  (the links are stored in the lookup itself to avoid allocations)
+     *  @var Lookups
+     */
+    Lookups *_list = nullptr;
+    Lookup *_prev = nullptr;
+    Lookup *_next = nullptr;
+    
+    /**
+     *  The tick at which the lookup expires (only used when it is stored in the timer wheel)
+     *  @var uint64_t
+     */
+    uint64_t _expires = 0;
+    
+    /**
+     *  Did the lookup still have credits when it was stored in the timer wheel?
+     *  @var bool
+     */
+    bool _active = false;
+    
+    /**
+     *  Is the lookup counted in the number of lookups in flight for its tenant?
+     *  @var bool
+     */
+    bool _counted = false;
+
 protected:
+    /**
+     *  Pointer to the core of the DNS library
+     *  @var Core
+     */
+    Core *_core;
+    
+    /**
+     *  Options that control how the lookup is scheduled (the core may promote a lookup
+     *  that is still waiting to be admitted, when an identical query of a higher class shares it)
+     *  @var Options
+     */
+    Options _options;
+
     /**
      *  Constructor
+     *  @param  core        dns core object
+     *  @param  options     scheduling options
      *  @param  handler     user space handler
      *  @param  op          the type of operation (normally a regular query)
      *  @param  dname       the domain to lookup
@@ -44,14 +90,24 @@ protected:
      *  @param  data        optional data (only for type = ns_o_notify)
      *  @throws std::runtime_error
      */
-    Lookup(Handler *handler, int op, const char *dname, int type, const Bits &bits, const unsigned char *data = nullptr) : 
-        Operation(handler, op, dname, type, bits, data) {}
+    Lookup(Core *core, const Options &options, Handler *handler, int op, const char *dname, int type, const Bits &bits, const unsigned char *data = nullptr) : 
+        Operation(handler, op, dname, type, bits, data), _core(core), _options(options) {}
 
 public:
     /**
      *  Destructor
      */
-    virtual ~Lookup() = default;
+    virtual ~Lookup()
+    {
+        // make sure the lookup is no longer linked
+        if (_list) _list->remove(this);
+    }
+    
+    /**
+     *  The options that control how the lookup is scheduled
+     *  @return Options
+     */
+    const Options &options() const { return _options; }
     
     /**
      *  How many credits are left (meaning: how many datagrams do we still have to send?)
@@ -66,12 +122,32 @@ public:
      */
     virtual double delay(double now) const = 0;
     
+    /**
+     *  Try to admit the lookup: this reserves room in the window of the nameserver
+     *  that the lookup is going to contact first
+     *  @return bool        was the lookup admitted? (false if the nameserver is too busy)
+     */
+    virtual bool admit() = 0;
+    
     /**
      *  Execute the lookup
      *  @param  now         current time
      *  @return bool        should the lookup be rescheduled?
      */
     virtual bool execute(double now) = 0;
+
+    /**
+     *  Destruct the lookup after userspace destructed the core while the lookup was
+     *  running (the lookup already reported to userspace, and may no longer use the core)
+     */
+    void orphan() { _handler = nullptr; delete this; }
+    
+    /**
+     *  The lists, the wheel and the core manage the bookkeeping
+     */
+    friend class Lookups;
+    friend class Wheel;
+    friend class Core;
 };
     
 /**
@@ -0,0 +1,121 @@
+/**
+ *  Lookups.h
+ *
+ *  Intrusive doubly-linked list of lookups. The links are stored inside
+ *  the lookup objects themselves, so that adding a lookup to a list does
+ *  not allocate any memory, and so that a lookup can be removed from the
+ *  list that holds it in O(1) time (for example when it is cancelled).
+ *
+ *  A list owns the lookups that it holds: when the list is destructed,
+ *  all lookups that are still in it are destructed too.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stddef.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Lookup;
+
+/**
+ *  Class definition
+ */
+class Lookups
+{
+private:
+    /**
+     *  The first and last lookup in the list
+     *  @var Lookup
+     */
+    Lookup *_first = nullptr;
+    Lookup *_last = nullptr;
+
+    /**
+     *  Number of lookups in the list
+     *  @var size_t
+     */
+    size_t _size = 0;
+
+public:
+    /**
+     *  Constructor
+     */
+    Lookups() = default;
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Lookups(const Lookups &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Lookups();
+
+    /**
+     *  Is the list empty?
+     *  @return bool
+     */
+    bool empty() const { return _size == 0; }
+
+    /**
+     *  Number of lookups in the list
+     *  @return size_t
+     */
+    size_t size() const { return _size; }
+
+    /**
+     *  The first lookup in the list
+     *  @return Lookup
+     */
+    Lookup *front() const { return _first; }
+
+    /**
+     *  Does the list contain a certain lookup?
+     *  @param  lookup
+     *  @return bool
+     */
+    bool contains(const Lookup *lookup) const;
+
+    /**
+     *  Add a lookup to the end of the list (it must not be part of another list)
+     *  @param  lookup
+     */
+    void push_back(Lookup *lookup);
+
+    /**
+     *  Remove the first lookup from the list
+     *  @return Lookup      the removed lookup (or nullptr if the list was empty)
+     */
+    Lookup *pop_front();
+
+    /**
+     *  Remove a lookup from the list
+     *  @param  lookup
+     *  @return bool        was it indeed part of this list?
+     */
+    bool remove(Lookup *lookup);
+};
+
+/**
+ *  End of namespace
+ */
+}
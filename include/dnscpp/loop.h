@@ -101,6 +101,32 @@ public:
      *  @param  Timer   the timer to cancel
      */
     virtual void cancel(void *identifier, Timer *timer) = 0;
+    
+    /**
+     *  Re-arm a timer so that it expires after a new timeout
+     * 
+     *  The DNS library keeps a single timer alive for as long as it has work
+     *  to do, and moves it forward or backward each time a query is started
+     *  or a response is received. The identifier remains valid after the timer
+     *  expired (it is only released by the cancel() method) so that it can be
+     *  armed again. The default implementation cancels the old timer and sets
+     *  a new one, but event loops that can reuse their timers (like libev with
+     *  its ev_timer_again() function) should override this method to avoid the
+     *  overhead of allocating a new timer for each change.
+     * 
+     *  @param  void*   identifier of the timer (returned by timer() or reset(), or nullptr)
+     *  @param  timeout number of seconds after which the timer expires
+     *  @param  Timer   the object that should be notified when the timer expired
+     *  @return void*   identifier for the timer
+     */
+    virtual void *reset(void *identifier, double timeout, Timer *timer)
+    {
+        // cancel the old timer
+        if (identifier != nullptr) cancel(identifier, timer);
+        
+        // and set a new one
+        return this->timer(timeout, timer);
+    }
 };
     
 /**
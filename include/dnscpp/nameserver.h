@@ -2,7 +2,9 @@
  *  Nameserver.h
  * 
  *  Class that encapsulates everything we know about one nameserver,
- *  and the socket that we use to communicate with that nameserver.
+ *  and the sockets that we use to communicate with that nameserver.
+ *  Every socket has its own source port, so the same query id can be
+ *  in flight on each of them.
  * 
  *  This is an internal class. You normally do not have to construct
  *  nameserver instances yourself, as you can send out your queries
@@ -26,7 +28,9 @@
 #include "response.h"
 #include "timer.h"
 #include "watchable.h"
-#include <set>
+#include "window.h"
+#include "identifiers.h"
+#include <deque>
 
 /**
  *  Begin of the namespace
@@ -60,6 +64,31 @@ public:
     };
     
 private:
+    /**
+     *  One of the sockets to the nameserver
+     */
+    struct Socket
+    {
+        /**
+         *  The udp socket
+         *  @var Udp
+         */
+        Udp udp;
+
+        /**
+         *  The ids that are in flight on this socket, and the handlers that wait for them
+         *  @var Identifiers
+         */
+        Identifiers<Handler> ids;
+
+        /**
+         *  Constructor
+         *  @param  core        the core object
+         *  @param  handler     object that will receive all incoming responses
+         */
+        Socket(Core *core, Udp::Handler *handler) : udp(core, handler) {}
+    };
+
     /**
      *  Pointer to the core object
      *  @var    Core
@@ -71,12 +100,24 @@ private:
      *  @var    Ip
      */
     Ip _ip;
+
+    /**
+     *  The port on which it listens
+     *  @var    uint16_t
+     */
+    uint16_t _port;
     
     /**
-     *  UDP socket to send messages to the nameserver
-     *  @var    Udp
+     *  UDP sockets to send messages to the nameserver (a deque never moves its elements)
+     *  @var    std::deque
      */
-    Udp _udp;
+    std::deque<Socket> _sockets;
+
+    /**
+     *  The socket at which the search for a socket for the next query starts
+     *  @var    size_t
+     */
+    size_t _next = 0;
 
     /**
      *  All the buffered responses that came in 
@@ -85,19 +126,47 @@ private:
     std::list<Received> _responses;
 
     /**
-     *  Set with the handlers
-     *  @var set
+     *  Adaptive window that limits the number of datagrams in flight
+     *  @var Window
+     */
+    Window _window;
+
+    /**
+     *  The index of one of our sockets
+     *  @param  udp         the socket
+     *  @return size_t      the index (or SIZE_MAX if the socket is not ours)
+     */
+    size_t index(const Udp *udp) const;
+
+    /**
+     *  Subscribe to a socket to be notified about the response to a query
+     *  (the query is assigned to a socket on which its id is not yet in use,
+     *  if there is no such socket the handler cannot be told apart from the
+     *  one that already uses the id, and it is not subscribed)
+     *  @param  handler     the handler that wants to receive an answer
+     *  @param  query       the query
+     *  @param  renumber    may the query get a new id?
+     *  @return size_t      index of the socket (or SIZE_MAX if the id is in use on every socket)
      */
-    std::set<std::pair<uint16_t,Handler*>> _handlers;
+    size_t subscribe(Handler *handler, Query &query, bool renumber);
 
     /**
      *  Method that is called when a response is received
+     *  @param  udp         the socket that received it
      *  @param  now         the receive-time
      *  @param  address     the address of the nameserver from which it is received
      *  @param  buffer      the received response
      *  @param  size        size of the response
      */
-    virtual void onReceived(time_t now, const struct sockaddr *address, const unsigned char *buffer, size_t size) override;
+    virtual void onReceived(Udp *udp, time_t now, const struct sockaddr *address, const unsigned char *buffer, size_t size) override;
+
+    /**
+     *  Method that is called when a batch of responses is received
+     *  @param  udp         the socket that received them
+     *  @param  now         the receive-time
+     *  @param  responses   the received responses (the ones that are kept are moved out)
+     */
+    virtual void onReceived(Udp *udp, time_t now, std::list<Received> &responses) override;
 
 
 public:
@@ -105,9 +174,10 @@ public:
      *  Constructor
      *  @param  core    the core object with the settings and event loop
      *  @param  ip      nameserver IP
+     *  @param  port    the port on which it listens
      *  @throws std::runtime_error
      */
-    Nameserver(Core *core, const Ip &ip);
+    Nameserver(Core *core, const Ip &ip, uint16_t port = 53);
     
     /**
      *  No copying
@@ -125,43 +195,75 @@ public:
      *  @return Ip
      */
     const Ip &ip() const { return _ip; }
+
+    /**
+     *  Expose the port on which the nameserver listens
+     *  @return uint16_t
+     */
+    uint16_t port() const { return _port; }
+
+    /**
+     *  Expose the window that limits the number of datagrams in flight
+     *  @return Window
+     */
+    Window &window() { return _window; }
+    const Window &window() const { return _window; }
     
     /**
-     *  Send a datagram to the nameserver
+     *  Send a datagram to the nameserver, the handler is subscribed to the response (if it
+     *  was not already subscribed) and the datagram goes over the socket of the subscription.
+     *  A query that was not sent before may get a new id, one that is not in flight on the socket.
+     *  If the id is in flight on every socket, nothing is sent: the response could not be told
+     *  apart from the one for the other handler, so the caller should try again later.
+     *  @param  handler     the handler that wants to receive an answer
+     *  @param  query       the query to send
+     *  @param  renumber    may the query get a new id?
+     *  @return bool        was the handler subscribed (and the datagram queued)?
+     */
+    bool datagram(Handler *handler, Query &query, bool renumber);
+
+    /**
+     *  Forget a datagram that was not yet sent (because the query is about to be destructed)
      *  @param  query
+     */
+    void cancel(const Query &query);
+
+    /**
+     *  Is one of the sockets full, or are all ids in use? (in that case no new lookups should be started)
      *  @return bool
      */
-    bool datagram(const Query &query);
+    bool blocked() const;
 
     /**
-     *  Subscribe to the socket if you want to be notified about incoming responses
-     *  @param  handler     the handler that wants to receive an answer
-     *  @param  id          id of the response that the handler is interested in
+     *  Number of ids that are in flight (on all sockets together)
+     *  @return size_t
      */
-    void subscribe(Handler *handler, uint16_t id)
-    {
-        // emplace the handler
-        _handlers.insert(std::make_pair(id, handler));
-    }
+    size_t occupancy() const;
+
+    /**
+     *  Send the datagrams that were queued in this iteration
+     */
+    void flush();
     
     /**
-     *  Unsubscribe from the socket, this is the counterpart of subscribe()
+     *  Unsubscribe from the socket, this is the counterpart of datagram()
      *  @param  handler     the handler that unsubscribes
      *  @param  id          id of the response that the handler is interested in
      */
     void unsubscribe(Handler *handler, uint16_t id)
     {
-        // find the element
-        auto iter = _handlers.find(std::make_pair(id, handler));
-
-        // if it is not found, we leap out (this should not happen)
-        if (iter == _handlers.end()) return;
+        // look for the socket on which the handler is waiting (there are not many of them)
+        for (auto &socket : _sockets)
+        {
+            // the id can be used again if it was claimed by the handler
+            if (!socket.ids.release(id, handler)) continue;
 
-        // simply erase the element
-        _handlers.erase(iter);
+            // if nobody is listening to the socket any more, we can just as well close it
+            if (socket.ids.size() == 0) socket.udp.close();
 
-        // if nobody is listening to the socket any more, we can just as well close it
-        if (_handlers.empty()) _udp.close();
+            // a handler is only subscribed once
+            return;
+        }
     }
     
     /**
@@ -30,6 +30,7 @@ namespace DNS {
  *  Forward declarations
  */
 class Handler;
+class Completion;
 
 /**
  *  Class definition
@@ -44,10 +45,16 @@ protected:
     Handler *_handler;
     
     /**
-     *  The query that we're going to send
+     *  The query that we're going to send (its id may change when it is sent for the first time)
      *  @var Query
      */
-    const Query _query;
+    Query _query;
+    
+    /**
+     *  The batch to which the operation belongs (only set when the batch has a completion callback)
+     *  @var Completion
+     */
+    Completion *_completion = nullptr;
         
     /**
      *  Constructor
@@ -65,7 +72,7 @@ protected:
     /**
      *  Private destructor because userspace is not supposed to destruct this
      */
-    virtual ~Operation() = default;
+    virtual ~Operation();
 
 public:
     /**
@@ -97,6 +104,13 @@ public:
      *  Cancel the operation
      */
     virtual void cancel();
+    
+    /**
+     *  Make the operation part of a batch (the completion is notified when the operation is destructed)
+     *  @param  completion
+     *  @internal
+     */
+    void track(Completion *completion);
 };
 
 /**
@@ -0,0 +1,145 @@
+/**
+ *  Options.h
+ *
+ *  Per-query options that can be passed to Context::query(). These options
+ *  control how the query is scheduled by the context, and do not end up
+ *  in the query message that is sent to the nameserver (use the Bits class
+ *  for that).
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stdint.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  The priority classes. When the context is busy, interactive lookups are
+ *  always started before the others, and normal lookups are started more
+ *  often than bulk lookups (but a bulk backlog still makes progress)
+ *
+ *      interactive:    someone is waiting for the result (for example a user request)
+ *      normal:         the default
+ *      bulk:           large batches for which throughput matters more than latency
+ *
+ *  @var Priority
+ */
+enum class Priority
+{
+    interactive     =   0,
+    normal          =   1,
+    bulk            =   2
+};
+
+/**
+ *  Class definition
+ */
+class Options
+{
+private:
+    /**
+     *  The priority class
+     *  @var Priority
+     */
+    Priority _priority;
+
+    /**
+     *  The tenant (or flow) to which the query belongs. When the context is busy,
+     *  the tenants take turns, so that a single tenant cannot starve the others
+     *  @var uint64_t
+     */
+    uint64_t _tenant;
+
+    /**
+     *  Absolute time (as returned by DNS::Now) at which the caller is no longer
+     *  interested in the result (zero when there is no deadline)
+     *  @var double
+     */
+    double _deadline = 0.0;
+
+    /**
+     *  Max number of datagrams to send (zero to use the setting of the context)
+     *  @var size_t
+     */
+    size_t _attempts = 0;
+
+public:
+    /**
+     *  Constructor
+     *  @param  priority    the priority class
+     *  @param  tenant      the tenant to which the query belongs
+     */
+    Options(Priority priority = Priority::normal, uint64_t tenant = 0) : _priority(priority), _tenant(tenant) {}
+
+    /**
+     *  Destructor
+     */
+    virtual ~Options() = default;
+
+    /**
+     *  The priority class
+     *  @return Priority
+     */
+    Priority priority() const { return _priority; }
+
+    /**
+     *  Change the priority class
+     *  @param  value
+     */
+    void priority(Priority value) { _priority = value; }
+
+    /**
+     *  The tenant to which the query belongs
+     *  @return uint64_t
+     */
+    uint64_t tenant() const { return _tenant; }
+
+    /**
+     *  Change the tenant
+     *  @param  value
+     */
+    void tenant(uint64_t value) { _tenant = value; }
+
+    /**
+     *  The deadline: absolute time after which the result is no longer needed (or zero)
+     *  @return double
+     */
+    double deadline() const { return _deadline; }
+
+    /**
+     *  Set the deadline. When the query has not completed by then, it is given
+     *  up and Handler::onExpired() is called. Datagrams that cannot be answered
+     *  before the deadline are not sent at all.
+     *  @param  value       absolute time, for example DNS::Now() + 0.2
+     */
+    void deadline(double value) { _deadline = value; }
+
+    /**
+     *  The max number of datagrams to send (or zero to use the setting of the context)
+     *  @return size_t
+     */
+    size_t attempts() const { return _attempts; }
+
+    /**
+     *  Set the max number of datagrams to send
+     *  @param  value
+     */
+    void attempts(size_t value) { _attempts = value; }
+};
+
+/**
+ *  End of namespace
+ */
+}
+
@@ -121,6 +121,12 @@ private:
     bool edns(bool dnssec);
 
 public:
+    /**
+     *  The max size of a response that is advertised in the edns pseudo-section
+     *  @var uint16_t
+     */
+    static const uint16_t PAYLOAD = 1200;
+
     /**
      *  Constructor
      *  @param  op          the type of operation (normally a regular query)
@@ -169,6 +175,12 @@ public:
      *  @return uint16_t
      */
     uint16_t id() const;
+
+    /**
+     *  Change the ID (this is done when the query is assigned to a socket)
+     *  @param  id
+     */
+    void id(uint16_t id);
     
     /**
      *  The opcode
@@ -0,0 +1,229 @@
+/**
+ *  Queue.h
+ *
+ *  Queue of lookups that are waiting to be processed, with one list per
+ *  priority class. Interactive lookups always come out first, and normal
+ *  and bulk lookups come out in a weighted order, so that a large bulk
+ *  backlog does not hold up the other lookups, while it still makes
+ *  progress itself.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "lookups.h"
+#include "lookup.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ *  The LIST is the type that holds the lookups of a single priority class
+ */
+template <typename LIST = Lookups>
+class Queue
+{
+private:
+    /**
+     *  Number of priority classes
+     *  @var size_t
+     */
+    static const size_t CLASSES = 3;
+
+    /**
+     *  Number of normal lookups that come out for each bulk lookup
+     *  @var size_t
+     */
+    static const size_t WEIGHT = 8;
+
+    /**
+     *  One list per priority class
+     *  @var LIST
+     */
+    LIST _lists[CLASSES];
+
+    /**
+     *  Number of normal lookups that came out since the last bulk lookup
+     *  @var size_t
+     */
+    size_t _turns = 0;
+
+    /**
+     *  The list of a priority class
+     *  @param  priority
+     *  @return LIST
+     */
+    LIST &list(Priority priority) { return _lists[size_t(priority)]; }
+
+    /**
+     *  The priority classes in the order in which they should be tried
+     *  @param  result      array that is filled with the classes
+     */
+    void order(Priority result[CLASSES]) const
+    {
+        // interactive lookups always go first
+        result[0] = Priority::interactive;
+
+        // bulk gets a turn after a number of normal lookups
+        result[1] = _turns < WEIGHT ? Priority::normal : Priority::bulk;
+        result[2] = _turns < WEIGHT ? Priority::bulk : Priority::normal;
+    }
+
+    /**
+     *  Update the bookkeeping after a lookup of a certain class came out
+     *  @param  priority
+     */
+    void taken(Priority priority)
+    {
+        // a bulk lookup resets the counter
+        if (priority == Priority::bulk) _turns = 0;
+
+        // normal lookups only count when bulk lookups are waiting for them
+        else if (priority == Priority::normal && !list(Priority::bulk).empty()) _turns += 1;
+    }
+
+public:
+    /**
+     *  Constructor
+     */
+    Queue() = default;
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Queue(const Queue &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Queue() = default;
+
+    /**
+     *  Is the queue empty?
+     *  @return bool
+     */
+    bool empty() const
+    {
+        // check all lists
+        for (const auto &list : _lists) if (!list.empty()) return false;
+
+        // all lists are empty
+        return true;
+    }
+
+    /**
+     *  Number of lookups in the queue
+     *  @return size_t
+     */
+    size_t size() const
+    {
+        // result variable
+        size_t result = 0;
+
+        // add all lists
+        for (const auto &list : _lists) result += list.size();
+
+        // done
+        return result;
+    }
+
+    /**
+     *  Add a lookup to the end of the list of its priority class
+     *  @param  lookup
+     */
+    void push_back(Lookup *lookup)
+    {
+        // add to the appropriate list
+        list(lookup->options().priority()).push_back(lookup);
+    }
+
+    /**
+     *  Remove the lookup that should come out next
+     *  @return Lookup      the removed lookup (or nullptr if the queue was empty)
+     */
+    Lookup *pop_front()
+    {
+        // the order in which the classes are tried
+        Priority priorities[CLASSES]; order(priorities);
+
+        // take the first lookup from the first class that has one
+        for (auto priority : priorities)
+        {
+            // take out the lookup
+            auto *lookup = list(priority).pop_front();
+
+            // try the next class if this one was empty
+            if (lookup == nullptr) continue;
+
+            // update bookkeeping
+            taken(priority);
+
+            // expose the lookup
+            return lookup;
+        }
+
+        // the queue was empty
+        return nullptr;
+    }
+
+    /**
+     *  Remove the lookup that should come out next, and that can be admitted
+     *  @param  admit       function that is called to admit a lookup
+     *  @return Lookup      the admitted lookup (or nullptr if no lookup could be admitted)
+     */
+    template <typename ADMIT>
+    Lookup *pop_front(const ADMIT &admit)
+    {
+        // the order in which the classes are tried
+        Priority priorities[CLASSES]; order(priorities);
+
+        // take the first lookup that can be admitted
+        for (auto priority : priorities)
+        {
+            // take out the lookup
+            auto *lookup = list(priority).pop_front(admit);
+
+            // try the next class if this one has nothing to admit
+            if (lookup == nullptr) continue;
+
+            // update bookkeeping
+            taken(priority);
+
+            // expose the lookup
+            return lookup;
+        }
+
+        // nothing could be admitted
+        return nullptr;
+    }
+
+    /**
+     *  Remove a lookup from the queue
+     *  @param  lookup
+     *  @return bool        was it indeed part of this queue?
+     */
+    bool remove(Lookup *lookup)
+    {
+        // it can only be in the list of its own class
+        return list(lookup->options().priority()).remove(lookup);
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
+
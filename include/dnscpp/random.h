@@ -0,0 +1,101 @@
+/**
+ *  Random.h
+ *
+ *  Fast cryptographically secure random number generator, based on the
+ *  ChaCha20 stream cipher. The key is taken from the random source of the
+ *  operating system, and the keystream is handed out in pieces. This is
+ *  used for the ids of the queries, that should not be guessable, without
+ *  a system call for each of them (and without the lock inside rand()).
+ *
+ *  This is an internal class that is not accessible from user space. It is
+ *  not thread-safe: each context (or thread) has its own generator.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Random
+{
+private:
+    /**
+     *  The state of the cipher: constants, key, counter and nonce
+     *  @var uint32_t[]
+     */
+    uint32_t _state[16];
+
+    /**
+     *  The keystream of the current block
+     *  @var uint32_t[]
+     */
+    uint32_t _block[16];
+
+    /**
+     *  Number of words of the block that were handed out
+     *  @var size_t
+     */
+    size_t _used = 16;
+
+    /**
+     *  Generate the next block of the keystream
+     */
+    void refill();
+
+public:
+    /**
+     *  Constructor
+     */
+    Random();
+
+    /**
+     *  No copying (the copy would produce the same numbers)
+     *  @param  that
+     */
+    Random(const Random &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Random();
+
+    /**
+     *  Get the next random number
+     *  @return uint32_t
+     */
+    uint32_t next()
+    {
+        // generate a new block when the current one is used up
+        if (_used == 16) refill();
+
+        // expose the next word
+        return _block[_used++];
+    }
+
+    /**
+     *  Get a random 16-bit number
+     *  @return uint16_t
+     */
+    uint16_t u16() { return next() & 0xffff; }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -50,6 +50,12 @@ private:
      */
     std::string _buffer;
 
+    /**
+     *  Index of the socket of the nameserver on which it was received
+     *  @var size_t
+     */
+    size_t _socket = 0;
+
 public:
     /**
      *  Constructor
@@ -88,6 +94,13 @@ public:
      *  @return size_t
      */
     size_t size() const { return _buffer.size(); }
+
+    /**
+     *  Index of the socket of the nameserver on which it was received
+     *  @return size_t
+     */
+    size_t socket() const { return _socket; }
+    void socket(size_t index) { _socket = index; }
 };
 
 /**
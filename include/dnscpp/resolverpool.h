@@ -0,0 +1,127 @@
+/**
+ *  ResolverPool.h
+ *
+ *  A context runs in a single thread. To use more cores, the resolver pool
+ *  starts a number of threads, each with its own event loop and its own
+ *  context. Queries are passed to the threads by the hash of the name, so
+ *  that identical queries end up in the same thread (where they can share
+ *  lookups and cached responses). Passing queries and results between the
+ *  threads does not take locks: the workers are woken up through a lock-free
+ *  queue, and each worker has its own single-producer queue for the results.
+ *
+ *  The query methods of the pool report the results in the thread that owns
+ *  the pool, via the event loop of that thread, and they should only be
+ *  called from that thread. Other threads can submit queries at the same
+ *  time through a Channel of their own: the results then come back in the
+ *  thread of the channel.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <vector>
+#include <memory>
+#include <functional>
+#include <arpa/nameser.h>
+#include "channel.h"
+#include "bits.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Loop;
+class Context;
+class Handler;
+class Operation;
+class Worker;
+
+/**
+ *  Class definition
+ */
+class ResolverPool
+{
+private:
+    /**
+     *  The worker threads (this does not change after construction, so any thread may read it)
+     *  @var std::vector
+     */
+    std::vector<std::unique_ptr<Worker>> _workers;
+
+    /**
+     *  The channel of the thread that owns the pool
+     *  @var std::unique_ptr
+     */
+    std::unique_ptr<Channel> _channel;
+
+    /**
+     *  The worker that handles a certain domain (this can be called from any thread)
+     *  @param  domain      the domain
+     *  @return Worker
+     */
+    Worker *route(const char *domain) const;
+
+    /**
+     *  The channels pass their queries to the workers
+     */
+    friend class Channel;
+
+public:
+    /**
+     *  Constructor
+     *  @param  loop        the event loop of the calling thread (through which results are reported)
+     *  @param  threads     number of worker threads
+     *  @param  defaults    should the contexts load the system settings (/etc/resolv.conf and /etc/hosts)?
+     *  @param  setup       function that is called in each worker thread to configure its context
+     *  @param  pin         should the worker threads be bound to a cpu each?
+     *  @throws std::runtime_error, or the exception of a worker thread whose context could not be created or set up
+     */
+    ResolverPool(Loop *loop, size_t threads, bool defaults = true, const std::function<void(Context *)> &setup = nullptr, bool pin = false);
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    ResolverPool(const ResolverPool &that) = delete;
+
+    /**
+     *  Destructor
+     *  This stops the worker threads, the operations of the owning thread that are still in progress
+     *  are cancelled (the channels of other threads must already have been destructed)
+     */
+    virtual ~ResolverPool();
+
+    /**
+     *  Number of worker threads
+     *  @return size_t
+     */
+    size_t threads() const { return _workers.size(); }
+
+    /**
+     *  Do a dns lookup
+     *  @param  domain      the record name to look for
+     *  @param  type        type of record (normally you ask for an 'a' record)
+     *  @param  bits        bits to include in the query
+     *  @param  handler     object that will be notified when the query is ready
+     *  @return Operation   object to interact with the operation while it is in progress (or nullptr when the domain is invalid)
+     */
+    Operation *query(const char *domain, ns_type type, const Bits &bits, Handler *handler) { return _channel->query(domain, type, bits, handler); }
+    Operation *query(const char *domain, ns_type type, Handler *handler) { return _channel->query(domain, type, handler); }
+};
+
+/**
+ *  End of namespace
+ */
+}
+
@@ -0,0 +1,608 @@
+/**
+ *  SharedCache.h
+ *
+ *  Cache of responses that can be shared by contexts that run on different
+ *  threads. A context is single-threaded, so processes that run a context
+ *  per thread would otherwise keep a separate cache in every thread, and
+ *  fetch every response from the nameservers once per thread.
+ *
+ *  The cache is split into shards by the hash of the name. Every shard has
+ *  a lock, but only threads that store responses take it. A lookup does not
+ *  lock anything: the entries are immutable once they are published in the
+ *  hash table of the shard, and an entry that is replaced or evicted is only
+ *  deallocated after all lookups that could still be reading it are done
+ *  (readers register themselves in one of two counters of the shard, and the
+ *  writer only recycles the memory of a generation when its counter dropped
+ *  to zero). Expired entries are therefore not removed by lookups, but by
+ *  the threads that store responses. The eviction is the same as in the
+ *  Cache class (S3-FIFO), and the capacity is divided equally over the shards.
+ *
+ *  The shared cache must outlive the contexts that use it.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "cache.h"
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class SharedCache
+{
+private:
+    /**
+     *  A single cached response, all members except the frequency are only
+     *  modified by the writer, and the readers only access the ones that
+     *  do not change after the entry was published
+     */
+    struct Entry
+    {
+        /**
+         *  The key under which it is stored, and its hash
+         *  @var std::string
+         */
+        std::string key;
+        size_t hash = 0;
+
+        /**
+         *  The response in wire format, and the offsets of the TTL fields
+         *  @var std::vector
+         */
+        std::vector<unsigned char> data;
+        std::vector<uint16_t> ttls;
+
+        /**
+         *  Time at which the response was stored, and at which it expires
+         *  @var double
+         */
+        double stored = 0.0;
+        double expires = 0.0;
+
+        /**
+         *  Upper limit for the TTLs of the records
+         *  @var uint32_t
+         */
+        uint32_t limit = UINT32_MAX;
+
+        /**
+         *  Number of times the entry was used since it was last looked at by the eviction (max 3)
+         *  @var std::atomic<uint8_t>
+         */
+        std::atomic<uint8_t> frequency;
+
+        /**
+         *  Is the entry in the main queue, and where (only used by the writer)
+         *  @var bool
+         */
+        bool main = false;
+        std::list<Entry*>::iterator position;
+
+        /**
+         *  Constructor
+         */
+        Entry() : frequency(0) {}
+
+        /**
+         *  Number of bytes that the entry takes (approximately)
+         *  @return size_t
+         */
+        size_t bytes() const { return sizeof(Entry) + 2 * key.size() + data.size() + ttls.size() * sizeof(uint16_t); }
+    };
+
+    /**
+     *  Hash table with open addressing, the readers probe it without a lock,
+     *  so entries are never moved: removed entries leave a tombstone behind,
+     *  and when the table fills up the writer publishes a bigger copy
+     */
+    struct Table
+    {
+        /**
+         *  The slots (the number of slots is a power of two)
+         *  @var std::unique_ptr
+         */
+        std::unique_ptr<std::atomic<Entry*>[]> slots;
+
+        /**
+         *  Number of slots minus one
+         *  @var size_t
+         */
+        size_t mask;
+
+        /**
+         *  Number of slots that are not empty (including tombstones, only used by the writer)
+         *  @var size_t
+         */
+        size_t used = 0;
+
+        /**
+         *  Constructor
+         *  @param  size        number of slots (a power of two)
+         */
+        Table(size_t size) : slots(new std::atomic<Entry*>[size]), mask(size - 1)
+        {
+            // all slots start empty
+            for (size_t i = 0; i < size; ++i) slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+
+        /**
+         *  Find the slot that holds an entry (writer only)
+         *  @param  entry       the entry to look for
+         *  @return std::atomic<Entry*>     the slot (or nullptr if the entry is not in the table)
+         */
+        std::atomic<Entry*> *locate(const Entry *entry)
+        {
+            // follow the probe sequence until the entry or an empty slot is found
+            for (size_t i = entry->hash & mask; ; i = (i + 1) & mask)
+            {
+                // the entry in this slot
+                Entry *current = slots[i].load(std::memory_order_relaxed);
+
+                // check if we found it
+                if (current == entry) return &slots[i];
+                if (current == nullptr) return nullptr;
+            }
+        }
+
+        /**
+         *  Store an entry in the first free slot of its probe sequence (writer only)
+         *  @param  entry       the entry to store
+         */
+        void place(Entry *entry)
+        {
+            // follow the probe sequence until an empty slot or a tombstone is found
+            for (size_t i = entry->hash & mask; ; i = (i + 1) & mask)
+            {
+                // the entry in this slot
+                Entry *current = slots[i].load(std::memory_order_relaxed);
+
+                // skip slots that are in use
+                if (current != nullptr && current != &_removed) continue;
+
+                // an empty slot becomes used
+                if (current == nullptr) used += 1;
+
+                // publish the entry
+                slots[i].store(entry, std::memory_order_release); return;
+            }
+        }
+    };
+
+    /**
+     *  A part of the cache, the members that the writers change, the members that
+     *  the readers only read, and the counters that every reader changes are on
+     *  separate cache lines, so that they do not invalidate each other
+     */
+    struct Shard
+    {
+        /**
+         *  The lock that is taken by the writers
+         *  @var std::mutex
+         */
+        std::mutex mutex;
+
+        /**
+         *  Entries and tables that were removed in an even and odd generation,
+         *  and that may still be read by readers of that generation
+         *  @var std::vector
+         */
+        std::vector<std::unique_ptr<Entry>> entries[2];
+        std::vector<std::unique_ptr<Table>> tables[2];
+
+        /**
+         *  The queues of the eviction, new entries are added to the front and evicted from the back
+         *  @var std::list<Entry*>
+         */
+        std::list<Entry*> smallqueue;
+        std::list<Entry*> mainqueue;
+
+        /**
+         *  Keys of the entries that were recently evicted from the small queue, and an index to find them
+         *  @var std::list
+         */
+        std::list<std::string> ghostqueue;
+        std::unordered_map<std::string, std::list<std::string>::iterator> ghosts;
+
+        /**
+         *  Max number of bytes to use, the number of bytes in use, and in use by the small queue
+         *  @var size_t
+         */
+        size_t capacity = 0;
+        size_t bytes = 0;
+        size_t small = 0;
+
+        /**
+         *  The hash table that the readers use (this starts a new cache line)
+         *  @var std::atomic<Table*>
+         */
+        alignas(64) std::atomic<Table*> table;
+
+        /**
+         *  The current generation (this rarely changes)
+         *  @var std::atomic<size_t>
+         */
+        std::atomic<size_t> generation;
+
+        /**
+         *  The number of readers that entered in an even and odd generation (on a cache line of their own)
+         *  @var std::atomic<size_t>
+         */
+        alignas(64) std::atomic<size_t> readers[2];
+
+        /**
+         *  Constructor
+         */
+        Shard() : table(nullptr), generation(0), readers{ {0}, {0} } {}
+
+        /**
+         *  Destructor
+         */
+        ~Shard()
+        {
+            // deallocate the entries and the table
+            for (auto *entry : smallqueue) delete entry;
+            for (auto *entry : mainqueue) delete entry;
+            delete table.load();
+        }
+    };
+
+    /**
+     *  Counters of the lookups, every thread updates the counters of its own stripe
+     *  (each on its own cache line), so that threads do not write to the same line
+     */
+    struct alignas(64) Statistics
+    {
+        /**
+         *  The counters
+         *  @var std::atomic<size_t>
+         */
+        std::atomic<size_t> hits;
+        std::atomic<size_t> misses;
+        std::atomic<size_t> stale;
+
+        /**
+         *  Constructor
+         */
+        Statistics() : hits(0), misses(0), stale(0) {}
+    };
+
+    /**
+     *  Reader of a shard, that keeps the entries alive for as long as it exists
+     */
+    class Reader
+    {
+    private:
+        /**
+         *  The shard
+         *  @var Shard
+         */
+        Shard &_shard;
+
+        /**
+         *  The counter in which the reader registered itself
+         *  @var size_t
+         */
+        size_t _parity;
+
+    public:
+        /**
+         *  Constructor
+         *  @param  shard       the shard to read
+         */
+        Reader(Shard &shard);
+
+        /**
+         *  Destructor
+         */
+        ~Reader() { _shard.readers[_parity].fetch_sub(1); }
+    };
+
+    /**
+     *  Number of stripes with statistics
+     *  @var size_t
+     */
+    static const size_t STRIPES = 32;
+
+    /**
+     *  The shards (aligned to cache lines, which operator new does not do before C++17)
+     *  @var Shard
+     */
+    Shard *_shards;
+
+    /**
+     *  Number of shards
+     *  @var size_t
+     */
+    const size_t _count;
+
+    /**
+     *  The stripes with statistics (aligned to cache lines)
+     *  @var Statistics
+     */
+    Statistics *_statistics;
+
+    /**
+     *  Max number of bytes to use (all shards together)
+     *  @var std::atomic<size_t>
+     */
+    std::atomic<size_t> _total;
+
+    /**
+     *  Number of seconds that expired responses are kept
+     *  @var std::atomic<double>
+     */
+    std::atomic<double> _keep;
+
+    /**
+     *  The marker that is left behind in the hash table when an entry is removed
+     *  @var Entry
+     */
+    static Entry _removed;
+
+    /**
+     *  The stripe with statistics of the calling thread
+     *  @return Statistics
+     */
+    Statistics &statistics() const;
+
+    /**
+     *  Find the shard that holds a key (a key and its NXDOMAIN key end up in the same shard)
+     *  @param  key         the key
+     *  @return Shard
+     */
+    Shard &shard(const std::string &key) const;
+
+    /**
+     *  Find an entry in the hash table (this can be called by readers and by the writer)
+     *  @param  shard       the shard
+     *  @param  key         the key to look for
+     *  @param  hash        hash of the key
+     *  @return Entry       the entry (or nullptr if there is no such entry)
+     */
+    static Entry *find(Shard &shard, const std::string &key, size_t hash);
+
+    /**
+     *  Find an entry that has not yet expired, and copy its response (readers only)
+     *  @param  shard       the shard
+     *  @param  key         the key to look for
+     *  @param  now         current time
+     *  @param  result      buffer that is filled with the response
+     *  @return Entry       the entry (or nullptr if there is no such entry)
+     */
+    static Entry *copy(Shard &shard, const std::string &key, double now, std::vector<unsigned char> &result);
+
+    /**
+     *  Publish an entry in the hash table, the table is replaced by a bigger one when it fills up (writer only)
+     *  @param  shard       the shard
+     *  @param  entry       the entry to publish
+     */
+    static void publish(Shard &shard, Entry *entry);
+
+    /**
+     *  Remove an entry from the hash table and the queues (writer only)
+     *  @param  shard       the shard
+     *  @param  entry       the entry to remove
+     */
+    static void erase(Shard &shard, Entry *entry);
+
+    /**
+     *  Remember the key of an entry that is evicted from the small queue (writer only)
+     *  @param  shard       the shard
+     *  @param  key         the key
+     */
+    static void haunt(Shard &shard, const std::string &key);
+
+    /**
+     *  Evict entries until the shard fits in its capacity (writer only)
+     *  @param  shard       the shard
+     */
+    static void shrink(Shard &shard);
+
+    /**
+     *  Remove the entries at the back of the queues that expired too long ago (writer only)
+     *  @param  shard       the shard
+     *  @param  now         current time
+     */
+    void reap(Shard &shard, double now);
+
+    /**
+     *  Deallocate the entries and tables that can no longer be read (writer only)
+     *  @param  shard       the shard
+     */
+    static void reclaim(Shard &shard);
+
+    /**
+     *  Store an entry, in the back of its queue (writer only)
+     *  @param  shard       the shard
+     *  @param  entry       the entry to store
+     *  @return bool        was the entry stored? (not when it was already there, or when it does not fit)
+     */
+    static bool restore(Shard &shard, std::unique_ptr<Entry> entry);
+
+    /**
+     *  Helper method to add up a statistic of all shards
+     *  @param  callback    function that returns the statistic of a single shard (which is locked)
+     *  @return size_t
+     */
+    template <typename CALLBACK>
+    size_t sum(const CALLBACK &callback) const
+    {
+        // the result variable
+        size_t result = 0;
+
+        // add up all shards
+        for (size_t i = 0; i < _count; ++i)
+        {
+            // lock the shard
+            std::lock_guard<std::mutex> lock(_shards[i].mutex);
+
+            // add its statistic
+            result += callback(_shards[i]);
+        }
+
+        // done
+        return result;
+    }
+
+public:
+    /**
+     *  Constructor
+     *  @param  capacity    max number of bytes to use (zero to disable the cache)
+     *  @param  shards      number of shards (more shards means less waiting for the writers, but a coarser eviction)
+     */
+    SharedCache(size_t capacity, size_t shards = 64);
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    SharedCache(const SharedCache &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    ~SharedCache();
+
+    /**
+     *  Is the cache enabled?
+     *  @return bool
+     */
+    bool enabled() const { return _total.load(std::memory_order_relaxed) > 0; }
+
+    /**
+     *  Max number of bytes to use
+     *  @return size_t
+     */
+    size_t capacity() const { return _total; }
+
+    /**
+     *  Change the max number of bytes to use (entries are evicted if the cache is too big)
+     *  @param  value       the new capacity (zero to disable the cache)
+     */
+    void capacity(size_t value);
+
+    /**
+     *  Number of bytes in use (approximately)
+     *  @return size_t
+     */
+    size_t bytes() const { return sum([](const Shard &shard) { return shard.bytes; }); }
+
+    /**
+     *  Number of cached responses
+     *  @return size_t
+     */
+    size_t size() const { return sum([](const Shard &shard) { return shard.smallqueue.size() + shard.mainqueue.size(); }); }
+
+    /**
+     *  Number of lookups that were answered from the cache
+     *  @return size_t
+     */
+    size_t hits() const;
+
+    /**
+     *  Number of lookups that could not be answered from the cache
+     *  @return size_t
+     */
+    size_t misses() const;
+
+    /**
+     *  Number of lookups that were answered with an expired response
+     *  @return size_t
+     */
+    size_t stale() const;
+
+    /**
+     *  Number of seconds that expired responses are kept
+     *  @return double
+     */
+    double retention() const { return _keep.load(std::memory_order_relaxed); }
+
+    /**
+     *  Change the number of seconds that expired responses are kept
+     *  @param  value       the new retention (zero to remove responses as soon as they expire)
+     */
+    void retention(double value) { _keep = std::max(value, 0.0); }
+
+    /**
+     *  Store a response
+     *  @param  key         the key under which it is stored
+     *  @param  response    the response to store
+     *  @param  now         current time
+     *  @return bool        was the response stored?
+     */
+    bool insert(const std::string &key, const Response &response, double now);
+
+    /**
+     *  Look up a response (this does not take a lock)
+     *  @param  key         the key to look for
+     *  @param  now         current time
+     *  @param  result      buffer that is filled with the response (with decremented TTLs)
+     *  @param  remaining   optional variable that is filled with the part of the TTL that is left (between 0 and 1)
+     *  @return bool        was the response found?
+     */
+    bool lookup(const std::string &key, double now, std::vector<unsigned char> &result, double *remaining = nullptr);
+
+    /**
+     *  Look up a response that can be stored under two keys (this counts as a single lookup, and does not take a lock)
+     *  @param  key         the key to look for first
+     *  @param  fallback    the key to look for next (for the same name)
+     *  @param  now         current time
+     *  @param  result      buffer that is filled with the response (with decremented TTLs)
+     *  @return bool        was the response found?
+     */
+    bool lookup(const std::string &key, const std::string &fallback, double now, std::vector<unsigned char> &result);
+
+    /**
+     *  Look up a response that has expired, but that is still retained (this does not take a lock)
+     *  @param  key         the key to look for
+     *  @param  now         current time
+     *  @param  result      buffer that is filled with the response (with the TTLs set to 30 seconds)
+     *  @return bool        was an expired response found?
+     */
+    bool expired(const std::string &key, double now, std::vector<unsigned char> &result);
+
+    /**
+     *  Remove all responses
+     */
+    void clear();
+
+    /**
+     *  Write all responses to a snapshot file (the file is replaced atomically)
+     *  @param  filename    the file to write
+     *  @return bool        was the snapshot written?
+     */
+    bool save(const char *filename) const;
+
+    /**
+     *  Load the responses from a snapshot file (responses that already expired are skipped,
+     *  and responses that are already in the cache are not replaced)
+     *  @param  filename    the file to read
+     *  @param  now         current time
+     *  @return size_t      number of responses that were loaded
+     */
+    size_t load(const char *filename, double now);
+};
+
+/**
+ *  End of namespace
+ */
+}
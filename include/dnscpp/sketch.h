@@ -0,0 +1,143 @@
+/**
+ *  Sketch.h
+ *
+ *  Count-min sketch that estimates how often a key was seen recently. This
+ *  is used to find the names that are looked up most often (the "heavy
+ *  hitters"), without having to keep a counter for every name. The sketch
+ *  never underestimates, and it overestimates only a little when the number
+ *  of counters is large compared to the number of popular keys. To make sure
+ *  that the counts reflect recent traffic, all counters are halved after a
+ *  fixed number of increments.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Sketch
+{
+private:
+    /**
+     *  Number of rows (each row uses a different hash function)
+     *  @var size_t
+     */
+    static const size_t DEPTH = 4;
+
+    /**
+     *  Number of counters per row
+     *  @var size_t
+     */
+    static const size_t WIDTH = 4096;
+
+    /**
+     *  The counters are halved after this many increments
+     *  @var size_t
+     */
+    static const size_t PERIOD = 8 * WIDTH;
+
+    /**
+     *  The counters (allocated when the sketch is first used)
+     *  @var std::vector
+     */
+    std::vector<uint16_t> _counters;
+
+    /**
+     *  Number of increments since the counters were last halved
+     *  @var size_t
+     */
+    size_t _increments = 0;
+
+    /**
+     *  Halve all counters
+     */
+    void age()
+    {
+        // halve all counters
+        for (auto &counter : _counters) counter >>= 1;
+
+        // start a new period
+        _increments = 0;
+    }
+
+public:
+    /**
+     *  Constructor
+     */
+    Sketch() = default;
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Sketch(const Sketch &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Sketch() = default;
+
+    /**
+     *  Count one more occurrence of a key
+     *  @param  key
+     *  @return size_t      estimated number of recent occurrences (including this one)
+     */
+    size_t increment(const std::string &key)
+    {
+        // allocate the counters on first use
+        if (_counters.empty()) _counters.resize(DEPTH * WIDTH, 0);
+
+        // the counters are halved every period
+        if (++_increments > PERIOD) age();
+
+        // the row-hashes are derived from two halves of a single hash
+        uint64_t hash = std::hash<std::string>()(key);
+        uint32_t h1 = hash, h2 = (hash >> 32) | 1;
+
+        // the result is the lowest counter
+        size_t result = SIZE_MAX;
+
+        // update one counter in each row
+        for (size_t row = 0; row < DEPTH; ++row)
+        {
+            // the counter in this row
+            auto &counter = _counters[row * WIDTH + (h1 + row * h2) % WIDTH];
+
+            // increment (without overflowing)
+            if (counter < UINT16_MAX) counter += 1;
+
+            // the estimate is the lowest counter
+            result = std::min(result, size_t(counter));
+        }
+
+        // expose the estimate
+        return result;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
+
@@ -25,6 +25,7 @@
 #include "received.h"
 #include <list>
 #include <string>
+#include <memory>
 
 /**
  *  Begin of namespace
@@ -39,12 +40,38 @@ class Query;
 class Loop;
 class Ip;
 class Response;
+class Uring;
 
 /**
  *  Class definition
  */
 class Udp : private Monitor
 {
+private:
+    /**
+     *  A datagram that is waiting to be sent
+     */
+    struct Pending
+    {
+        /**
+         *  The query to send (the buffer of the query is not copied)
+         *  @var Query
+         */
+        const Query *query;
+
+        /**
+         *  The address to send to
+         *  @var struct sockaddr_in6
+         */
+        struct sockaddr_in6 address;
+
+        /**
+         *  Size of the address
+         *  @var socklen_t
+         */
+        socklen_t size;
+    };
+
 public:
     /**
      *  Interface that can be implemented by listeners
@@ -54,12 +81,22 @@ public:
     public:
         /**
          *  Method that is called when a response is received
+         *  @param  udp         the socket that received it
          *  @param  time        receive-time
          *  @param  address     the address of the nameserver from which it is received
          *  @param  response    the received response
          *  @param  size        size of the response
          */
-        virtual void onReceived(time_t now, const struct sockaddr *addr, const unsigned char *response, size_t size) = 0;
+        virtual void onReceived(Udp *udp, time_t now, const struct sockaddr *addr, const unsigned char *response, size_t size) = 0;
+
+        /**
+         *  Method that is called when a batch of responses is received. The handler can
+         *  splice the messages that it wants to keep out of the list, the rest is discarded.
+         *  @param  udp         the socket that received them
+         *  @param  time        receive-time
+         *  @param  responses   the received responses
+         */
+        virtual void onReceived(Udp *udp, time_t now, std::list<Received> &responses) = 0;
     };
 
     /**
@@ -88,11 +125,44 @@ private:
      */
     void *_identifier = nullptr;
 
+    /**
+     *  The io_uring instance through which the socket is read and written (if any),
+     *  and the identifier of the receive operation
+     *  @var Uring
+     */
+    Uring *_uring = nullptr;
+    void *_receiver = nullptr;
+
     /**
      *  The object that is interested in handling responses
      *  @var Handler
      */
     Handler *_handler;
+
+    /**
+     *  Number of datagrams that are received (and sent) with a single system call
+     *  @var size_t
+     */
+    static const size_t BATCH = 64;
+
+    /**
+     *  Slots in which a batch of datagrams is received, every slot is as big as the
+     *  response size that the queries advertise (allocated when the socket is opened)
+     *  @var std::unique_ptr<unsigned char[]>
+     */
+    std::unique_ptr<unsigned char[]> _ring;
+
+    /**
+     *  Datagrams that are sent by the next call to flush()
+     *  @var std::vector
+     */
+    std::vector<Pending> _pending;
+
+    /**
+     *  Is the socket full, so that we wait for it to become writable?
+     *  @var bool
+     */
+    bool _blocked = false;
     
     /**
      *  Method that is called from user-space when the socket becomes readable.
@@ -100,7 +170,7 @@ private:
     virtual void notify() override;
     
     /**
-     *  Send a query to a certain nameserver
+     *  Queue a query for a certain nameserver
      *  @param  address     target address
      *  @param  size        size of the address
      *  @param  query       query to send
@@ -108,6 +178,12 @@ private:
      */
     bool send(const struct sockaddr *address, size_t size, const Query &query);
 
+    /**
+     *  Wait for the socket to become writable because it is full
+     *  @param  sent        number of queued datagrams that were sent
+     */
+    void block(size_t sent);
+
     /**
      *  Open the socket (this is optional, the socket is automatically opened when you start sending to it)
      *  @param  version
@@ -115,6 +191,20 @@ private:
      */
     bool open(int version);
 
+    /**
+     *  Method that is called by io_uring when a datagram was received
+     *  @param  now         receive-time
+     *  @param  address     the address from which it is received
+     *  @param  response    the received response
+     *  @param  size        size of the response
+     */
+    void received(time_t now, const struct sockaddr *address, const unsigned char *response, size_t size) { _handler->onReceived(this, now, address, response, size); }
+
+    /**
+     *  io_uring passes the datagrams that it receives
+     */
+    friend class Uring;
+
 
 public:
     /**
@@ -137,13 +227,33 @@ public:
     virtual ~Udp();
 
     /**
-     *  Send a query to the socket
+     *  Queue a query to be sent over the socket. The query is sent by the next call
+     *  to flush(), so it must stay valid until then (or be passed to cancel())
      *  Watch out: you need to be consistent in calling this with either ipv4 or ipv6 addresses
      *  @param  ip      IP address of the target nameserver
+     *  @param  port    the port on which it listens
      *  @param  query   the query to send
      *  @return bool
      */
-    bool send(const Ip &ip, const Query &query);
+    bool send(const Ip &ip, uint16_t port, const Query &query);
+
+    /**
+     *  Is the socket full? Queries are still accepted then, but they stay in the queue
+     *  until the socket is writable again
+     *  @return bool
+     */
+    bool blocked() const { return _blocked; }
+
+    /**
+     *  Forget a query that was queued but not yet sent
+     *  @param  query   the query
+     */
+    void cancel(const Query &query);
+
+    /**
+     *  Send all queued queries (with as few system calls as possible)
+     */
+    void flush();
 
     /**
      *  Close the socket (this is useful if you do not expect incoming data anymore)
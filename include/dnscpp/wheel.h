@@ -0,0 +1,192 @@
+/**
+ *  Wheel.h
+ *
+ *  Hierarchical timer wheel that is used by the core to keep track of
+ *  the lookups that are in progress. Each lookup is stored in a slot
+ *  that corresponds with the time at which it wants to run again. This
+ *  makes inserting and expiring lookups an O(1) operation, no matter
+ *  how many lookups are in progress, and it makes sure that lookups
+ *  are processed in the order of their deadlines.
+ *
+ *  The wheel has a resolution of one millisecond and is made up of five
+ *  levels of 64 slots each. The slots on the lowest level span one
+ *  millisecond, and the slots on each next level span the full range of
+ *  the level below it. Lookups that are scheduled far in the future are
+ *  stored on one of the higher levels, and are cascaded to the lower
+ *  levels when their time comes closer.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stdint.h>
+#include "lookups.h"
+#include "queue.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Wheel
+{
+private:
+    /**
+     *  Number of levels and the number of slots per level
+     *  @var size_t
+     */
+    static const size_t LEVELS = 5;
+    static const size_t BITS = 6;
+    static const size_t SLOTS = 1 << BITS;
+
+    /**
+     *  The slots on each level
+     *  @var Lookups
+     */
+    Lookups _slots[LEVELS][SLOTS];
+
+    /**
+     *  Bitmaps that tell which slots are in use (one bit per slot)
+     *  @var uint64_t
+     */
+    uint64_t _occupied[LEVELS];
+
+    /**
+     *  Lookups that have expired and that are waiting to be processed (per priority class)
+     *  @var Queue
+     */
+    Queue<> _due;
+
+    /**
+     *  The next tick that is going to be processed
+     *  @var uint64_t
+     */
+    uint64_t _tick;
+
+    /**
+     *  Number of lookups stored in the slots (lookups in _due not included)
+     *  @var size_t
+     */
+    size_t _size = 0;
+
+    /**
+     *  Number of lookups that still had credits when they were added
+     *  @var size_t
+     */
+    size_t _active = 0;
+
+
+    /**
+     *  Convert a time to a tick (rounded up, so that entries never expire too early)
+     *  @param  time        time in seconds
+     *  @return uint64_t
+     */
+    static uint64_t ticks(double time);
+
+    /**
+     *  Store a lookup in the slot that matches its expire-tick
+     *  @param  lookup      the lookup to store
+     */
+    void place(Lookup *lookup);
+
+    /**
+     *  Move all lookups from one of the slots on a higher level to the lower levels
+     *  @param  level       the level of the slot
+     *  @param  index       index of the slot
+     */
+    void cascade(size_t level, size_t index);
+
+public:
+    /**
+     *  Constructor
+     */
+    Wheel();
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Wheel(const Wheel &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Wheel() = default;
+
+    /**
+     *  Number of lookups in the wheel
+     *  @return size_t
+     */
+    size_t size() const { return _size + _due.size(); }
+
+    /**
+     *  Number of lookups in the wheel that still had credits when they were added
+     *  @return size_t
+     */
+    size_t active() const { return _active; }
+
+    /**
+     *  Is the wheel empty?
+     *  @return bool
+     */
+    bool empty() const { return size() == 0; }
+
+    /**
+     *  Add a lookup that should be processed right away
+     *  @param  lookup      the lookup to add
+     *  @param  active      does the lookup still have credits?
+     */
+    void push(Lookup *lookup, bool active);
+
+    /**
+     *  Add a lookup that should be processed at a certain time
+     *  @param  lookup      the lookup to add
+     *  @param  expires     time at which it should run
+     *  @param  active      does the lookup still have credits?
+     */
+    void insert(Lookup *lookup, double expires, bool active);
+
+    /**
+     *  Remove a lookup from the wheel
+     *  @param  lookup      the lookup to remove
+     *  @return bool        was it stored in the wheel?
+     */
+    bool remove(Lookup *lookup);
+
+    /**
+     *  Move all lookups that expired before a certain time to the list of due entries
+     *  @param  now         current time
+     */
+    void advance(double now);
+
+    /**
+     *  Take the next lookup that is due (the oldest one of the most urgent priority class)
+     *  @return Lookup      the lookup (or nullptr if nothing is due)
+     */
+    Lookup *pop();
+
+    /**
+     *  Number of seconds until the next lookup is due (or until lookups have
+     *  to be cascaded to a lower level, which may be a little earlier)
+     *  @param  now         current time
+     *  @return double      delay in seconds (or < 0 if the wheel is empty)
+     */
+    double next(double now) const;
+};
+
+/**
+ *  End of namespace
+ */
+}
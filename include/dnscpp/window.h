@@ -0,0 +1,157 @@
+/**
+ *  Window.h
+ *
+ *  Adaptive window that limits the number of datagrams that can be in
+ *  flight to a single nameserver. The window is controlled in the same
+ *  way as a tcp congestion window: it grows while responses come in on
+ *  time (first exponentially, later additively) and it is halved when
+ *  datagrams get lost (a retry or a timeout was needed). This allows
+ *  bulk lookups to run at the highest rate that the nameserver can
+ *  sustain, without having to tune the capacity by hand.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stddef.h>
+#include <algorithm>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Window
+{
+private:
+    /**
+     *  The current size of the window (fractional, because it grows with 1/size per response),
+     *  the window starts (and never drops below) ten datagrams, so that random packet loss
+     *  does not bring the throughput down to a single lookup at a time
+     *  @var double
+     */
+    double _size = 10.0;
+
+    /**
+     *  Threshold below which the window grows exponentially ("slow start")
+     *  @var double
+     */
+    double _threshold = 1.0e9;
+
+    /**
+     *  Number of datagrams in flight
+     *  @var size_t
+     */
+    size_t _inflight = 0;
+
+    /**
+     *  The window is decreased at most once per interval, this is the time at which it may be decreased again
+     *  @var double
+     */
+    double _recover = 0.0;
+
+    /**
+     *  Smoothed round trip time of the datagrams (zero when it is not yet known)
+     *  @var double
+     */
+    double _rtt = 0.0;
+
+public:
+    /**
+     *  Constructor
+     */
+    Window() = default;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Window() = default;
+
+    /**
+     *  The current size of the window
+     *  @return size_t
+     */
+    size_t size() const { return _size; }
+
+    /**
+     *  Number of datagrams in flight
+     *  @return size_t
+     */
+    size_t inflight() const { return _inflight; }
+
+    /**
+     *  The smoothed round trip time (or zero when it is not yet known)
+     *  @return double
+     */
+    double rtt() const { return _rtt; }
+
+    /**
+     *  Is there room for one more datagram?
+     *  @return bool
+     */
+    bool admissible() const { return _inflight < size(); }
+
+    /**
+     *  Register that a datagram was sent
+     */
+    void sent() { _inflight += 1; }
+
+    /**
+     *  Register that a response came in on time
+     *  @param  rtt         round trip time of the datagram
+     */
+    void acknowledge(double rtt)
+    {
+        // update the smoothed round trip time
+        _rtt = _rtt == 0.0 ? rtt : _rtt + (rtt - _rtt) / 8.0;
+
+        // the window only grows when it was fully in use (otherwise we learn nothing about the capacity)
+        if (_inflight >= size()) _size += _size < _threshold ? 1.0 : 1.0 / _size;
+
+        // the datagram is no longer in flight
+        release();
+    }
+
+    /**
+     *  Register that a datagram got lost
+     *  @param  now         current time
+     *  @param  interval    period during which one loss-event is counted only once
+     */
+    void lost(double now, double interval)
+    {
+        // the datagram is no longer in flight
+        release();
+
+        // multiple losses in the same period are caused by the same congestion
+        if (now < _recover) return;
+
+        // halve the window (but not below the initial size), and continue with additive increase
+        _size = _threshold = std::max(_size / 2.0, 10.0);
+
+        // the window is not reduced again in the next period
+        _recover = now + interval;
+    }
+
+    /**
+     *  Register that a datagram is no longer in flight, without learning anything
+     *  from it (for example because the lookup was cancelled)
+     */
+    void release() { if (_inflight > 0) _inflight -= 1; }
+};
+
+/**
+ *  End of namespace
+ */
+}
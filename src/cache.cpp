@@ -0,0 +1,487 @@
+/**
+ *  Cache.cpp
+ *
+ *  Implementation file for the Cache class
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/cache.h"
+#include "../include/dnscpp/response.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <iterator>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Helper function to read a 32bit number in network byte order
+ *  @param  data
+ *  @return uint32_t
+ */
+static uint32_t get32(const unsigned char *data)
+{
+    // combine the four bytes
+    return uint32_t(data[0]) << 24 | uint32_t(data[1]) << 16 | uint32_t(data[2]) << 8 | uint32_t(data[3]);
+}
+
+/**
+ *  Helper function to write a 32bit number in network byte order
+ *  @param  data
+ *  @param  value
+ */
+static void put32(unsigned char *data, uint32_t value)
+{
+    // write the four bytes
+    data[0] = value >> 24; data[1] = value >> 16; data[2] = value >> 8; data[3] = value;
+}
+
+/**
+ *  Remove an entry from the cache
+ *  @param  iter        the entry
+ */
+void Cache::erase(std::list<Entry>::iterator iter)
+{
+    // size of the entry
+    size_t bytes = iter->bytes();
+
+    // update the bookkeeping
+    _bytes -= bytes; if (!iter->main) _small -= bytes;
+
+    // forget the entry
+    _index.erase(iter->key);
+
+    // remove it from its queue
+    (iter->main ? _mainqueue : _smallqueue).erase(iter);
+}
+
+/**
+ *  Remember the key of an entry that is evicted from the small queue
+ *  @param  key
+ */
+void Cache::haunt(const std::string &key)
+{
+    // add to the front of the ghost queue
+    _ghostqueue.push_front(key); _ghosts[key] = _ghostqueue.begin();
+
+    // we remember at most as many keys as there are entries in the cache
+    while (_ghostqueue.size() > std::max(_index.size(), size_t(1)))
+    {
+        // forget the oldest ghost
+        _ghosts.erase(_ghostqueue.back()); _ghostqueue.pop_back();
+    }
+}
+
+/**
+ *  Evict entries until the cache fits in its capacity
+ */
+void Cache::shrink()
+{
+    // keep evicting while the cache is too big
+    while (_bytes > _capacity)
+    {
+        // entries are evicted from the small queue when it is bigger than its share (or when there is nothing else)
+        if (!_smallqueue.empty() && (_small * 100 > _capacity * SMALL || _mainqueue.empty()))
+        {
+            // the oldest entry of the small queue
+            auto iter = std::prev(_smallqueue.end());
+
+            // if the entry was used again, it is promoted to the main queue
+            if (iter->frequency > 0)
+            {
+                // the entry is no longer part of the small queue
+                _small -= iter->bytes(); iter->main = true; iter->frequency = 0;
+
+                // move it to the front of the main queue
+                _mainqueue.splice(_mainqueue.begin(), _smallqueue, iter);
+            }
+            else
+            {
+                // the entry is evicted, but we remember that it was there
+                haunt(iter->key); erase(iter);
+            }
+        }
+        else
+        {
+            // the oldest entry of the main queue
+            auto iter = std::prev(_mainqueue.end());
+
+            // entries that were used get another round (but with a lower frequency)
+            if (iter->frequency > 0) { iter->frequency -= 1; _mainqueue.splice(_mainqueue.begin(), _mainqueue, iter); }
+
+            // others are evicted
+            else erase(iter);
+        }
+    }
+}
+
+/**
+ *  Find the ttls of the records in a response
+ *  @param  response    the response
+ *  @param  ttls        vector that is filled with the offsets of the ttls
+ *  @return uint32_t    the lowest ttl (zero if the response should not be cached)
+ */
+uint32_t Cache::parse(const Response &response, std::vector<uint16_t> &ttls)
+{
+    // the lowest TTL of the records (the response expires when the first record expires)
+    uint32_t ttl = UINT32_MAX;
+    
+    // is this a negative response, and did we find the SOA record that is needed to cache it?
+    bool negative = response.answers() == 0, soa = false;
+
+    // we parse a copy of the handle (parsing updates it)
+    ns_msg handle = *response.handle();
+
+    // check all records in the answer, authority and additional sections
+    for (auto section : { ns_s_an, ns_s_ns, ns_s_ar })
+    {
+        // check all records in this section
+        for (int i = 0; i < ns_msg_count(handle, section); ++i)
+        {
+            // parse the record (responses that cannot be parsed are not cached)
+            ns_rr record; if (ns_parserr(&handle, section, i, &record) != 0) return 0;
+
+            // the ttl of the opt pseudo-record holds flags instead of a ttl
+            if (ns_rr_type(record) == ns_t_opt) continue;
+
+            // update the lowest ttl
+            ttl = std::min(ttl, uint32_t(ns_rr_ttl(record)));
+            
+            // for negative responses the minimum field of the soa record (the last field) is an upper limit too
+            if (negative && section == ns_s_ns && ns_rr_type(record) == ns_t_soa && ns_rr_rdlen(record) >= 20)
+            {
+                // we found the soa record
+                soa = true; ttl = std::min(ttl, get32(ns_rr_rdata(record) + ns_rr_rdlen(record) - 4));
+            }
+
+            // the ttl is stored right before the rdlength, which is stored right before the rdata
+            ttls.push_back(ns_rr_rdata(record) - 6 - response.data());
+        }
+    }
+
+    // responses without records (or negative responses without a soa record) are not stored
+    return ttls.empty() || (negative && !soa) ? 0 : ttl;
+}
+
+/**
+ *  Number of seconds that a response spent in the cache
+ *  @param  stored      time at which the response was stored
+ *  @param  now         current time
+ *  @return uint32_t
+ */
+uint32_t Cache::age(double stored, double now)
+{
+    // the clock may have been turned back
+    return std::min(std::max(now - stored, 0.0), double(UINT32_MAX));
+}
+
+/**
+ *  Copy a cached response with decremented ttls
+ *  @param  data        the cached response
+ *  @param  ttls        offsets of the ttls in the response
+ *  @param  limit       upper limit for the ttls
+ *  @param  age         number of seconds that the response spent in the cache
+ *  @param  result      buffer that is filled with the response
+ */
+void Cache::expose(const std::vector<unsigned char> &data, const std::vector<uint16_t> &ttls, uint32_t limit, uint32_t age, std::vector<unsigned char> &result)
+{
+    // copy the response
+    result.assign(data.begin(), data.end());
+
+    // decrement the ttls
+    for (auto offset : ttls)
+    {
+        // the original ttl
+        uint32_t ttl = std::min(get32(data.data() + offset), limit);
+
+        // store the remaining ttl
+        put32(result.data() + offset, ttl > age ? ttl - age : 0);
+    }
+}
+
+/**
+ *  Copy an expired response, the records get a short ttl, so that the response
+ *  is not kept for long by whoever receives it
+ *  @param  data        the cached response
+ *  @param  ttls        offsets of the ttls in the response
+ *  @param  limit       upper limit for the ttls
+ *  @param  result      buffer that is filled with the response
+ */
+void Cache::exposestale(const std::vector<unsigned char> &data, const std::vector<uint16_t> &ttls, uint32_t limit, std::vector<unsigned char> &result)
+{
+    // copy the response
+    result.assign(data.begin(), data.end());
+
+    // set the ttls
+    for (auto offset : ttls) put32(result.data() + offset, std::min(uint32_t(STALE), limit));
+}
+
+/**
+ *  Store a response
+ *  @param  key         the key under which it is stored
+ *  @param  response    the response to store
+ *  @param  now         current time
+ *  @return bool        was the response stored?
+ */
+bool Cache::insert(const std::string &key, const Response &response, double now)
+{
+    // nothing is stored when the cache is disabled
+    if (_capacity == 0) return false;
+
+    // the new entry
+    Entry entry;
+
+    // find the ttls (responses without a ttl should not be cached)
+    uint32_t ttl = parse(response, entry.ttls); if (ttl == 0) return false;
+
+    // fill the entry
+    entry.key = key;
+    entry.data.assign(response.data(), response.data() + response.size());
+    entry.stored = now;
+    entry.expires = now + ttl;
+    if (response.answers() == 0) entry.limit = ttl;
+
+    // entries that would not even fit in an empty cache are not stored
+    if (entry.bytes() > _capacity) return false;
+
+    // if the key is already in the cache, the old entry is replaced (but it keeps its place)
+    auto found = _index.find(key);
+    if (found != _index.end()) { entry.main = found->second->main; entry.frequency = found->second->frequency; erase(found->second); }
+
+    // if the key was evicted from the small queue recently, it goes straight to the main queue
+    auto ghost = _ghosts.find(key);
+    if (ghost != _ghosts.end()) { entry.main = true; _ghostqueue.erase(ghost->second); _ghosts.erase(ghost); }
+
+    // size of the entry, and the queue in which it should be stored
+    size_t bytes = entry.bytes();
+    auto &queue = entry.main ? _mainqueue : _smallqueue;
+
+    // update the bookkeeping
+    _bytes += bytes; if (!entry.main) _small += bytes;
+
+    // store the entry
+    queue.push_front(std::move(entry)); _index[key] = queue.begin();
+
+    // make sure that the cache fits in its capacity
+    shrink();
+
+    // done
+    return true;
+}
+
+/**
+ *  Look up a response
+ *  @param  key         the key to look for
+ *  @param  now         current time
+ *  @param  result      buffer that is filled with the response (with decremented TTLs)
+ *  @param  remaining   optional variable that is filled with the part of the TTL that is left
+ *  @return bool        was the response found?
+ */
+bool Cache::lookup(const std::string &key, double now, std::vector<unsigned char> &result, double *remaining)
+{
+    // nothing is found when the cache is disabled
+    if (_capacity == 0) return false;
+
+    // find the entry
+    auto *entry = find(key, now);
+
+    // the response is not in the cache
+    if (entry == nullptr) { _misses += 1; return false; }
+
+    // expose the response
+    copy(*entry, now, result);
+
+    // the caller may want to know how long the response remains valid
+    if (remaining) *remaining = (entry->expires - now) / (entry->expires - entry->stored);
+
+    // done
+    return true;
+}
+
+/**
+ *  Look up a response that can be stored under two keys
+ *  @param  key         the key to look for first
+ *  @param  fallback    the key to look for next
+ *  @param  now         current time
+ *  @param  result      buffer that is filled with the response (with decremented TTLs)
+ *  @return bool        was the response found?
+ */
+bool Cache::lookup(const std::string &key, const std::string &fallback, double now, std::vector<unsigned char> &result)
+{
+    // nothing is found when the cache is disabled
+    if (_capacity == 0) return false;
+
+    // find the entry
+    auto *entry = find(key, now);
+
+    // try the other key if it was not found
+    if (entry == nullptr) entry = find(fallback, now);
+
+    // the response is not in the cache
+    if (entry == nullptr) { _misses += 1; return false; }
+
+    // expose the response
+    copy(*entry, now, result);
+
+    // done
+    return true;
+}
+
+/**
+ *  Look up a response that has expired, but that is still retained
+ *  @param  key         the key to look for
+ *  @param  now         current time
+ *  @param  result      buffer that is filled with the response (with the TTLs set to 30 seconds)
+ *  @return bool        was an expired response found?
+ */
+bool Cache::expired(const std::string &key, double now, std::vector<unsigned char> &result)
+{
+    // nothing is found when the cache is disabled or when expired responses are not kept
+    if (_capacity == 0 || _retention == 0.0) return false;
+
+    // find the entry
+    auto found = _index.find(key);
+
+    // the response is not in the cache, or it has not yet expired (then it should not be used as a last resort)
+    if (found == _index.end() || found->second->expires > now) return false;
+
+    // the response expired too long ago
+    if (found->second->expires + _retention <= now) { erase(found->second); return false; }
+
+    // copy the response (with short ttls)
+    exposestale(found->second->data, found->second->ttls, found->second->limit, result);
+
+    // one more lookup was answered with an expired response
+    _stale += 1;
+
+    // done
+    return true;
+}
+
+/**
+ *  Find an entry that has not yet expired (entries that expired too long ago are removed)
+ *  @param  key         the key to look for
+ *  @param  now         current time
+ *  @return Entry       the entry (or nullptr if there is no such entry)
+ */
+Cache::Entry *Cache::find(const std::string &key, double now)
+{
+    // find the entry
+    auto found = _index.find(key);
+
+    // the response is not in the cache
+    if (found == _index.end()) return nullptr;
+
+    // expired entries are no longer used (but they may be retained for a while as a last resort)
+    if (found->second->expires <= now) { if (found->second->expires + _retention <= now) erase(found->second); return nullptr; }
+
+    // expose the entry
+    return &*found->second;
+}
+
+/**
+ *  Copy the response of an entry, and mark the entry as used
+ *  @param  entry       the entry
+ *  @param  now         current time
+ *  @param  result      buffer that is filled with the response (with decremented TTLs)
+ */
+void Cache::copy(Entry &entry, double now, std::vector<unsigned char> &result)
+{
+    // the entry is used once more
+    entry.frequency = std::min(entry.frequency + 1, 3);
+    _hits += 1;
+
+    // copy the response with decremented ttls
+    expose(entry.data, entry.ttls, entry.limit, age(entry.stored, now), result);
+}
+
+/**
+ *  Remove all responses
+ */
+void Cache::clear()
+{
+    // forget all entries and ghosts
+    _smallqueue.clear(); _mainqueue.clear(); _index.clear();
+    _ghostqueue.clear(); _ghosts.clear();
+
+    // nothing is in use any more
+    _bytes = _small = 0;
+}
+
+/**
+ *  Write all responses to a snapshot file
+ *  @param  filename    the file to write
+ *  @return bool        was the snapshot written?
+ */
+bool Cache::save(const char *filename) const
+{
+    // write the file
+    return Snapshot::save(filename, [this](std::ostream &stream) {
+
+        // the main queue comes first, so that the most valuable entries are loaded first when the capacity is smaller
+        for (auto *queue : { &_mainqueue, &_smallqueue })
+        {
+            // write all entries in the queue (most recent first)
+            for (auto &entry : *queue) Snapshot::write(stream, entry.key, entry.data, entry.ttls, entry.stored, entry.expires, entry.limit, entry.frequency, entry.main);
+        }
+    });
+}
+
+/**
+ *  Load the responses from a snapshot file
+ *  @param  filename    the file to read
+ *  @param  now         current time
+ *  @return size_t      number of responses that were loaded
+ */
+size_t Cache::load(const char *filename, double now)
+{
+    // nothing is loaded when the cache is disabled
+    if (!enabled()) return 0;
+    
+    // read the file
+    return Snapshot::load(filename, now, _retention, [this](Snapshot::Record &&record) -> bool {
+
+        // entries that are already in the cache are newer than the ones in the file
+        if (_index.count(record.key) > 0) return false;
+        
+        // the new entry
+        Entry entry;
+        
+        // fill the entry
+        entry.key = std::move(record.key);
+        entry.data = std::move(record.data);
+        entry.ttls = std::move(record.ttls);
+        entry.stored = record.stored;
+        entry.expires = record.expires;
+        entry.limit = record.limit;
+        entry.frequency = record.frequency;
+        entry.main = record.main;
+
+        // entries that do not fit are skipped (the file starts with the most valuable entries)
+        size_t bytes = entry.bytes(); if (_bytes + bytes > _capacity) return false;
+        
+        // the queue in which it should be stored
+        auto &queue = entry.main ? _mainqueue : _smallqueue;
+        
+        // update the bookkeeping
+        _bytes += bytes; if (!entry.main) _small += bytes;
+        
+        // store the entry (at the back, because the file is ordered from recent to old)
+        queue.push_back(std::move(entry)); _index[queue.back().key] = std::prev(queue.end());
+        
+        // the entry was stored
+        return true;
+    });
+}
+
+/**
+ *  End of namespace
+ */
+}
+
@@ -0,0 +1,185 @@
+/**
+ *  CachedLookup.h
+ *
+ *  Class that reports a response that was found in the cache. Just like
+ *  lookups in the /etc/hosts file, the response is reported through the
+ *  scheduler of the core (and thus in a later tick of the event loop).
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <vector>
+#include "../include/dnscpp/lookup.h"
+#include "../include/dnscpp/core.h"
+#include "../include/dnscpp/handler.h"
+#include "../include/dnscpp/response.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class CachedLookup : public Lookup
+{
+private:
+    /**
+     *  The cached response (with TTLs that are already decremented)
+     *  @var std::vector
+     */
+    std::vector<unsigned char> _response;
+
+    /**
+     *  The type of records that was asked for
+     *  @var ns_type
+     */
+    ns_type _type;
+
+    /**
+     *  Is the operation ready?
+     *  @var bool
+     */
+    bool _ready = false;
+
+    /**
+     *  Method that is called when it is time to process this lookup
+     *  @param  now     current time
+     *  @return bool    should it be rescheduled?
+     */
+    virtual bool execute(double now) override
+    {
+        // do nothing if ready
+        if (_ready) return false;
+
+        // remember the handler
+        auto *handler = _handler;
+
+        // remember that the operation is ready (and forget the handler so that it can no longer be cancelled)
+        _ready = true; _handler = nullptr;
+
+        // the tenant has one lookup less in flight (before we call userspace, which may destruct the core)
+        _core->release(this);
+
+        // the response should match our own query, the id is stored in network byte order in the first two bytes
+        _response[0] = _query.id() >> 8; _response[1] = _query.id() & 0xff;
+
+        // a cached NXDOMAIN response may have been given for a different type, so we also set the type of the question
+        const unsigned char *question = _response.data() + HFIXEDSZ, *end = _response.data() + _response.size();
+
+        // the type is stored right after the name
+        if (ns_name_skip(&question, end) == 0 && question + 2 <= end)
+        {
+            // overwrite the type (in network byte order)
+            size_t offset = question - _response.data();
+            _response[offset] = _type >> 8; _response[offset + 1] = _type & 0xff;
+        }
+
+        // pass the response to userspace
+        handler->onReceived(this, Response(_response.data(), _response.size()));
+
+        // no need to reschedule
+        return false;
+    }
+
+    /**
+     *  How long should we wait until the next runtime?
+     *  @param  now         current time
+     *  @return double      delay in seconds
+     */
+    virtual double delay(double now) const override
+    {
+        // should run right away
+        return 0.0;
+    }
+
+    /**
+     *  How many credits are left (meaning: how many datagrams do we still have to send?)
+     *  @return size_t      number of attempts
+     */
+    virtual size_t credits() const override
+    {
+        // cached lookups do not send anything at all
+        return 0;
+    }
+
+    /**
+     *  Try to admit the lookup
+     *  @return bool        was the lookup admitted?
+     */
+    virtual bool admit() override
+    {
+        // cached lookups do not contact a nameserver, so they can always run
+        return true;
+    }
+
+    /**
+     *  Cancel the lookup
+     */
+    virtual void cancel() override
+    {
+        // if already reported back to user-space
+        if (_handler == nullptr) return;
+
+        // remember the handler
+        auto *handler = _handler;
+
+        // get rid of the handler to avoid that the result is reported
+        _handler = nullptr; _ready = true;
+
+        // the core no longer has to keep track of this lookup
+        _core->remove(this);
+
+        // report it back to user-space
+        handler->onCancelled(this);
+
+        // the lookup is no longer needed
+        delete this;
+    }
+
+public:
+    /**
+     *  Constructor
+     *  @param  core        dns core object
+     *  @param  domain      the domain of the lookup
+     *  @param  type        type of records to look for
+     *  @param  bits        the bits to include in the request
+     *  @param  options     scheduling options
+     *  @param  handler     user space object interested in the result
+     *  @param  response    the cached response
+     *  @throws std::runtime_error
+     */
+    CachedLookup(Core *core, const char *domain, ns_type type, const Bits &bits, const Options &options, Handler *handler, std::vector<unsigned char> &&response) :
+        Lookup(core, options, handler, ns_o_query, domain, type, bits), _response(std::move(response)), _type(type) {}
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    CachedLookup(const CachedLookup &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~CachedLookup()
+    {
+        // if the operation is destructed while it was still running, it means that the
+        // core was destructed before the lookup ran, let the handler know
+        if (!_ready && _handler) _handler->onCancelled(this);
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
+
@@ -0,0 +1,114 @@
+/**
+ *  Channel.cpp
+ *
+ *  Implementation file for the Channel class
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/channel.h"
+#include "../include/dnscpp/resolverpool.h"
+#include "../include/dnscpp/loop.h"
+#include "../include/dnscpp/watcher.h"
+#include "worker.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Constructor
+ *  @param  pool        the pool to submit queries to
+ *  @param  loop        the event loop of the calling thread
+ *  @throws std::runtime_error
+ */
+Channel::Channel(ResolverPool *pool, Loop *loop) : _pool(pool), _loop(loop), _inbox(std::make_shared<Inbox>(pool->threads()))
+{
+    // we want to be notified when results are posted
+    _identifier = _loop->add(_inbox->fd(), 1, this);
+}
+
+/**
+ *  Destructor
+ */
+Channel::~Channel()
+{
+    // we are no longer interested in results (the lookups that are still running post them to an inbox that nobody reads)
+    _loop->remove(_identifier, _inbox->fd(), this);
+
+    // the operations that are still in progress are cancelled (their handlers are notified)
+    for (auto *ticket : _tickets) delete ticket;
+}
+
+/**
+ *  Submit a query to a worker
+ *  @param  domain      the domain to look up
+ *  @param  type        type of records to look for
+ *  @param  bits        bits to include in the query
+ *  @param  defaults    should the default bits of the context be used instead?
+ *  @param  handler     object that will be notified when the query is ready
+ *  @return Operation   object to interact with the operation while it is in progress
+ */
+Operation *Channel::query(const char *domain, ns_type type, const Bits &bits, bool defaults, Handler *handler)
+{
+    // the ticket can throw (for example when the domain is invalid)
+    try
+    {
+        // the ticket through which the result is reported
+        auto *ticket = new Ticket(handler, domain, type, bits);
+
+        // remember it until the result comes in
+        _tickets.insert(ticket);
+
+        // pass the lookup to the worker (this only pushes it onto a lock-free queue)
+        _pool->route(domain)->post(Job{ ticket, _inbox, domain, type, bits, defaults });
+
+        // expose the operation
+        return ticket;
+    }
+    catch (...)
+    {
+        // invalid parameters were supplied
+        return nullptr;
+    }
+}
+
+/**
+ *  Method that is called when results were posted
+ */
+void Channel::notify()
+{
+    // a call to userspace might destruct `this`
+    Watcher watcher(this);
+
+    // results that are posted from now on wake us up again
+    _inbox->reset();
+
+    // the result that is being reported
+    Result result;
+
+    // take out the results of all workers
+    for (size_t i = 0; i < _inbox->size(); ++i) while (_inbox->take(i, result))
+    {
+        // the ticket no longer belongs to the channel
+        _tickets.erase(result.ticket);
+
+        // report to userspace
+        result.ticket->report(result);
+
+        // the ticket is no longer needed
+        delete result.ticket;
+
+        // maybe the userspace call ended up in `this` being destructed (the other tickets are gone then)
+        if (!watcher.valid()) return;
+    }
+}
+
+/**
+ *  End of namespace
+ */
+}
@@ -147,13 +147,14 @@ public:
      *  Constructor
      *  @param  loop        the event loop
      *  @param  ip          the IP address to connect to
+     *  @param  port        the port to connect to
      *  @param  query       the query to send over the connection
      *  @param  response    the response that was already received
      *  @param  handler     parent object that is notified about the result
      */
-    Connection(Loop *loop, const Ip &ip, const Query &query, const Response &response, Handler *handler) :
+    Connection(Loop *loop, const Ip &ip, uint16_t port, const Query &query, const Response &response, Handler *handler) :
         _tcp(loop, ip),
-        _connector(&_tcp, ip, this),
+        _connector(&_tcp, ip, port, this),
         _receiver(&_tcp, this),
         _query(query),
         _truncated(response),
@@ -93,13 +93,14 @@ public:
      *  Constructor
      *  @param  socket      the socket socket
      *  @param  ip          the IP address to connect to
+     *  @param  port        the port to connect to
      *  @param  handler     object that is notified on success
      *  @throws std::runtime_error
      */
-    Connector(Tcp *tcp, const Ip &ip, Handler *handler) : _tcp(tcp), _handler(handler)
+    Connector(Tcp *tcp, const Ip &ip, uint16_t port, Handler *handler) : _tcp(tcp), _handler(handler)
     {
         // try to connect
-        if (!tcp->connect(ip, 53)) throw std::runtime_error("failed to connect");
+        if (!tcp->connect(ip, port)) throw std::runtime_error("failed to connect");
         
         // monitor the socket for writability, because that means that the socket is connected
         _identifier = tcp->monitor(2, this);
@@ -11,8 +11,11 @@
  *  Dependencies
  */
 #include "../include/dnscpp/context.h"
+#include "../include/dnscpp/completion.h"
 #include "remotelookup.h"
 #include "locallookup.h"
+#include "cachedlookup.h"
+#include "uring.h"
 
 /**
  *  Begin of namespace
@@ -20,24 +23,80 @@
 namespace DNS {
 
 /**
- *  Do a dns lookup
+ *  Can the result of a lookup be shared with identical lookups? This is not
+ *  the case when the options limit the lookup to what a single caller wants
+ *  @param  options
+ *  @return bool
+ */
+static bool shareable(const Options &options)
+{
+    // deadlines and retry budgets are personal
+    return options.deadline() == 0.0 && options.attempts() == 0;
+}
+
+/**
+ *  Handler for the lookups that refresh the cache in the background (it ignores
+ *  the result, because the lookups store their responses in the cache anyway)
+ *  @var Handler
+ */
+static Handler background;
+
+/**
+ *  Number of recent lookups that make a name popular enough to be prefetched
+ *  @var size_t
+ */
+static const size_t POPULAR = 8;
+
+/**
+ *  Create a lookup object
+ *  @param  key         the key under which identical lookups are cached and shared
  *  @param  name        the record name to look for
  *  @param  type        type of record (normally you ask for an 'a' record)
  *  @param  bits        bits to include in the query
+ *  @param  options     options that control how the query is scheduled
  *  @param  handler     object that will be notified when the query is ready
- *  @return Operation   object to interact with the operation while it is in progress
+ *  @return Lookup      the lookup (or nullptr when the parameters were invalid)
  */
-Operation *Context::query(const char *domain, ns_type type, const Bits &bits, Handler *handler)
+Lookup *Context::create(const std::string &key, const char *domain, ns_type type, const Bits &bits, const Options &options, Handler *handler)
 {
     // for A and AAAA lookups we also check the /etc/hosts file
-    if (type == ns_t_a    && _hosts.lookup(domain, 4)) return add(new LocalLookup(_hosts, domain, type, handler));
-    if (type == ns_t_aaaa && _hosts.lookup(domain, 6)) return add(new LocalLookup(_hosts, domain, type, handler));
+    if (type == ns_t_a    && _hosts.lookup(domain, 4)) return new LocalLookup(this, _hosts, domain, type, options, handler);
+    if (type == ns_t_aaaa && _hosts.lookup(domain, 6)) return new LocalLookup(this, _hosts, domain, type, options, handler);
     
     // the request can throw (for example when the domain is invalid
     try
     {
+        // current time, a buffer for a cached response, and the part of its TTL that is left
+        Now now; std::vector<unsigned char> response; double remaining = 1.0;
+        
+        // when popular names are prefetched, we keep track of how often each name is looked up
+        size_t popularity = _prefetches.rate() > 0.0 ? _sketch.increment(key) : 0;
+        
+        // if the response is in the cache, we do not have to send anything
+        if (cache().lookup(key, now, response, &remaining))
+        {
+            // popular responses that are about to expire are refreshed in the background
+            if (popularity >= POPULAR && remaining <= _prefetchwindow) refresh(key, domain, type, bits, now);
+            
+            // report the cached response
+            return new CachedLookup(this, domain, type, bits, options, handler, std::move(response));
+        }
+        
+        // the same is true if we know that the name does not exist, or that it has no records of this type
+        if (negativecache().enabled() && negativecache().lookup(RemoteLookup::nxdomain(key), key, now, response)) return new CachedLookup(this, domain, type, bits, options, handler, std::move(response));
+        
+        // if an identical lookup already had to fall back to an expired response (because the
+        // nameservers are slow to respond), this lookup gets the expired response right away
+        if (cache().retention() > 0.0 && stale(key) && cache().expired(key, now, response)) return new CachedLookup(this, domain, type, bits, options, handler, std::move(response));
+        
         // we are going to create a self-destructing request
-        return add(new RemoteLookup(this, domain, type, bits, handler));
+        auto *lookup = new RemoteLookup(this, key, domain, type, bits, options, handler);
+        
+        // identical lookups that are started later can share the result
+        if (shareable(options)) lookup->publish();
+        
+        // expose the lookup
+        return lookup;
     }
     catch (...)
     {
@@ -46,20 +105,196 @@ Operation *Context::query(const char *domain, ns_type type, const Bits &bits, Ha
     }
 }
 
+/**
+ *  Refresh a cached response in the background
+ *  @param  key         the key under which the response is cached
+ *  @param  name        the record name to look for
+ *  @param  type        type of record
+ *  @param  bits        bits to include in the query
+ *  @param  now         current time
+ */
+void Context::refresh(const std::string &key, const char *domain, ns_type type, const Bits &bits, double now)
+{
+    // if the response is already being refreshed there is nothing to do
+    if (_pending.find(key) != _pending.end()) return;
+    
+    // prefetches may not take capacity from the lookups of userspace
+    if (_wheel.active() >= _capacity || !_scheduled.empty()) return;
+    
+    // there is a limit on the number of prefetches
+    if (!_prefetches.take(now)) return;
+    
+    // the lookup can throw (this is not expected, because the same lookup was done before)
+    try
+    {
+        // the lookup stores the response in the cache (and other lookups can share it)
+        auto *lookup = new RemoteLookup(this, key, domain, type, bits, Options(Priority::bulk), &background);
+        
+        // identical lookups that miss the cache can share the result
+        lookup->publish();
+        
+        // start the lookup
+        add(lookup);
+    }
+    catch (...)
+    {
+        // the prefetch is skipped
+    }
+}
+
+/**
+ *  Is an identical lookup in progress that already reported an expired response?
+ *  @param  key         the key under which identical lookups are shared
+ *  @return bool
+ */
+bool Context::stale(const std::string &key) const
+{
+    // find the identical lookup
+    auto iter = _pending.find(key);
+    
+    // check if it fell back to the expired response
+    return iter != _pending.end() && iter->second->stale();
+}
+
+/**
+ *  Share the result of an identical lookup that is already in progress
+ *  @param  key         the key under which identical lookups are shared
+ *  @param  name        the record name to look for
+ *  @param  type        type of record (normally you ask for an 'a' record)
+ *  @param  bits        bits to include in the query
+ *  @param  options     options that control how the query is scheduled
+ *  @param  handler     object that will be notified when the query is ready
+ *  @return Operation   the operation (or nullptr when there is no lookup to share)
+ */
+Operation *Context::join(const std::string &key, const char *domain, ns_type type, const Bits &bits, const Options &options, Handler *handler)
+{
+    // nothing to share if nothing is in progress, or if the lookup has personal options
+    if (_pending.empty() || !shareable(options)) return nullptr;
+    
+    // find the identical lookup
+    auto iter = _pending.find(key);
+    
+    // no identical lookup is in progress (or it only refreshes an expired response, then we use that response too)
+    if (iter == _pending.end() || iter->second->stale()) return nullptr;
+    
+    // the operation can throw (for example when the domain is invalid)
+    try
+    {
+        // attach to the lookup that is in progress
+        auto *operation = iter->second->follow(domain, type, bits, handler);
+        
+        // if the lookup is still waiting behind lookups of a lower class than ours, it moves up
+        promote(iter->second, options);
+        
+        // expose the operation
+        return operation;
+    }
+    catch (...)
+    {
+        // invalid parameters were supplied
+        return nullptr;
+    }
+}
+
+/**
+ *  Do a dns lookup
+ *  @param  name        the record name to look for
+ *  @param  type        type of record (normally you ask for an 'a' record)
+ *  @param  bits        bits to include in the query
+ *  @param  options     options that control how the query is scheduled
+ *  @param  handler     object that will be notified when the query is ready
+ *  @return Operation   object to interact with the operation while it is in progress
+ */
+Operation *Context::query(const char *domain, ns_type type, const Bits &bits, const Options &options, Handler *handler)
+{
+    // the key under which identical lookups are cached and shared
+    auto key = RemoteLookup::key(domain, type, bits);
+    
+    // if an identical lookup is already in progress, we share its result
+    if (auto *operation = join(key, domain, type, bits, options, handler)) return operation;
+    
+    // create the lookup
+    auto *lookup = create(key, domain, type, bits, options, handler);
+    
+    // add it to the core (if the parameters were valid)
+    return lookup ? add(lookup) : nullptr;
+}
+
+/**
+ *  Submit a batch of queries
+ *  @param  batch       the queries to submit
+ *  @return size_t      number of queries that were started
+ */
+size_t Context::query(Batch &batch)
+{
+    // object to keep track of the progress (only needed when there is a callback),
+    // it is registered once more to avoid that it completes while we're busy
+    auto *completion = batch.completed() ? new Completion(batch.completed()) : nullptr;
+    if (completion) completion->add();
+    
+    // number of started queries, and should the timer be armed?
+    size_t count = 0; bool wakeup = false;
+    
+    // create all lookups
+    for (auto &entry : batch)
+    {
+        // the key under which identical lookups are cached and shared
+        auto key = RemoteLookup::key(entry.domain, entry.type, entry.bits);
+        
+        // if an identical lookup is already in progress (maybe earlier in the batch), we share its result
+        if ((entry.operation = join(key, entry.domain, entry.type, entry.bits, entry.options, entry.handler)) != nullptr)
+        {
+            // make the operation part of the batch
+            if (completion) entry.operation->track(completion);
+            
+            // one more query was started
+            count += 1; continue;
+        }
+        
+        // create the lookup
+        auto *lookup = create(key, entry.domain, entry.type, entry.bits, entry.options, entry.handler);
+        
+        // store the operation
+        entry.operation = lookup;
+        
+        // skip invalid entries
+        if (lookup == nullptr) continue;
+        
+        // make the lookup part of the batch
+        if (completion) lookup->track(completion);
+        
+        // add it to the core
+        if (enqueue(lookup)) wakeup = true;
+        
+        // one more query was started
+        count += 1;
+    }
+    
+    // arm the timer once for the whole batch
+    if (wakeup) Core::wakeup();
+    
+    // we're done adding (this calls the callback if nothing could be started)
+    if (completion) completion->done();
+    
+    // expose the number of started queries
+    return count;
+}
+
 /**
  *  Do a reverse IP lookup, this is only meaningful for PTR lookups
  *  @param  ip          the ip address to lookup
  *  @param  bits        bits to include in the query
+ *  @param  options     options that control how the query is scheduled
  *  @param  handler     object that will be notified when the query is ready
  *  @return operation   object to interact with the operation while it is in progress
  */
-Operation *Context::query(const Ip &ip, const Bits &bits, Handler *handler) 
+Operation *Context::query(const Ip &ip, const Bits &bits, const Options &options, Handler *handler)
 {
     // if the /etc/hosts file already holds a record
-    if (_hosts.lookup(ip)) return add(new LocalLookup(_hosts, ip, handler));
+    if (_hosts.lookup(ip)) return add(new LocalLookup(this, _hosts, ip, options, handler));
 
     // pass on to the regular query method
-    return query(Reverse(ip), TYPE_PTR, bits, handler);
+    return query(Reverse(ip), TYPE_PTR, bits, options, handler);
 }
 
 /**
@@ -67,28 +302,48 @@ Operation *Context::query(const Ip &ip, const Bits &bits, Handler *handler)
  *  @param  name        the record name to look for
  *  @param  type        type of record (normally you ask for an 'a' record)
  *  @param  bits        bits to include in the query
+ *  @param  options     options that control how the query is scheduled
  *  @param  success     function that will be called on success
  *  @param  failure     function that will be called on failure
  *  @return operation   object to interact with the operation while it is in progress
  */
-Operation *Context::query(const char *domain, ns_type type, const Bits &bits, const SuccessCallback &success, const FailureCallback &failure)
+Operation *Context::query(const char *domain, ns_type type, const Bits &bits, const Options &options, const SuccessCallback &success, const FailureCallback &failure)
 {
     // use a self-destructing wrapper for the handler
-    return query(domain, type, bits, new Callbacks(success, failure));
+    return query(domain, type, bits, options, new Callbacks(success, failure));
 }
 
 /**
  *  Do a reverse dns lookup and pass the result to callbacks
  *  @param  ip          the ip address to lookup
  *  @param  bits        bits to include in the query
+ *  @param  options     options that control how the query is scheduled
  *  @param  success     function that will be called on success
  *  @param  failure     function that will be called on failure
  *  @return operation   object to interact with the operation while it is in progress
  */
-Operation *Context::query(const DNS::Ip &ip, const Bits &bits, const SuccessCallback &success, const FailureCallback &failure)
+Operation *Context::query(const DNS::Ip &ip, const Bits &bits, const Options &options, const SuccessCallback &success, const FailureCallback &failure)
 {
     // use a self-destructing wrapper for the handler
-    return query(ip, bits, new Callbacks(success, failure));
+    return query(ip, bits, options, new Callbacks(success, failure));
+}
+
+/**
+ *  Use io_uring for the udp sockets
+ *  @param  enable      should io_uring be used?
+ *  @return bool        is io_uring used for new sockets?
+ */
+bool Context::uring(bool enable)
+{
+    // sockets that are already open keep using the instance, so it is never destructed
+    if (enable && !_uring)
+    {
+        // the kernel might not support everything we need, we then stick to the regular system calls
+        try { _uring.reset(new Uring(_loop)); } catch (const std::runtime_error &error) { return false; }
+    }
+
+    // remember the setting
+    return _useuring = enable;
 }
 
 /**
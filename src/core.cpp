@@ -14,6 +14,7 @@
 #include "../include/dnscpp/lookup.h"
 #include "../include/dnscpp/loop.h"
 #include "../include/dnscpp/watcher.h"
+#include "uring.h"
 
 /**
  *  Begin of namespace
@@ -77,6 +78,24 @@ Core::~Core()
     _loop->cancel(_timer, this);
 }
 
+/**
+ *  Add a new lookup to the wheel or to the overflow buffer, without arming the timer
+ *  @param  lookup
+ *  @return bool        can the lookup run right away?
+ */
+bool Core::enqueue(Lookup *lookup)
+{
+    // if we already have too many operations in progress (or if the tenant or 
+    // the nameserver is too busy), we delay it
+    if (_wheel.active() >= _capacity || !admit(lookup)) { _scheduled.push_back(lookup); return false; }
+    
+    // we want to run it immediately
+    _wheel.push(lookup, lookup->credits() > 0);
+    
+    // the timer should be armed
+    return true;
+}
+
 /**
  *  Add a new lookup to the list
  *  @param  lookup
@@ -84,34 +103,114 @@ Core::~Core()
  */
 Operation *Core::add(Lookup *lookup)
 {
-    // add to the operations
-    if (_lookups.size() < _capacity)
-    {
-        // put at the beginning of the list (because we want to run it immediately)
-        _lookups.emplace_front(lookup);
-        
-        // if we already have a timer the expires immediately
-        if (_timer && _immediate) return lookup;
-    
-        // stop existing timer
-        if (_timer) _loop->cancel(_timer, this);
-        
-        // reschedule the timer
-        _timer = _loop->timer(0.0, this);
-        
-        // this is an immediate-timer
-        _immediate = true;
-    }
-    else
-    {
-        // we already have too many operations in progress, delay it
-        _scheduled.emplace_back(lookup);
-    }
+    // add to the operations, and make sure the timer expires right away if it can run
+    if (enqueue(lookup)) wakeup();
     
     // expose the operation
     return lookup;
 }
 
+/**
+ *  Move a lookup that is still waiting to be admitted to a higher priority class
+ *  @param  lookup      the lookup that is shared
+ *  @param  options     the options of the query that shares it
+ */
+void Core::promote(Lookup *lookup, const Options &options)
+{
+    // only a promotion makes sense (a lower class would only delay the queries that already share the lookup)
+    if (options.priority() >= lookup->options().priority()) return;
+
+    // lookups that were already admitted are not waiting for anything
+    if (!_scheduled.remove(lookup)) return;
+
+    // the lookup now runs in the class and for the tenant of the query that shares it
+    lookup->_options.priority(options.priority()); lookup->_options.tenant(options.tenant());
+
+    // queue it again (in its new class), it may even be admitted right away
+    if (enqueue(lookup)) wakeup();
+}
+
+/**
+ *  Remove a lookup that is finished or cancelled
+ *  @param  lookup      the lookup to remove
+ */
+void Core::remove(Lookup *lookup)
+{
+    // the lookup is either in the overflow buffer, or in the wheel (or in neither 
+    // when it is the lookup that is being processed right now)
+    if (!_scheduled.remove(lookup)) _wheel.remove(lookup);
+    
+    // the tenant has one lookup less in flight
+    release(lookup);
+    
+    // if the lookup freed up capacity, the scheduled lookups can start
+    if (!_scheduled.empty() && _wheel.active() < _capacity) wakeup();
+}
+
+/**
+ *  Try to admit a lookup
+ *  @param  lookup      the lookup to admit
+ *  @return bool        was the lookup admitted?
+ */
+bool Core::admit(Lookup *lookup)
+{
+    // without a per-tenant limit, only the nameserver has to have room
+    if (_tenantcapacity == 0) return lookup->admit();
+    
+    // the tenant of the lookup
+    auto tenant = lookup->options().tenant();
+    
+    // find the number of lookups that the tenant has in flight
+    auto iter = _tenants.find(tenant);
+    
+    // the tenant must have room, and so must the nameserver
+    if (iter != _tenants.end() && iter->second >= _tenantcapacity) return false;
+    if (!lookup->admit()) return false;
+    
+    // the lookup is counted for the tenant
+    _tenants[tenant] += 1; lookup->_counted = true;
+    
+    // the lookup is admitted
+    return true;
+}
+
+/**
+ *  Release the resources that an admitted lookup held
+ *  @param  lookup      the lookup that is finished
+ */
+void Core::release(Lookup *lookup)
+{
+    // nothing to do if the lookup was not counted
+    if (!lookup->_counted) return;
+    
+    // find the tenant
+    auto iter = _tenants.find(lookup->options().tenant());
+    
+    // the lookup is no longer counted
+    lookup->_counted = false;
+    
+    // this should not happen
+    if (iter == _tenants.end()) return;
+    
+    // forget the tenant when it has nothing left in flight
+    if (--iter->second == 0) _tenants.erase(iter);
+}
+
+/**
+ *  Make sure that the timer expires right away
+ */
+void Core::wakeup()
+{
+    // if we already have a timer the expires immediately
+    if (_timer && _immediate) return;
+
+    // re-arm the timer so that it expires right away
+    _timer = _loop->reset(_timer, 0.0, this);
+    
+    // this is an immediate-timer
+    _immediate = true;
+}
+
 /**
  *  Calculate the delay until the next job
  *  @return double      the delay in seconds (or < 0 if there is no need to run a timer)
@@ -125,15 +224,8 @@ double Core::delay(double now)
         if (nameserver.busy()) return 0.0;
     }
     
-    // if there is nothing scheduled
-    if (_lookups.empty() && _ready.empty()) return -1.0;
-    
-    // if only one is set
-    if (_lookups.empty()) return _ready.front()->delay(now);
-    if (_ready.empty()) return _lookups.front()->delay(now);
-    
-    // get the minimum
-    return std::min(_lookups.front()->delay(now), _ready.front()->delay(now));
+    // the wheel knows when the next lookup should run
+    return _wheel.next(now);
 }
 
 /**
@@ -151,36 +243,56 @@ void Core::reschedule(double now)
     // if timer was immediate and stays immediate, not changes are needed
     if (seconds == 0.0 && _timer != nullptr && _immediate) return;
 
-    // if the timer is already running we have to reset it
-    if (_timer != nullptr) _loop->cancel(_timer, this);
+    // if there is nothing left to do, we release the timer (so that it no longer keeps the event loop alive)
+    if (seconds < 0.0) { _loop->cancel(_timer, this); _timer = nullptr; _immediate = false; return; }
     
-    // check when the next operation should run
-    _timer = seconds < 0 ? nullptr : _loop->timer(seconds, this);
+    // re-arm the timer for when the next operation should run
+    _timer = _loop->reset(_timer, seconds, this);
     _immediate = seconds == 0.0;
 }
 
+/**
+ *  Store a lookup in the wheel, at the time when it wants to run again
+ *  @param  lookup      the lookup to store
+ *  @param  now         current time
+ */
+void Core::schedule(Lookup *lookup, double now)
+{
+    // does the lookup still have to send datagrams (only those count for the capacity)
+    bool active = lookup->credits() > 0;
+    
+    // how long should the lookup wait?
+    auto delay = lookup->delay(now);
+    
+    // store in the wheel
+    if (delay > 0.0) _wheel.insert(lookup, now + delay, active);
+    
+    // lookups that want to run right away are due immediately
+    else _wheel.push(lookup, active);
+}
+
 /**
  *  Process a lookup
  *  @param  lookup      the lookup to process
  *  @param  now         current time
- *  @return bool        was this lookup indeed processable (false if processed too early)
  */
-bool Core::process(const std::shared_ptr<Lookup> &lookup, double now)
+void Core::process(Lookup *lookup, double now)
 {
-    // if it is not yet time to run this lookup, we do nothing more
-    if (lookup->delay(now) > 0.0) return false;
+    // if it is not yet time to run this lookup (possible when settings were changed), we put it back
+    if (lookup->delay(now) > 0.0) return schedule(lookup, now);
+
+    // a call to userspace might destruct `this`
+    Watcher watcher(this);
 
-    // run the lookup (if this fails the lookup was already finished and we do not have to reschedule it)
-    if (!lookup->execute(now)) return true;
+    // run the lookup (if this fails the lookup is finished, and it already gave up its resources before it reported to userspace)
+    if (!lookup->execute(now)) { delete lookup; return; }
     
-    // if no more attempts are expected, we put it in a special list
-    if (lookup->credits() == 0) _ready.push_back(lookup);
+    // a lookup that keeps running after it reported an intermediate result (like an expired
+    // response from the cache) cannot be rescheduled when userspace destructed `this`
+    if (!watcher.valid()) return lookup->orphan();
     
     // remember the lookup for the next attempt
-    else _lookups.push_back(lookup);
-    
-    // done
-    return true;
+    schedule(lookup, now);
 }
 
 /**
@@ -190,17 +302,24 @@ bool Core::process(const std::shared_ptr<Lookup> &lookup, double now)
  */
 void Core::proceed(double now, size_t count)
 {
-    // iterate
-    while (count > 0)
+    // a call to userspace might destruct `this`
+    Watcher watcher(this);
+    
+    // iterate (operations are started in order of priority, with the tenants taking turns,
+    // as long as the tenants and the nameservers have room for them)
+    while (count > 0 && !_scheduled.empty())
     {
-        // not possible if nothing is scheduled
-        if (_scheduled.empty()) return;
+        // get the next operation that can be admitted (it is no longer scheduled)
+        auto *lookup = _scheduled.pop_front([this](Lookup *lookup) { return admit(lookup); });
         
-        // get the oldest scheduled operation (the process() always returns true)
-        if (!process(_scheduled.front(), now)) return;
+        // leap out if nothing can be admitted
+        if (lookup == nullptr) break;
         
-        // this lookup is no longer scheduled
-        _scheduled.pop_front();
+        // run it
+        process(lookup, now);
+        
+        // maybe the userspace call ended up in `this` being destructed
+        if (!watcher.valid()) return;
         
         // one extra operation is scheduled
         count -= 1;
@@ -212,8 +331,8 @@ void Core::proceed(double now, size_t count)
  */
 void Core::expire()
 {
-    // forget the timer
-    _loop->cancel(_timer, this); _timer = nullptr;
+    // the timer is no longer pending (but we keep it so that it can be re-armed)
+    _immediate = false;
     
     // a call to userspace might destruct `this`
     Watcher watcher(this);
@@ -243,50 +362,49 @@ void Core::expire()
         // start other operations now that some earlier operations are completed
         proceed(now, count);
         
+        // userspace might have destructed `this` while the operations were started
+        if (!watcher.valid()) return;
+        
         // is it meaningful to proceed
         if (calls > _maxcalls) break;        
     }
     
-    // there was no data to process, so we are going to run jobs
-    while (calls < _maxcalls && !_lookups.empty())
+    // move the lookups that should run by now to the front of the wheel
+    _wheel.advance(now);
+    
+    // run the lookups that are due (in order of their deadlines)
+    while (calls < _maxcalls)
     {
-        // get the oldest operation
-        if (!process(_lookups.front(), now)) break;
+        // get the oldest lookup that is due
+        auto *lookup = _wheel.pop();
+        
+        // leap out if nothing is due
+        if (lookup == nullptr) break;
+        
+        // run the lookup
+        process(lookup, now);
         
         // maybe the userspace call ended up in `this` being destructed
         if (!watcher.valid()) return;
         
         // log one extra call (this is not entirely correct, maybe there was no call to userspace)
         calls += 1;
-        
-        // forget this lookup because we ran it
-        _lookups.pop_front();
     }
     
-    // look at lookups that can no longer be repeated, but for which we're waiting for answer
-    while (calls < _maxcalls && !_ready.empty())
-    {
-        // get the oldest operation
-        if (!process(_ready.front(), now)) break;
-
-        // maybe the userspace call ended up in `this` being destructed
-        if (!watcher.valid()) return;
-
-        // log one extra call
-        calls += 1;
-        
-        // forget this lookup because we are going to run it
-        _ready.pop_front();
-    }
-
     // if there are more slots for scheduled operations, we start them now
-    if (_capacity > _lookups.size()) proceed(now, _capacity - _lookups.size());
+    if (_capacity > _wheel.active()) proceed(now, _capacity - _wheel.active());
+    
+    // userspace might have destructed `this` while the operations were started
+    if (!watcher.valid()) return;
+    
+    // the datagrams that were queued in this iteration are sent with as few system calls as possible
+    for (auto &nameserver : _nameservers) nameserver.flush();
+    if (_uring) _uring->flush();
     
     // reset the timer
     reschedule(now);
 }
 
-
     
 /**
  *  End of namespace
@@ -0,0 +1,118 @@
+/**
+ *  Doorbell.h
+ *
+ *  Wake-up signal for a thread that runs an event loop. Other threads ring
+ *  the doorbell after they added messages to one of its queues, the
+ *  receiving thread monitors the eventfd for readability. Only the first
+ *  ring after the receiver reset the doorbell results in a system call,
+ *  further rings only cost an atomic load.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <atomic>
+#include <stdexcept>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Doorbell
+{
+private:
+    /**
+     *  The eventfd that becomes readable when the doorbell rings
+     *  @var int
+     */
+    int _fd;
+
+    /**
+     *  Did the doorbell ring since the receiver last reset it?
+     *  @var std::atomic<bool>
+     */
+    std::atomic<bool> _rung;
+
+public:
+    /**
+     *  Constructor
+     *  @throws std::runtime_error
+     */
+    Doorbell() : _fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), _rung(false)
+    {
+        // check for failure
+        if (_fd < 0) throw std::runtime_error("failed to create eventfd");
+    }
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Doorbell(const Doorbell &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Doorbell()
+    {
+        // close the eventfd
+        close(_fd);
+    }
+
+    /**
+     *  The filedescriptor that the receiver should monitor for readability
+     *  @return int
+     */
+    int fd() const { return _fd; }
+
+    /**
+     *  Ring the doorbell (this can be called from any thread, after a message was added)
+     */
+    void ring()
+    {
+        // the message must be visible before we check the flag (this pairs with the fence in reset())
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // if the receiver was already woken up, it will also see our message
+        if (_rung.load(std::memory_order_relaxed) || _rung.exchange(true, std::memory_order_acq_rel)) return;
+
+        // wake up the receiver
+        uint64_t value = 1; if (write(_fd, &value, sizeof(value))) {}
+    }
+
+    /**
+     *  Reset the doorbell (this should be called by the receiver before it takes out the messages)
+     */
+    void reset()
+    {
+        // empty the eventfd
+        uint64_t value; if (read(_fd, &value, sizeof(value))) {}
+
+        // messages that are added from now on ring the doorbell again
+        _rung.store(false, std::memory_order_relaxed);
+
+        // the flag must be cleared before the receiver looks at its queues (this pairs with the fence in ring())
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
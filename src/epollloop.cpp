@@ -0,0 +1,331 @@
+/**
+ *  EpollLoop.cpp
+ *
+ *  Implementation file for the EpollLoop class
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/epollloop.h"
+#include "../include/dnscpp/monitor.h"
+#include "../include/dnscpp/timer.h"
+#include "../include/dnscpp/now.h"
+#include <stdexcept>
+#include <algorithm>
+#include <unistd.h>
+#include <math.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  The events to pass to epoll
+ *  @param  events      the events to monitor for (1 for readability, 2 for writability)
+ *  @return uint32_t
+ */
+static uint32_t flags(int events)
+{
+    // monitor edge-triggered
+    return EPOLLET | (events & 1 ? EPOLLIN : 0) | (events & 2 ? EPOLLOUT : 0);
+}
+
+/**
+ *  Constructor
+ *  @param  events      max number of events that are handled per iteration
+ *  @throws std::runtime_error
+ */
+EpollLoop::EpollLoop(size_t events) : _fd(epoll_create1(EPOLL_CLOEXEC)), _events(std::max(events, size_t(1)))
+{
+    // check for failure
+    if (_fd < 0) throw std::runtime_error("failed to create epoll instance");
+}
+
+/**
+ *  Destructor
+ */
+EpollLoop::~EpollLoop()
+{
+    // close the epoll instance
+    close(_fd);
+}
+
+/**
+ *  Add a filedescriptor to the loop
+ *  @param  fd          the filedescriptor
+ *  @param  events      the events to monitor for
+ *  @param  monitor     the object to notify
+ *  @return void*       identifier of the watch
+ */
+void *EpollLoop::add(int fd, int events, Monitor *monitor)
+{
+    // recycle a watch, or add a new one
+    Watch *watch = nullptr;
+    if (_unused.empty()) { _watches.emplace_back(); watch = &_watches.back(); }
+    else { watch = _unused.back(); _unused.pop_back(); }
+
+    // set it up
+    *watch = Watch{ fd, monitor };
+
+    // the event for epoll
+    struct epoll_event event{}; event.events = flags(events); event.data.ptr = watch;
+
+    // add to epoll
+    epoll_ctl(_fd, EPOLL_CTL_ADD, fd, &event);
+
+    // one more watch in use
+    _active += 1;
+
+    // expose the watch
+    return watch;
+}
+
+/**
+ *  Change the events that are monitored
+ *  @param  identifier  identifier of the watch
+ *  @param  fd          the filedescriptor
+ *  @param  events      the events to monitor for
+ *  @param  monitor     the object to notify
+ *  @return void*       new identifier of the watch
+ */
+void *EpollLoop::update(void *identifier, int fd, int events, Monitor *monitor)
+{
+    // the watch
+    auto *watch = (Watch *)identifier;
+
+    // the monitor may have changed
+    watch->monitor = monitor;
+
+    // the event for epoll
+    struct epoll_event event{}; event.events = flags(events); event.data.ptr = watch;
+
+    // modify it (this also makes epoll look at the filedescriptor again, so that
+    // monitors that did not read everything can be notified once more)
+    epoll_ctl(_fd, EPOLL_CTL_MOD, fd, &event);
+
+    // the identifier stays the same
+    return identifier;
+}
+
+/**
+ *  Stop monitoring a filedescriptor
+ *  @param  identifier  identifier of the watch
+ *  @param  fd          the filedescriptor
+ *  @param  monitor     the object that was notified
+ */
+void EpollLoop::remove(void *identifier, int fd, Monitor *monitor)
+{
+    // the watch
+    auto *watch = (Watch *)identifier;
+
+    // remove from epoll
+    epoll_ctl(_fd, EPOLL_CTL_DEL, fd, nullptr);
+
+    // it is recycled in the next iteration (there may still be events for it in this one)
+    watch->monitor = nullptr; _removed.push_back(watch);
+
+    // one less watch in use
+    _active -= 1;
+}
+
+/**
+ *  Move an alarm to its right place in the heap
+ *  @param  alarm       the alarm
+ */
+void EpollLoop::sift(Alarm *alarm)
+{
+    // the position of the alarm
+    size_t position = alarm->position;
+
+    // move it up while it expires before its parent
+    while (position > 0 && alarm->expires < _heap[(position - 1) / 2]->expires)
+    {
+        // move the parent down
+        place(_heap[(position - 1) / 2], position); position = (position - 1) / 2;
+    }
+
+    // move it down while one of its children expires earlier
+    while (true)
+    {
+        // the first child, and the earliest child
+        size_t child = 2 * position + 1;
+        if (child >= _heap.size()) break;
+        if (child + 1 < _heap.size() && _heap[child + 1]->expires < _heap[child]->expires) child += 1;
+
+        // stop if the alarm expires before the child
+        if (!(_heap[child]->expires < alarm->expires)) break;
+
+        // move the child up
+        place(_heap[child], position); position = child;
+    }
+
+    // the final place of the alarm
+    place(alarm, position);
+}
+
+/**
+ *  Add an alarm to the heap
+ *  @param  alarm       the alarm
+ */
+void EpollLoop::push(Alarm *alarm)
+{
+    // add it to the end, and move it to its place
+    _heap.push_back(alarm); alarm->position = _heap.size() - 1; sift(alarm);
+}
+
+/**
+ *  Remove an alarm from the heap
+ *  @param  alarm       the alarm
+ */
+void EpollLoop::erase(Alarm *alarm)
+{
+    // not possible if it is not pending
+    if (alarm->position == npos) return;
+
+    // the last alarm in the heap takes its place
+    auto *last = _heap.back(); _heap.pop_back();
+
+    // if the alarm was not the last one, the last one has to be moved to its place
+    if (last != alarm) { last->position = alarm->position; _heap[last->position] = last; sift(last); }
+
+    // the alarm is no longer pending
+    alarm->position = npos;
+}
+
+/**
+ *  Set a timer
+ *  @param  timeout     number of seconds after which the timer expires
+ *  @param  timer       the object to notify
+ *  @return void*       identifier of the timer
+ */
+void *EpollLoop::timer(double timeout, Timer *timer)
+{
+    // recycle an alarm, or add a new one
+    Alarm *alarm = nullptr;
+    if (_spare.empty()) { _alarms.emplace_back(); alarm = &_alarms.back(); }
+    else { alarm = _spare.back(); _spare.pop_back(); }
+
+    // set it up
+    *alarm = Alarm{ Now() + timeout, timer, npos, false };
+
+    // add it to the heap
+    push(alarm);
+
+    // expose the alarm
+    return alarm;
+}
+
+/**
+ *  Cancel a timer
+ *  @param  identifier  identifier of the timer
+ *  @param  timer       the object that would have been notified
+ */
+void EpollLoop::cancel(void *identifier, Timer *timer)
+{
+    // the alarm
+    auto *alarm = (Alarm *)identifier;
+
+    // it is no longer pending, and it can be recycled
+    erase(alarm); alarm->due = false; _spare.push_back(alarm);
+}
+
+/**
+ *  Re-arm a timer
+ *  @param  identifier  identifier of the timer (or nullptr)
+ *  @param  timeout     number of seconds after which the timer expires
+ *  @param  timer       the object to notify
+ *  @return void*       identifier of the timer
+ */
+void *EpollLoop::reset(void *identifier, double timeout, Timer *timer)
+{
+    // if there is no timer yet, we create one
+    if (identifier == nullptr) return this->timer(timeout, timer);
+
+    // the alarm
+    auto *alarm = (Alarm *)identifier;
+
+    // set the new time, it is no longer due for the current iteration
+    alarm->expires = Now() + timeout; alarm->timer = timer; alarm->due = false;
+
+    // move it to its new place, or put it back in the heap
+    if (alarm->position == npos) push(alarm); else sift(alarm);
+
+    // the identifier stays the same
+    return identifier;
+}
+
+/**
+ *  Run a single iteration
+ *  @param  timeout     max number of seconds to wait (negative to wait until something happens)
+ *  @return bool        is there still something to wait for?
+ */
+bool EpollLoop::step(double timeout)
+{
+    // the watches that were removed in the previous iteration can be recycled now
+    _unused.insert(_unused.end(), _removed.begin(), _removed.end()); _removed.clear();
+
+    // if there is nothing to wait for, we're done
+    if (_active == 0 && _heap.empty()) return false;
+
+    // we do not wait longer than the first alarm
+    if (!_heap.empty())
+    {
+        // time until the first alarm
+        double first = std::max(_heap.front()->expires - Now(), 0.0);
+
+        // wait for the alarm, or shorter
+        timeout = timeout < 0.0 ? first : std::min(timeout, first);
+    }
+
+    // wait for something to happen (timeouts are rounded up, to avoid waking up just too early)
+    int result = epoll_wait(_fd, _events.data(), _events.size(), timeout < 0.0 ? -1 : int(ceil(timeout * 1000.0)));
+
+    // notify the monitors of the filedescriptors that are active
+    for (int i = 0; i < result; ++i)
+    {
+        // the watch
+        auto *watch = (Watch *)_events[i].data.ptr;
+
+        // skip watches that were removed in the meantime
+        if (watch->monitor == nullptr) continue;
+
+        // notify the monitor
+        watch->monitor->notify();
+    }
+
+    // the current time (the notifications took time too)
+    double now = Now();
+
+    // take out the alarms that expired (alarms that are re-armed while we notify are only looked at in the next iteration)
+    _due.clear();
+    while (!_heap.empty() && _heap.front()->expires <= now)
+    {
+        // the alarm is due, it is no longer pending but it keeps its identifier until it is cancelled
+        auto *alarm = _heap.front(); erase(alarm); alarm->due = true; _due.push_back(alarm);
+    }
+
+    // notify the timers
+    for (auto *alarm : _due)
+    {
+        // skip alarms that were cancelled or re-armed by an earlier timer
+        if (!alarm->due) continue;
+
+        // the alarm is no longer due
+        alarm->due = false;
+
+        // notify the timer
+        alarm->timer->expire();
+    }
+
+    // there may be more to wait for
+    return true;
+}
+
+/**
+ *  End of namespace
+ */
+}
@@ -0,0 +1,49 @@
+/**
+ *  Follower.cpp
+ *
+ *  Implementation file for the Follower class
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "follower.h"
+#include "remotelookup.h"
+#include "../include/dnscpp/handler.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Cancel the operation
+ */
+void Follower::cancel()
+{
+    // if already reported back to user-space
+    if (_handler == nullptr) return;
+
+    // remember the handler
+    auto *handler = _handler;
+
+    // get rid of the handler to avoid that the result is reported
+    _handler = nullptr;
+
+    // the leader no longer has to notify us (this may stop the leader too)
+    _leader->detach(this);
+
+    // report it back to user-space
+    handler->onCancelled(this);
+
+    // the follower is no longer needed
+    delete this;
+}
+
+/**
+ *  End of namespace
+ */
+}
+
@@ -0,0 +1,101 @@
+/**
+ *  Follower.h
+ *
+ *  When a lookup is started while an identical lookup (same name, type and
+ *  bits) is already in progress, no new datagrams are sent. Instead, a
+ *  follower is attached to the lookup that is already running (the leader),
+ *  and the follower is notified with the same result. The follower has its
+ *  own handler and can be cancelled independently.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/operation.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class RemoteLookup;
+
+/**
+ *  Class definition
+ */
+class Follower : public Operation
+{
+private:
+    /**
+     *  The lookup that does the actual work
+     *  @var RemoteLookup
+     */
+    RemoteLookup *_leader;
+
+    /**
+     *  Cancel the operation
+     */
+    virtual void cancel() override;
+
+public:
+    /**
+     *  Constructor
+     *  @param  leader      the lookup that does the actual work
+     *  @param  domain      the domain of the lookup
+     *  @param  type        type of records to look for
+     *  @param  bits        the bits to include in the request
+     *  @param  handler     user space object interested in the result
+     *  @throws std::runtime_error
+     */
+    Follower(RemoteLookup *leader, const char *domain, ns_type type, const Bits &bits, Handler *handler) :
+        Operation(handler, ns_o_query, domain, type, bits), _leader(leader) {}
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Follower(const Follower &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Follower() = default;
+
+    /**
+     *  Report the result of the leader to userspace and destruct the follower
+     *  @param  callback    function that reports to userspace
+     */
+    template <typename CALLBACK>
+    void report(const CALLBACK &callback)
+    {
+        // remember the handler
+        auto *handler = _handler;
+
+        // forget the handler so that the operation can no longer be cancelled
+        _handler = nullptr;
+
+        // report to userspace
+        callback(handler, this);
+
+        // the follower is no longer needed
+        delete this;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
+
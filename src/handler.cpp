@@ -31,6 +31,16 @@ void Handler::onTimeout(const Operation *operation)
     onFailure(operation, ns_r_servfail);
 }
 
+/**
+ *  Method that is called when an operation is given up because its deadline passed
+ *  @param  operation       the operation that expired
+ */
+void Handler::onExpired(const Operation *operation)
+{
+    // we treat this as a timeout
+    onTimeout(operation);
+}
+
 /**
  *  Method that is called when a raw response is received
  *  @param  operation       the reporting operation
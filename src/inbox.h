@@ -0,0 +1,115 @@
+/**
+ *  Inbox.h
+ *
+ *  The results of the lookups that a channel submitted to the resolver pool.
+ *  Every worker thread has its own queue in the inbox, so that each queue
+ *  has exactly one producer (the worker) and one consumer (the thread of the
+ *  channel), and adding a result never takes a lock. After a worker added
+ *  a result, it rings the doorbell of the channel.
+ *
+ *  The inbox is shared by the channel and the lookups that are still running
+ *  in the workers, so that a channel can be destructed while its lookups are
+ *  still in progress (their results then end up in an inbox that nobody reads).
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <vector>
+#include <memory>
+#include "spscqueue.h"
+#include "doorbell.h"
+#include "ticket.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Inbox
+{
+private:
+    /**
+     *  The results that were not yet taken out, one queue per worker
+     *  @var std::vector
+     */
+    std::vector<std::unique_ptr<SpscQueue<Result>>> _queues;
+
+    /**
+     *  The doorbell to wake up the thread of the channel
+     *  @var Doorbell
+     */
+    Doorbell _doorbell;
+
+public:
+    /**
+     *  Constructor
+     *  @param  workers     number of worker threads
+     *  @throws std::runtime_error
+     */
+    Inbox(size_t workers)
+    {
+        // create a queue for every worker
+        for (size_t i = 0; i < workers; ++i) _queues.emplace_back(new SpscQueue<Result>());
+    }
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Inbox(const Inbox &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Inbox() = default;
+
+    /**
+     *  The filedescriptor that the channel should monitor for readability
+     *  @return int
+     */
+    int fd() const { return _doorbell.fd(); }
+
+    /**
+     *  Number of queues
+     *  @return size_t
+     */
+    size_t size() const { return _queues.size(); }
+
+    /**
+     *  Add a result (this should only be called by the worker that owns the queue)
+     *  @param  worker      index of the worker
+     *  @param  result      the result
+     */
+    void post(size_t worker, Result &&result) { _queues[worker]->push(std::move(result)); _doorbell.ring(); }
+
+    /**
+     *  Reset the doorbell (this should be called by the channel before it takes out the results)
+     */
+    void reset() { _doorbell.reset(); }
+
+    /**
+     *  Take out the oldest result of a worker (this should only be called by the thread of the channel)
+     *  @param  worker      index of the worker
+     *  @param  result      where the result is stored
+     *  @return bool        was there a result?
+     */
+    bool take(size_t worker, Result &result) { return _queues[worker]->pop(result); }
+};
+
+/**
+ *  End of namespace
+ */
+}
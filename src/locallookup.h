@@ -52,11 +52,17 @@ private:
         // do nothing if ready
         if (_ready) return false;
         
-        // pass to the hosts
-        _hosts.notify(Request(this), _handler, this);
+        // remember the handler
+        auto *handler = _handler;
+        
+        // remember that the operation is ready (and forget the handler so that it can no longer be cancelled)
+        _ready = true; _handler = nullptr;
         
-        // remember that the operation is ready
-        _ready = true;
+        // the tenant has one lookup less in flight (before we call userspace, which may destruct the core)
+        _core->release(this);
+        
+        // pass to the hosts
+        _hosts.notify(Request(this), handler, this);
         
         // no need to reschedule
         return false;
@@ -83,6 +89,16 @@ private:
         return 0;
     }
     
+    /**
+     *  Try to admit the lookup
+     *  @return bool        was the lookup admitted?
+     */
+    virtual bool admit() override
+    {
+        // local lookups do not contact a nameserver, so they can always run
+        return true;
+    }
+    
     /**
      *  Cancel the lookup
      */
@@ -95,10 +111,16 @@ private:
         auto *handler = _handler;
         
         // get rid of the handler to avoid that the result is reported
-        _handler = nullptr;
+        _handler = nullptr; _ready = true;
+        
+        // the core no longer has to keep track of this lookup
+        _core->remove(this);
         
-        // the last instruction is to report it back to user-space
+        // report it back to user-space
         handler->onCancelled(this);
+        
+        // the lookup is no longer needed
+        delete this;
     }
 
     
@@ -107,22 +129,26 @@ public:
      *  Constructor
      *  To keep the behavior of lookups consistent with the behavior of remote lookups, we set
      *  a timer so that userspace will be informed in a later tick of the event loop
+     *  @param  core
      *  @param  hosts
      *  @param  domain
      *  @param  type
+     *  @param  options
      *  @param  handler
      */
-    LocalLookup(const Hosts &hosts, const char *domain, int type, Handler *handler) : 
-        Lookup(handler, ns_o_query, domain, type, false), _hosts(hosts) {}
+    LocalLookup(Core *core, const Hosts &hosts, const char *domain, int type, const Options &options, Handler *handler) : 
+        Lookup(core, options, handler, ns_o_query, domain, type, false), _hosts(hosts) {}
 
     /**
      *  Constructor
      *  This is a utility constructor for reverse lookups
+     *  @param  core
      *  @param  hosts
      *  @param  ip
+     *  @param  options
      *  @param  handler
      */
-    LocalLookup(const Hosts &hosts, const Ip &ip, Handler *handler) : LocalLookup(hosts, Reverse(ip), TYPE_PTR, handler) {}
+    LocalLookup(Core *core, const Hosts &hosts, const Ip &ip, const Options &options, Handler *handler) : LocalLookup(core, hosts, Reverse(ip), TYPE_PTR, options, handler) {}
 
     /**
      *  Destructor
@@ -131,9 +157,8 @@ public:
     virtual ~LocalLookup()
     {
         // if the operation is destructed while it was still running, it means that the
-        // operation was prematurely cancelled from user-space, let the handler know
-        // @todo check if this is correct  / also implement the cancel() method
-        if (!_ready) _handler->onCancelled(this);
+        // core was destructed before the lookup ran, let the handler know
+        if (!_ready && _handler) _handler->onCancelled(this);
     }
 };
     
@@ -0,0 +1,103 @@
+/**
+ *  Lookups.cpp
+ *
+ *  Implementation file for the Lookups class
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/lookups.h"
+#include "../include/dnscpp/lookup.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Destructor
+ */
+Lookups::~Lookups()
+{
+    // destruct all lookups that are still in the list
+    while (_first != nullptr) delete pop_front();
+}
+
+/**
+ *  Does the list contain a certain lookup?
+ *  @param  lookup
+ *  @return bool
+ */
+bool Lookups::contains(const Lookup *lookup) const
+{
+    // the lookup knows the list that holds it
+    return lookup->_list == this;
+}
+
+/**
+ *  Add a lookup to the end of the list
+ *  @param  lookup
+ */
+void Lookups::push_back(Lookup *lookup)
+{
+    // link the lookup
+    lookup->_list = this;
+    lookup->_prev = _last;
+    lookup->_next = nullptr;
+
+    // update the neighbour
+    if (_last) _last->_next = lookup; else _first = lookup;
+
+    // this is the new end of the list
+    _last = lookup;
+    _size += 1;
+}
+
+/**
+ *  Remove the first lookup from the list
+ *  @return Lookup
+ */
+Lookup *Lookups::pop_front()
+{
+    // remember the first lookup
+    auto *lookup = _first;
+
+    // remove it (if there was one)
+    if (lookup) remove(lookup);
+
+    // expose the lookup
+    return lookup;
+}
+
+/**
+ *  Remove a lookup from the list
+ *  @param  lookup
+ *  @return bool
+ */
+bool Lookups::remove(Lookup *lookup)
+{
+    // the lookup must be part of this list
+    if (lookup->_list != this) return false;
+
+    // update the neighbours
+    if (lookup->_prev) lookup->_prev->_next = lookup->_next; else _first = lookup->_next;
+    if (lookup->_next) lookup->_next->_prev = lookup->_prev; else _last = lookup->_prev;
+
+    // the lookup is no longer linked
+    lookup->_list = nullptr;
+    lookup->_prev = lookup->_next = nullptr;
+
+    // one lookup less
+    _size -= 1;
+
+    // done
+    return true;
+}
+
+/**
+ *  End of namespace
+ */
+}
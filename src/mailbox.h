@@ -0,0 +1,102 @@
+/**
+ *  Mailbox.h
+ *
+ *  Queue to pass messages from any thread to a thread that runs an event
+ *  loop. Posting a message does not take a lock: it is appended to a
+ *  lock-free queue, and the receiver is only woken up (via an eventfd) when
+ *  it was not already woken up. The receiver then takes out all messages in
+ *  one batch.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <vector>
+#include "mpscqueue.h"
+#include "doorbell.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+template <typename MESSAGE>
+class Mailbox
+{
+private:
+    /**
+     *  The messages that were not yet taken out
+     *  @var MpscQueue
+     */
+    MpscQueue<MESSAGE> _messages;
+
+    /**
+     *  The doorbell to wake up the receiver
+     *  @var Doorbell
+     */
+    Doorbell _doorbell;
+
+public:
+    /**
+     *  Constructor
+     *  @throws std::runtime_error
+     */
+    Mailbox() = default;
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Mailbox(const Mailbox &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Mailbox() = default;
+
+    /**
+     *  The filedescriptor that the receiver should monitor for readability
+     *  @return int
+     */
+    int fd() const { return _doorbell.fd(); }
+
+    /**
+     *  Post a message (this can be called from any thread)
+     *  @param  message     the message to post
+     */
+    void post(MESSAGE &&message)
+    {
+        // add the message, and wake up the receiver
+        _messages.push(std::move(message)); _doorbell.ring();
+    }
+
+    /**
+     *  Take out all messages (this should be called by the receiver when the filedescriptor is readable)
+     *  @param  messages    vector to which the messages are added
+     */
+    void take(std::vector<MESSAGE> &messages)
+    {
+        // messages that are posted from now on wake us up again
+        _doorbell.reset();
+
+        // take out the messages
+        MESSAGE message; while (_messages.pop(message)) messages.push_back(std::move(message));
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
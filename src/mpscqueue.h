@@ -0,0 +1,136 @@
+/**
+ *  MpscQueue.h
+ *
+ *  Unbounded queue that can be filled by many threads, and that is emptied
+ *  by a single thread. Adding a message takes one atomic exchange, and
+ *  never blocks (the queue is a linked list, the consumer starts at the
+ *  oldest node, the producers append to the newest).
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <atomic>
+#include <utility>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+template <typename TYPE>
+class MpscQueue
+{
+private:
+    /**
+     *  A message in the queue
+     */
+    struct Node
+    {
+        /**
+         *  The next (newer) node
+         *  @var std::atomic
+         */
+        std::atomic<Node*> next;
+
+        /**
+         *  The message
+         *  @var TYPE
+         */
+        TYPE value;
+
+        /**
+         *  Constructor
+         *  @param  value       the message
+         */
+        Node(TYPE &&value = TYPE()) : next(nullptr), value(std::move(value)) {}
+    };
+
+    /**
+     *  The newest node (where the producers append)
+     *  @var std::atomic
+     */
+    std::atomic<Node*> _newest;
+
+    /**
+     *  The node before the oldest message (its value was already taken out by the consumer)
+     *  @var Node
+     */
+    Node *_oldest;
+
+public:
+    /**
+     *  Constructor
+     */
+    MpscQueue() : _oldest(new Node())
+    {
+        // the queue starts empty
+        _newest.store(_oldest);
+    }
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    MpscQueue(const MpscQueue &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~MpscQueue()
+    {
+        // remove all nodes
+        while (_oldest) { auto *next = _oldest->next.load(); delete _oldest; _oldest = next; }
+    }
+
+    /**
+     *  Add a message (this can be called from any thread)
+     *  @param  value       the message
+     */
+    void push(TYPE &&value)
+    {
+        // the new node
+        auto *node = new Node(std::move(value));
+
+        // make it the newest node, and link it to the node that was the newest
+        _newest.exchange(node, std::memory_order_acq_rel)->next.store(node, std::memory_order_release);
+    }
+
+    /**
+     *  Take out the oldest message (this should only be called by the consumer)
+     *  Messages for which the producer is still busy linking are not yet visible.
+     *  @param  value       where the message is stored
+     *  @return bool        was there a message?
+     */
+    bool pop(TYPE &value)
+    {
+        // the node with the oldest message
+        auto *next = _oldest->next.load(std::memory_order_acquire);
+
+        // check if there is one
+        if (next == nullptr) return false;
+
+        // take out the message, the node is now the one before the oldest message
+        value = std::move(next->value); delete _oldest; _oldest = next;
+
+        // done
+        return true;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -25,33 +25,151 @@ namespace DNS {
  *  Constructor
  *  @param  core    the core object with the settings and event loop
  *  @param  ip      nameserver IP
+ *  @param  port    the port on which it listens
  *  @throws std::runtime_error
  */
-Nameserver::Nameserver(Core *core, const Ip &ip) : _core(core), _ip(ip), _udp(core, this) {}
+Nameserver::Nameserver(Core *core, const Ip &ip, uint16_t port) : _core(core), _ip(ip), _port(port) {}
 
 /**
  *  Destructor
  */
 Nameserver::~Nameserver() {}
 
+/**
+ *  The index of one of our sockets
+ *  @param  udp         the socket
+ *  @return size_t      the index (or SIZE_MAX if the socket is not ours)
+ */
+size_t Nameserver::index(const Udp *udp) const
+{
+    // look for the socket (there are not many of them)
+    for (size_t i = 0; i < _sockets.size(); ++i) if (&_sockets[i].udp == udp) return i;
+
+    // the socket is unknown
+    return SIZE_MAX;
+}
+
+/**
+ *  Subscribe to a socket to be notified about the response to a query
+ *  @param  handler     the handler that wants to receive an answer
+ *  @param  query       the query
+ *  @param  renumber    may the query get a new id?
+ *  @return size_t      index of the socket (or SIZE_MAX if the id is in use on every socket)
+ */
+size_t Nameserver::subscribe(Handler *handler, Query &query, bool renumber)
+{
+    // if the handler was already subscribed, it keeps using the same socket
+    for (size_t i = 0; i < _sockets.size(); ++i) if (_sockets[i].ids.find(query.id()) == handler) return i;
+
+    // the number of sockets that we may use (sockets are only added, never removed)
+    size_t count = std::max(_core->sockets(), size_t(1));
+    while (_sockets.size() < count) _sockets.emplace_back(_core, static_cast<Udp::Handler*>(this));
+
+    // look for a socket (in turns, to spread the queries over the sockets)
+    for (size_t i = 0; i < count; ++i)
+    {
+        // the socket to check
+        size_t candidate = (_next + i) % count;
+        auto &ids = _sockets[candidate].ids;
+
+        // a query that was not sent before gets an id that is free on the socket, other queries
+        // keep their id, so we need a socket on which it is not yet in use
+        if (renumber && !ids.full()) query.id(ids.allocate(_core->random(), handler));
+        else if (!ids.claim(query.id(), handler)) continue;
+
+        // the next search starts after this socket
+        _next = candidate + 1;
+
+        // expose the socket
+        return candidate;
+    }
+
+    // the id is in use on every socket, a response could not be told apart from the one for the other handler
+    return SIZE_MAX;
+}
+
 /**
  *  Send a datagram to the nameserver
+ *  @param  handler     the handler that wants to receive an answer
+ *  @param  query       the query to send
+ *  @param  renumber    may the query get a new id?
+ *  @return bool        was the handler subscribed? (false if there is no socket on which the id is free)
+ */
+bool Nameserver::datagram(Handler *handler, Query &query, bool renumber)
+{
+    // the socket on which the handler waits for the response
+    size_t index = subscribe(handler, query, renumber);
+
+    // nobody would listen for the response if we sent it anyway
+    if (index == SIZE_MAX) return false;
+
+    // queue the message on the socket of the handler (it is sent when the core flushes the nameservers,
+    // if the socket cannot be opened the datagram is lost, and the handler tries again later)
+    _sockets[index].udp.send(_ip, _port, query);
+
+    // the handler is subscribed
+    return true;
+}
+
+/**
+ *  Forget a datagram that was not yet sent
  *  @param  query
+ */
+void Nameserver::cancel(const Query &query)
+{
+    // the query may be queued on any of the sockets
+    for (auto &socket : _sockets) socket.udp.cancel(query);
+}
+
+/**
+ *  Is one of the sockets full, or are all ids in use?
  *  @return bool
  */
-bool Nameserver::datagram(const Query &query)
+bool Nameserver::blocked() const
+{
+    // check all sockets
+    for (const auto &socket : _sockets) if (socket.udp.blocked()) return true;
+
+    // if there is still room for more sockets, there are ids enough
+    if (_sockets.size() < _core->sockets()) return false;
+
+    // new queries need a free id on one of the sockets
+    return occupancy() >= _sockets.size() * Identifiers<Handler>::capacity();
+}
+
+/**
+ *  Number of ids that are in flight
+ *  @return size_t
+ */
+size_t Nameserver::occupancy() const
 {
-    // send the message
-    return _udp.send(_ip, query);
+    // result variable
+    size_t result = 0;
+
+    // add up the sockets
+    for (const auto &socket : _sockets) result += socket.ids.size();
+
+    // done
+    return result;
+}
+
+/**
+ *  Send the datagrams that were queued in this iteration
+ */
+void Nameserver::flush()
+{
+    // flush all sockets
+    for (auto &socket : _sockets) socket.udp.flush();
 }
 
 /**
  *  Method that is called when a response is received
+ *  @param  udp         the socket that received it
  *  @param  address     the address of the nameserver from which it is received
  *  @param  buffer      the received response
  *  @param  size        size of the response
  */
-void Nameserver::onReceived(time_t now, const sockaddr *address, const unsigned char *buffer, size_t size)
+void Nameserver::onReceived(Udp *udp, time_t now, const sockaddr *address, const unsigned char *buffer, size_t size)
 {
     // parse the address
     Ip ip(address);
@@ -59,16 +177,59 @@ void Nameserver::onReceived(time_t now, const sockaddr *address, const unsigned
     // ignore messages not from ip
     if (_ip != ip) return;
 
-    // if nobody is interested there is no point in handling the message
-    if (_handlers.empty()) return;
+    // the socket that received it
+    size_t socket = index(udp);
+
+    // ignore messages from sockets that are not ours, and if nobody is interested there is no point in handling the message
+    if (socket == SIZE_MAX || _sockets[socket].ids.size() == 0) return;
 
     // add to the responses
     _responses.emplace_back(address, buffer, size);
+
+    // remember the socket
+    _responses.back().socket(socket);
     
     // let the core that we need to process this queue
     _core->reschedule(now);
 }
 
+/**
+ *  Method that is called when a batch of responses is received
+ *  @param  udp         the socket that received them
+ *  @param  now         the receive-time
+ *  @param  responses   the received responses (the ones that are kept are moved out)
+ */
+void Nameserver::onReceived(Udp *udp, time_t now, std::list<Received> &responses)
+{
+    // the socket that received them
+    size_t socket = index(udp);
+
+    // ignore messages from sockets that are not ours, and if nobody is interested there is no point in handling the messages
+    if (socket == SIZE_MAX || _sockets[socket].ids.size() == 0) return;
+
+    // number of messages that we had
+    size_t before = _responses.size();
+
+    // move the messages from our ip to the responses (the buffers are not copied)
+    for (auto iter = responses.begin(); iter != responses.end(); )
+    {
+        // the message to check, and the next one
+        auto current = iter++;
+
+        // ignore messages not from ip
+        if (current->ip() != _ip) continue;
+
+        // remember the socket
+        current->socket(socket);
+
+        // add to the responses
+        _responses.splice(_responses.end(), responses, current);
+    }
+
+    // let the core know that we need to process this queue
+    if (_responses.size() > before) _core->reschedule(now);
+}
+
 /**
  *  Process queued messages
  *  @param  size_t          max number of calls to userspace
@@ -105,21 +266,11 @@ size_t Nameserver::process(size_t maxcalls)
             // parse the response
             Response response(front.data(), front.size());
         
-            // filter on the response, the beginning is simply the handler at nullptr
-            auto begin = _handlers.lower_bound(std::make_pair(response.id(), nullptr));
-
-            // iterate over those elements, notifying each handler
-            for (auto iter = begin; iter != _handlers.end(); ++iter) 
-            {
-                // if this element is not applicable any more, we're going to leap out (we're done)
-                if (iter->first != response.id()) break;
-
-                // call the onreceived for the element
-                if (iter->second->onReceived(this, response)) result += 1;
-                
-                // the message was processed, we no longer need other handlers
-                break;
-            }
+            // the handler that waits for this id on the socket that received the response
+            auto *handler = _sockets[front.socket()].ids.find(response.id());
+
+            // call the onreceived for the handler
+            if (handler != nullptr && handler->onReceived(this, response)) result += 1;
         }
         catch (const std::runtime_error &error)
         {
@@ -12,12 +12,32 @@
  */
 #include "../include/dnscpp/handler.h"
 #include "../include/dnscpp/operation.h"
+#include "../include/dnscpp/completion.h"
 
 /**
  *  Begin of namespace
  */
 namespace DNS {
 
+/**
+ *  Destructor
+ */
+Operation::~Operation()
+{
+    // let the batch know that one more operation is done
+    if (_completion) _completion->done();
+}
+
+/**
+ *  Make the operation part of a batch
+ *  @param  completion
+ */
+void Operation::track(Completion *completion)
+{
+    // register the operation
+    completion->add(); _completion = completion;
+}
+
 /**
  *  Cancel the operation
  */
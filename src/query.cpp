@@ -15,7 +15,6 @@
 #include <arpa/nameser.h>
 #include <arpa/inet.h>
 #include <stdexcept>
-#include "randombits.h"
 #include "compressor.h"
 #include "../include/dnscpp/type.h"
 #include "../include/dnscpp/question.h"
@@ -44,12 +43,10 @@ Query::Query(int op, const char *dname, int type, const Bits &bits, const unsign
     // make sure buffer is completely filled with zero's
     memset(_buffer, 0, sizeof(_buffer));
     
-    // for simpler access to the header-properties, we use a local variable
+    // for simpler access to the header-properties, we use a local variable (the id stays zero
+    // for now, the nameserver assigns a random id that is free on the socket when it is sent)
     HEADER *header = (HEADER *)_buffer;
 
-    // we need a random id so that it cannot be guessed
-    header->id = RandomBits();
-
     // store the opcode
     header->opcode = op;
     
@@ -193,7 +190,7 @@ bool Query::edns(bool dnssec)
     // this is the same buffer size as libresolv seems to use. Their ratio
     // is that this limits the risk that dgram message get fragmented,
     // which makes the system vulnerable for injection
-    put16(1200);
+    put16(PAYLOAD);
     
     // extended rcode (0 because the normal rcode is good enough) and the 
     // edns version (also 0 because that is the mose up-to-date version)
@@ -229,6 +226,19 @@ uint16_t Query::id() const
     // expose the properties
     return ntohs(header->id);
 }
+
+/**
+ *  Change the ID
+ *  @param  id
+ */
+void Query::id(uint16_t id)
+{
+    // use a local variable to access properties
+    HEADER *header = (HEADER *)_buffer;
+
+    // store the id
+    header->id = htons(id);
+}
     
 /**
  *  The opcode
@@ -0,0 +1,118 @@
+/**
+ *  Random.cpp
+ *
+ *  Implementation file for the Random class
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/random.h"
+#include <sys/random.h>
+#include <sys/time.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Rotate a word to the left
+ *  @param  value       the word
+ *  @param  bits        number of bits
+ *  @return uint32_t
+ */
+static inline uint32_t rotate(uint32_t value, int bits)
+{
+    // rotate the bits
+    return (value << bits) | (value >> (32 - bits));
+}
+
+/**
+ *  The quarter round of the cipher
+ *  @param  x           the working state
+ *  @param  a, b, c, d  the words to mix
+ */
+static inline void quarter(uint32_t *x, int a, int b, int c, int d)
+{
+    // mix the words
+    x[a] += x[b]; x[d] = rotate(x[d] ^ x[a], 16);
+    x[c] += x[d]; x[b] = rotate(x[b] ^ x[c], 12);
+    x[a] += x[b]; x[d] = rotate(x[d] ^ x[a], 8);
+    x[c] += x[d]; x[b] = rotate(x[b] ^ x[c], 7);
+}
+
+/**
+ *  Constructor
+ */
+Random::Random()
+{
+    // the constants of the cipher ("expand 32-byte k")
+    _state[0] = 0x61707865; _state[1] = 0x3320646e; _state[2] = 0x79622d32; _state[3] = 0x6b206574;
+
+    // the key and the nonce come from the operating system
+    uint32_t seed[14];
+
+    // if that fails (which should not happen) we fall back to the time and process id, that is better than nothing
+    if (getrandom(seed, sizeof(seed), 0) != ssize_t(sizeof(seed)))
+    {
+        // get the current time
+        struct timeval tv; gettimeofday(&tv, nullptr);
+
+        // use it for the seed
+        memset(seed, 0, sizeof(seed)); seed[0] = tv.tv_sec; seed[1] = tv.tv_usec; seed[2] = getpid(); seed[3] = uint32_t(uintptr_t(this));
+    }
+
+    // the key (words 4 to 11), and the nonce (words 13 to 15)
+    memcpy(_state + 4, seed, 8 * sizeof(uint32_t));
+    memcpy(_state + 13, seed + 8, 3 * sizeof(uint32_t));
+
+    // the block counter
+    _state[12] = 0;
+}
+
+/**
+ *  Destructor
+ */
+Random::~Random()
+{
+    // wipe the key
+    memset(_state, 0, sizeof(_state)); memset(_block, 0, sizeof(_block));
+}
+
+/**
+ *  Generate the next block of the keystream
+ */
+void Random::refill()
+{
+    // start with the state
+    memcpy(_block, _state, sizeof(_block));
+
+    // the twenty rounds (alternating column and diagonal rounds)
+    for (int i = 0; i < 10; ++i)
+    {
+        // the columns
+        quarter(_block, 0, 4, 8, 12); quarter(_block, 1, 5, 9, 13); quarter(_block, 2, 6, 10, 14); quarter(_block, 3, 7, 11, 15);
+
+        // the diagonals
+        quarter(_block, 0, 5, 10, 15); quarter(_block, 1, 6, 11, 12); quarter(_block, 2, 7, 8, 13); quarter(_block, 3, 4, 9, 14);
+    }
+
+    // add the state
+    for (int i = 0; i < 16; ++i) _block[i] += _state[i];
+
+    // the next block has a different counter (the nonce takes the carry)
+    if (++_state[12] == 0) _state[13] += 1;
+
+    // nothing of the block was used
+    _used = 0;
+}
+
+/**
+ *  End of namespace
+ */
+}
@@ -151,23 +151,25 @@ private:
         // prevent exceptions (parsing the response could fail)
         try
         {
-            // receive data from the socket
-            auto result = _tcp->receive(_buffer + _received, expected());
-            
-            // do nothing if the operation is blocking
-            if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
-            
-            // if there is a failure we leap out
-            if (result <= 0) throw false;
-            
-            // update the number of bytes received
-            _received += result;
-            
-            // after we've received the first two bytes, we can reallocate the buffer so that it is of sufficient size
-            if (_received == 2 && !reallocate()) throw false;
-            
-            // continue waiting if we have not yet received everything there is
-            if (expected() > 0) return;
+            // keep reading until the socket would block (event loops that are edge-triggered do 
+            // not notify us again for data that is already waiting)
+            while (expected() > 0)
+            {
+                // receive data from the socket
+                auto result = _tcp->receive(_buffer + _received, expected());
+                
+                // do nothing if the operation is blocking
+                if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+                
+                // if there is a failure we leap out
+                if (result <= 0) throw false;
+                
+                // update the number of bytes received
+                _received += result;
+                
+                // after we've received the first two bytes, we can reallocate the buffer so that it is of sufficient size
+                if (_received == 2 && !reallocate()) throw false;
+            }
             
             // all data has been received, parse the response, and report to the handler
             _handler->onReceived(this, Response(_buffer + 2, _received - 2));
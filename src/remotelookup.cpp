@@ -12,28 +12,42 @@
  */
 #include "remotelookup.h"
 #include "connection.h"
+#include "follower.h"
 #include "../include/dnscpp/core.h"
 #include "../include/dnscpp/response.h"
 #include "../include/dnscpp/answer.h"
 #include "../include/dnscpp/handler.h"
 #include "../include/dnscpp/question.h"
+#include "../include/dnscpp/completion.h"
 #include "fakeresponse.h"
+#include <string.h>
+#include <ctype.h>
+#include <vector>
 
 /**
  *  Begin of namespace
  */
 namespace DNS {
 
+/**
+ *  Handler that ignores everything, it is installed when a lookup is cancelled
+ *  while other operations still share its result
+ *  @var Handler
+ */
+static DNS::Handler silent;
+
 /**
  *  Constructor
  *  @param  core        dns core object
+ *  @param  key         the key under which the response is cached and shared
  *  @param  domain      the domain of the lookup
  *  @param  type        the type of the request
  *  @param  bits        bits to include
+ *  @param  options     scheduling options
  *  @param  handler     user space object
  */
-RemoteLookup::RemoteLookup(Core *core, const char *domain, ns_type type, const Bits &bits, DNS::Handler *handler) : 
-    Lookup(handler, ns_o_query, domain, type, bits), _core(core), _id(rand()) {}
+RemoteLookup::RemoteLookup(Core *core, const std::string &key, const char *domain, ns_type type, const Bits &bits, const Options &options, DNS::Handler *handler) : 
+    Lookup(core, options, handler, ns_o_query, domain, type, bits), _id(core->random().next()), _key(key) {}
 
 /**
  *  Destructor
@@ -46,6 +60,123 @@ RemoteLookup::~RemoteLookup()
     // but if userspace decided to kill the job (by calling job->cancel()) we still
     // have to do some cleaning ourselves
     cleanup();
+    
+    // followers that were not yet notified (because the core is destructed) go down with us
+    while (!_followers.empty()) { delete _followers.front(); _followers.pop_front(); }
+}
+
+/**
+ *  The key under which identical lookups are shared
+ *  Names are compared case-insensitive, and with or without a trailing dot
+ *  @param  domain      the domain of the lookup
+ *  @param  type        type of records to look for
+ *  @param  bits        the bits to include in the request
+ *  @return std::string
+ */
+std::string RemoteLookup::key(const char *domain, ns_type type, const Bits &bits)
+{
+    // size of the name, without the trailing dot
+    size_t size = strlen(domain);
+    if (size > 0 && domain[size - 1] == '.') size -= 1;
+    
+    // the result variable
+    std::string result; result.reserve(size + 4);
+    
+    // the lowercase name
+    for (size_t i = 0; i < size; ++i) result.push_back(tolower(domain[i]));
+    
+    // a separator that cannot be part of a name, followed by the type and the bits
+    result.push_back('\0');
+    result.push_back(char(type >> 8));
+    result.push_back(char(type));
+    result.push_back(char((bits.AD() ? BIT_AD : 0) | (bits.CD() ? BIT_CD : 0) | (bits.DO() ? BIT_DO : 0)));
+    
+    // done
+    return result;
+}
+
+/**
+ *  The key under which a NXDOMAIN response is cached
+ *  @param  key         the key of the lookup
+ *  @return std::string
+ */
+std::string RemoteLookup::nxdomain(const std::string &key)
+{
+    // copy the key
+    std::string result(key);
+    
+    // the type (the two bytes before the bits) is set to zero
+    result[result.size() - 3] = result[result.size() - 2] = 0;
+    
+    // done
+    return result;
+}
+
+/**
+ *  Make the lookup available to identical lookups that are started later
+ */
+void RemoteLookup::publish()
+{
+    // register in the core (unless an identical lookup was already registered)
+    _published = _core->pending().emplace(_key, this).second;
+}
+
+/**
+ *  Attach an operation for an identical lookup, that shares our result
+ *  @param  domain      the domain of the lookup
+ *  @param  type        type of records to look for
+ *  @param  bits        the bits to include in the request
+ *  @param  handler     user space object interested in the result
+ *  @return Operation
+ *  @throws std::runtime_error
+ */
+Operation *RemoteLookup::follow(const char *domain, ns_type type, const Bits &bits, DNS::Handler *handler)
+{
+    // construct the follower (it gets its own query, and thus its own id)
+    auto *follower = new Follower(this, domain, type, bits, handler);
+    
+    // it is notified when we are
+    _followers.push_back(follower);
+    
+    // expose the operation
+    return follower;
+}
+
+/**
+ *  Detach a follower that was cancelled
+ *  @param  follower
+ */
+void RemoteLookup::detach(Follower *follower)
+{
+    // the follower no longer has to be notified
+    _followers.remove(follower);
+    
+    // if we were only kept alive for the followers, the lookup can stop now
+    if (_followers.empty() && _handler == &silent) finish([](DNS::Handler *handler, const Operation *operation) {});
+}
+
+/**
+ *  Pass a response to a handler
+ *  Operations that share a lookup each have their own query id, the response is
+ *  changed so that it matches the query of the operation to which it is reported
+ *  @param  handler     the handler to notify
+ *  @param  operation   the operation for which the response is reported
+ *  @param  response    the received response
+ */
+void RemoteLookup::received(DNS::Handler *handler, const Operation *operation, const Response &response)
+{
+    // the id of the operation
+    uint16_t id = operation->query().id();
+    
+    // if the ids match the response can be passed on as it is
+    if (response.id() == id) return handler->onReceived(operation, response);
+    
+    // copy the response, the id is stored in network byte order in the first two bytes
+    std::vector<unsigned char> buffer(response.data(), response.data() + response.size());
+    buffer[0] = id >> 8; buffer[1] = id & 0xff;
+    
+    // pass on the copy
+    handler->onReceived(operation, Response(buffer.data(), buffer.size()));
 }
 
 /**
@@ -58,7 +189,33 @@ size_t RemoteLookup::credits() const
     if (_connection) return 0;
     
     // number of attempts left
-    return _core->attempts() > _count ? _core->attempts() - _count : 0;
+    return attempts() > _count ? attempts() - _count : 0;
+}
+
+/**
+ *  Max number of datagrams to send
+ *  @return size_t
+ */
+size_t RemoteLookup::attempts() const
+{
+    // when it is pointless to send more, we stick to what we have sent
+    if (_final) return _count;
+    
+    // the options may override the setting of the context
+    return _options.attempts() > 0 ? _options.attempts() : _core->attempts();
+}
+
+/**
+ *  When does the job expire?
+ *  @return double
+ */
+double RemoteLookup::expires() const
+{
+    // we wait for the timeout after the last datagram (or the start of the tcp connection)
+    double result = _last + _core->timeout();
+    
+    // but never longer than the deadline
+    return _options.deadline() > 0.0 ? std::min(result, _options.deadline()) : result;
 }
 
 /**
@@ -70,13 +227,86 @@ double RemoteLookup::delay(double now) const
 {
     // if the operation is ready, we should run asap (so that it is removed)
     // if the operation never ran it should also run immediately
-    if (_count == 0 || _handler == nullptr) return 0.0;
+    if ((_count == 0 && _held == 0.0) || _handler == nullptr) return 0.0;
+    
+    // if already doing a tcp lookup, or when all attemps have passed, we wait until the expire-time,
+    // otherwise the next datagram is sent after the interval (unless the deadline comes first)
+    double next = _connection || _count >= attempts() ? expires() : _options.deadline() > 0.0 ? std::min(_last + _core->interval(), _options.deadline()) : _last + _core->interval();
+    
+    // a datagram that was held back waits a little longer for room in the window of the nameserver, or for a free id
+    if (!_connection && _count < attempts()) next = std::max(next, _held);
     
-    // if already doing a tcp lookup, or when all attemps have passed, we wait until the expire-time
-    if (_connection || _count >= _core->attempts()) return std::max(0.0, _last + _core->timeout() - now);
+    // userspace may have waited long enough before that (then an expired response can be reported)
+    double patience = this->patience();
+    if (patience > 0.0) next = std::min(next, patience);
     
     // wait until we can send a next datagram
-    return std::max(_last + _core->interval() - now, 0.0);
+    return std::max(next - now, 0.0);
+}
+
+/**
+ *  Find a nameserver by its index
+ *  @param  index       index of the nameserver
+ *  @return Nameserver  the nameserver (or nullptr if there is no such nameserver)
+ */
+Nameserver *RemoteLookup::nameserver(size_t index) const
+{
+    // look it up in the list
+    for (auto &nameserver : _core->nameservers()) if (index-- == 0) return &nameserver;
+    
+    // not found (the nameservers may have been changed in the meantime)
+    return nullptr;
+}
+
+/**
+ *  Give up the slot in the window of the nameserver
+ *  @return Window      the window that held the slot (or nullptr if there was no slot)
+ */
+Window *RemoteLookup::outstanding()
+{
+    // if there is no slot there is nothing to give up
+    if (_slot == SIZE_MAX) return nullptr;
+    
+    // find the nameserver that holds the slot
+    auto *nameserver = this->nameserver(_slot);
+    
+    // we no longer hold a slot
+    _slot = SIZE_MAX;
+    
+    // expose the window
+    return nameserver ? &nameserver->window() : nullptr;
+}
+
+/**
+ *  Try to admit the lookup
+ *  This reserves a slot in the window of the nameserver that is contacted first
+ *  @return bool        was the lookup admitted?
+ */
+bool RemoteLookup::admit()
+{
+    // if the lookup already has a slot, it does not need another one
+    if (_slot != SIZE_MAX) return true;
+    
+    // number of nameservers
+    size_t nscount = _core->nameservers().size();
+    
+    // without nameservers there is nothing to limit (the lookup will time out right away)
+    if (nscount == 0) return true;
+    
+    // the nameserver that is contacted first
+    size_t target = _core->rotate() ? _id % nscount : 0;
+    
+    // access to the window of that nameserver
+    auto &window = nameserver(target)->window();
+    
+    // check if there is room for one more datagram (and if the socket can take it)
+    if (!window.admissible() || nameserver(target)->blocked()) return false;
+    
+    // reserve the slot
+    window.sent(); _slot = target;
+    
+    // the lookup can start
+    return true;
 }
 
 /**
@@ -87,6 +317,10 @@ double RemoteLookup::delay(double now) const
  */
 Handler *RemoteLookup::cleanup()
 {
+    // if the object was already cleaned up (this also happens when the lookup is destructed
+    // after userspace already destructed the core) there is nothing left to do
+    if (_handler == nullptr) return nullptr;
+    
     // remember the old handler
     auto handler = _handler;
     
@@ -96,21 +330,186 @@ Handler *RemoteLookup::cleanup()
     // forget the tcp connection
     _connection.reset();
     
-    // unsubscribe from the nameservers
-    for (auto &nameserver : _core->nameservers()) nameserver.unsubscribe(this, _query.id());
+    // give up the slot in the window of the nameserver
+    if (auto *window = outstanding()) window->release();
+    
+    // index of the nameserver in the next loop
+    size_t index = 0;
+    
+    // unsubscribe from the nameservers that we sent to, and make sure that they do not send our query after we're gone
+    for (auto &nameserver : _core->nameservers()) if (contacted(index++)) { nameserver.unsubscribe(this, _query.id()); nameserver.cancel(_query); }
+    
+    // identical lookups that are started from now on can no longer share our result
+    if (_published) { _core->pending().erase(_key); _published = false; }
+    
+    // the tenant has one lookup less in flight
+    _core->release(this);
     
     // expose the handler
     return handler;
 }
 
+/**
+ *  Cleanup the object and report to userspace (to our own handler and to the followers)
+ *  @param  callback    function that reports to userspace
+ */
+template <typename CALLBACK>
+void RemoteLookup::notify(const CALLBACK &callback)
+{
+    // cleanup and report to userspace (which may destruct the core)
+    callback(cleanup(), this);
+    
+    // the followers get the same result (userspace may cancel followers in the
+    // meantime, so we take them out of the list one by one)
+    while (!_followers.empty())
+    {
+        // take out the first follower
+        auto *follower = _followers.front(); _followers.pop_front();
+        
+        // report to userspace and destruct it
+        follower->report(callback);
+    }
+}
+
+/**
+ *  Finish the lookup: remove it from the core, report to userspace and destruct it
+ *  This is used when the lookup completes outside the regular processing by the core
+ *  (for example because a response came in, or because userspace cancelled it)
+ *  @param  callback    function that reports to userspace
+ */
+template <typename CALLBACK>
+void RemoteLookup::finish(const CALLBACK &callback)
+{
+    // the tcp connection may hold the buffer of the response that we are reporting,
+    // so we keep it alive until userspace has been informed
+    auto connection = std::move(_connection);
+    
+    // the core no longer has to keep track of this lookup
+    _core->remove(this);
+    
+    // cleanup and report to userspace (which may destruct the core)
+    notify(callback);
+    
+    // the lookup is no longer needed
+    delete this;
+}
+
 /** 
  *  Time out the job because no appropriate response was received in time
+ *  @param  now         current time
  *  @return bool        should the lookup be resheduled?
  */
-bool RemoteLookup::timeout()
+bool RemoteLookup::timeout(double now)
 {
+    // the last datagram did not get an answer
+    if (auto *window = outstanding()) window->lost(now, _core->interval());
+
+    // buffer for an expired response
+    std::vector<unsigned char> buffer;
+    
+    // if the cache still holds an expired response, userspace gets that instead of the timeout (RFC 8767)
+    if (waiting() && _core->cache().expired(_key, now, buffer))
+    {
+        // parse the response
+        Response response(buffer.data(), buffer.size());
+        
+        // before we report to userspace we cleanup the object
+        notify([&response](DNS::Handler *handler, const Operation *operation) { received(handler, operation, response); });
+    }
+    
     // before we report to userspace we cleanup the object
-    cleanup()->onTimeout(this);
+    else notify([](DNS::Handler *handler, const Operation *operation) { handler->onTimeout(operation); });
+    
+    // done (we do not have to run again)
+    return false;
+}
+
+/**
+ *  Is anybody still waiting for the result?
+ *  @return bool
+ */
+bool RemoteLookup::waiting() const
+{
+    // the silent handler is installed when nobody but the followers is interested
+    return (_handler != nullptr && _handler != &silent) || !_followers.empty();
+}
+
+/**
+ *  Time at which userspace has waited long enough, and an expired response may be reported
+ *  @return double      the time (or zero if no expired response is going to be reported)
+ */
+double RemoteLookup::patience() const
+{
+    // the timer runs only once, starts when the first datagram is sent, and is only useful when expired responses are kept
+    if (_waited || _count == 0 || _core->cache().retention() == 0.0 || !waiting()) return 0.0;
+    
+    // the timer starts at the first datagram
+    return _started + _core->staletimeout();
+}
+
+/**
+ *  Report an expired response from the cache (RFC 8767), while the lookup keeps running to refresh the cache
+ *  @param  now         current time
+ *  @return bool        should the lookup be rescheduled?
+ */
+bool RemoteLookup::fallback(double now)
+{
+    // the timer expires only once
+    _waited = true;
+    
+    // buffer for the expired response
+    std::vector<unsigned char> buffer;
+    
+    // if there is no expired response, userspace simply has to wait for the nameservers
+    if (!_core->cache().expired(_key, now, buffer)) return true;
+    
+    // parse the response (this does not fail, because the response was parsed when it was stored)
+    Response response(buffer.data(), buffer.size());
+    
+    // from now on the lookup only refreshes the cache (and identical lookups can use the expired response too)
+    _stale = true;
+    
+    // forget the handler, so that the lookup can not be cancelled (or finished) while we call userspace
+    auto *handler = _handler; _handler = nullptr;
+    
+    // as far as the batch is concerned the operation is done
+    auto *completion = _completion; _completion = nullptr;
+    
+    // report to userspace (which may destruct the core, but not this lookup, because the core
+    // does not hold it while it is running, if the core is gone it takes care of us)
+    received(handler, this, response);
+    
+    // the followers get the same response (they are taken out of the list one by one, because userspace may cancel them)
+    while (!_followers.empty())
+    {
+        // take out the first follower
+        auto *follower = _followers.front(); _followers.pop_front();
+        
+        // report to userspace and destruct it
+        follower->report([&response](DNS::Handler *handler, const Operation *operation) { received(handler, operation, response); });
+    }
+    
+    // the lookup continues silently
+    _handler = &silent;
+    
+    // this may call userspace too
+    if (completion) completion->done();
+    
+    // the lookup keeps running to refresh the cache
+    return true;
+}
+
+/** 
+ *  Give up the job because its deadline passed
+ *  @return bool        should the lookup be resheduled?
+ */
+bool RemoteLookup::expire()
+{
+    // the last datagram may still be answered, but we are no longer interested in it
+    if (auto *window = outstanding()) window->release();
+
+    // before we report to userspace we cleanup the object
+    notify([](DNS::Handler *handler, const Operation *operation) { handler->onExpired(operation); });
     
     // done (we do not have to run again)
     return false;
@@ -126,11 +525,18 @@ bool RemoteLookup::execute(double now)
     // if the result has already been reported to user-space, we do not have to do anything
     if (_handler == nullptr) return false;
     
+    // when the caller is no longer interested in the result
+    if (_options.deadline() > 0.0 && now >= _options.deadline()) return expire();
+    
     // when job times out
-    if ((_connection || _count >= _core->attempts()) && now > _last + _core->timeout()) return timeout();
+    if ((_connection || _count >= attempts()) && now > _last + _core->timeout()) return timeout(now);
+    
+    // when userspace waited long enough for the nameservers, it may get an expired response from the cache
+    double patience = this->patience();
+    if (patience > 0.0 && now >= patience) return fallback(now);
 
     // if we reached the max attempts we stop sending out more datagrams, but we keep active
-    if (_count >= _core->attempts()) return true;
+    if (_count >= attempts()) return true;
     
     // if the operation is already using tcp we simply wait for that
     if (_connection) return true;
@@ -140,7 +546,7 @@ bool RemoteLookup::execute(double now)
     size_t nscount = nameservers.size();
     
     // what if there are no nameservers?
-    if (nscount == 0) return timeout();
+    if (nscount == 0) return timeout(now);
 
     // which nameserver should we sent now?
     size_t target = _core->rotate() ? (_count + _id) % nscount : _count % nscount;
@@ -154,12 +560,37 @@ bool RemoteLookup::execute(double now)
         // is this the target nameserver? (we use ++ postfix operator on purpose)
         if (target != i++) continue;
         
-        // send a datagram to this server
-        nameserver.datagram(_query);
+        // a retry that cannot be answered before the deadline is pointless, from now on we only wait
+        if (_count > 0 && _options.deadline() > 0.0 && now + nameserver.window().rtt() > _options.deadline()) { _final = true; return true; }
+        
+        // give up the slot from the previous datagram (that one did not get an answer in time, 
+        // which is a sign of congestion, the very first slot was just reserved when the lookup was admitted)
+        if (auto *window = outstanding()) { if (_count > 0) window->lost(now, _core->interval()); else window->release(); }
+
+        // access to the window of this server
+        auto &window = nameserver.window();
+
+        // when a datagram cannot be sent right now, we try again after about one round trip
+        double hold = now + (window.rtt() > 0.0 ? std::min(window.rtt(), _core->interval()) : _core->interval());
+
+        // a retry must fit in the window too (under loss the windows shrink, and sending anyway
+        // would only add to the congestion), if there is no room we hold it back for a while
+        if (_count > 0 && (!window.admissible() || nameserver.blocked())) { _held = hold; return true; }
+
+        // send a datagram to this server (this also subscribes us to the response, the first datagram
+        // gets an id that is not yet in flight on the socket), a retry keeps its id, and when that id
+        // is in use on every socket of this server we wait until the other lookup is done with it
+        if (!nameserver.datagram(this, _query, _count == 0)) { _held = hold; return true; }
+        
+        // remember that this nameserver has to forget about us when we're done
+        _contacted |= target < 64 ? uint64_t(1) << target : ~uint64_t(0);
         
-        // in the first iteration we have not yet subscribed
-        if (_count < nscount) nameserver.subscribe(this, _query.id());
+        // this datagram takes a slot in the window of the nameserver
+        window.sent(); _slot = target; _held = 0.0;
 
+        // the first message starts the client response timer
+        if (_count == 0) _started = now;
+        
         // one more message has been sent
         _count += 1; _last = now;
         
@@ -182,16 +613,41 @@ void RemoteLookup::report(const Response &response)
     // if the result has already been reported, we do nothing here
     if (_handler == nullptr) return;
     
+    // store the response so that identical lookups can be answered from the cache (responses
+    // without answers are NODATA responses, they go to the cache of negative responses)
+    if (response.rcode() == ns_r_noerror && !response.truncated()) (response.answers() > 0 ? _core->cache() : _core->negativecache()).insert(_key, response, Now());
+    
+    // buffer for an expired response
+    std::vector<unsigned char> buffer;
+    
+    // when the nameserver failed, userspace gets an expired response instead (if the cache still holds one)
+    if ((response.rcode() == ns_r_servfail || response.rcode() == ns_r_refused) && waiting() && _core->cache().expired(_key, Now(), buffer))
+    {
+        // parse the response
+        Response stale(buffer.data(), buffer.size());
+        
+        // report to userspace
+        return finish([&stale](DNS::Handler *handler, const Operation *operation) { received(handler, operation, stale); });
+    }
+    
     // for NXDOMAIN errors we need special treatment (maybe the hostname _does_ exists in 
     // /etc/hosts?) For all other type of results the message can be passed to userspace
-    if (response.rcode() != ns_r_nxdomain) return cleanup()->onReceived(this, response);
+    if (response.rcode() != ns_r_nxdomain) return finish([&response](DNS::Handler *handler, const Operation *operation) { received(handler, operation, response); });
 
     // extract the original question, to find out the host for which we were looking
     Question question(response);
     
     // there was a NXDOMAIN error, which we should not communicate if our /etc/hosts
-    // file does have a record for this hostname, check this
-    if (!_core->exists(question.name())) return cleanup()->onReceived(this, response);
+    // file does have a record for this hostname, check this (the error is cached for
+    // all types, so that we do not have to check again for the next lookup)
+    if (!_core->exists(question.name())) 
+    {
+        // store in the cache of negative responses
+        if (_core->negativecache().enabled()) _core->negativecache().insert(nxdomain(_key), response, Now());
+        
+        // report to userspace
+        return finish([&response](DNS::Handler *handler, const Operation *operation) { received(handler, operation, response); });
+    }
     
     // get the original request (so that the response can match the request)
     Request request(this);
@@ -200,7 +656,7 @@ void RemoteLookup::report(const Response &response)
     FakeResponse fake(request, question);
 
     // send the fake-response to user-space
-    cleanup()->onReceived(this, Response(fake.data(), fake.size()));
+    finish([&fake](DNS::Handler *handler, const Operation *operation) { received(handler, operation, Response(fake.data(), fake.size())); });
 }
 
 /**
@@ -218,11 +674,15 @@ bool RemoteLookup::onReceived(Nameserver *nameserver, const Response &response)
     // if we're already busy with a tcp connection we ignore further dgram responses
     if (_connection) return false;
     
+    // the datagram is answered, which lets the window grow (but only if it was answered by
+    // the nameserver to which the last datagram was sent, a late answer tells us nothing)
+    if (auto *window = outstanding()) { if (window == &nameserver->window()) window->acknowledge(Now() - _last); else window->release(); }
+    
     // if the response was not truncated, we can report it to userspace
     if (!response.truncated()) { report(response); return true; }
 
     // switch to tcp mode to retry the query to get a non-truncated response
-    _connection.reset(new Connection(_core->loop(), nameserver->ip(), _query, response, this));
+    _connection.reset(new Connection(_core->loop(), nameserver->ip(), nameserver->port(), _query, response, this));
     
     // remember the start-time of the connection to reset the timeout-period
     _last = Now();
@@ -260,7 +720,7 @@ void RemoteLookup::onFailure(Connection *connection, const Response &truncated)
     if (_handler == nullptr) return;
     
     // we failed to get the regular response, so we send back the truncated response
-    cleanup()->onReceived(this, truncated);
+    finish([&truncated](DNS::Handler *handler, const Operation *operation) { received(handler, operation, truncated); });
 }
 
 /**
@@ -269,10 +729,22 @@ void RemoteLookup::onFailure(Connection *connection, const Response &truncated)
 void RemoteLookup::cancel()
 {
     // do nothing if already cancelled
-    if (_handler == nullptr) return;
+    if (_handler == nullptr || _handler == &silent) return;
+    
+    // cleanup, report to userspace and destruct (there is nobody else to notify)
+    if (_followers.empty()) return finish([](DNS::Handler *handler, const Operation *operation) { handler->onCancelled(operation); });
+    
+    // other operations share our result, so we keep running (but silently)
+    auto *handler = _handler; _handler = &silent;
+    
+    // as far as the batch is concerned the operation is done
+    auto *completion = _completion; _completion = nullptr;
+    
+    // report it back to user-space
+    handler->onCancelled(this);
     
-    // cleanup, and remove to userspace
-    cleanup()->onCancelled(this);
+    // this may call userspace too
+    if (completion) completion->done();
 }
 
 /**
@@ -16,6 +16,9 @@
  *  Dependencies
  */
 #include <memory>
+#include <string>
+#include <list>
+#include <stdint.h>
 #include "../include/dnscpp/nameserver.h"
 #include "../include/dnscpp/timer.h"
 #include "../include/dnscpp/query.h"
@@ -35,6 +38,7 @@ namespace DNS {
  */
 class Core;
 class Handler;
+class Follower;
 
 /**
  *  Class definition
@@ -42,12 +46,6 @@ class Handler;
 class RemoteLookup : public Lookup, private Nameserver::Handler, private Connection::Handler
 {
 private:
-    /**
-     *  Pointer to the core of the DNS library
-     *  @var Core
-     */
-    Core *_core;
-
     /**
      *  When was the last time that the job ran?
      *  @var double
@@ -60,6 +58,18 @@ private:
      */
     size_t _count = 0;
     
+    /**
+     *  Time until which a datagram is held back, because the window of the nameserver was full, or its id was in use
+     *  @var double
+     */
+    double _held = 0.0;
+    
+    /**
+     *  When was the first message sent?
+     *  @var double
+     */
+    double _started = 0.0;
+    
     /**
      *  Random ID (mainly used to decide which nameserver to use first)
      *  @var size_t
@@ -71,6 +81,81 @@ private:
      *  @var Connection
      */
     std::unique_ptr<Connection> _connection;
+    
+    /**
+     *  Index of the nameserver whose window holds a slot for this lookup (or SIZE_MAX if there is none)
+     *  @var size_t
+     */
+    size_t _slot = SIZE_MAX;
+    
+    /**
+     *  The nameservers to which a datagram was sent, one bit per index (all bits are set
+     *  when the index does not fit, then we assume that all nameservers were contacted)
+     *  @var uint64_t
+     */
+    uint64_t _contacted = 0;
+    
+    /**
+     *  Is it pointless to send more datagrams (because they cannot be answered before the deadline)?
+     *  @var bool
+     */
+    bool _final = false;
+    
+    /**
+     *  The key under which the response is cached, and under which identical lookups can find us
+     *  @var std::string
+     */
+    const std::string _key;
+    
+    /**
+     *  Can identical lookups find us?
+     *  @var bool
+     */
+    bool _published = false;
+    
+    /**
+     *  Operations for identical lookups that share our result
+     *  @var std::list<Follower*>
+     */
+    std::list<Follower*> _followers;
+    
+    /**
+     *  Did the client response timer already expire? (then we no longer check for an expired response)
+     *  @var bool
+     */
+    bool _waited = false;
+    
+    /**
+     *  Was an expired response reported? (then the lookup only refreshes the cache)
+     *  @var bool
+     */
+    bool _stale = false;
+
+    /**
+     *  Was a datagram sent to a certain nameserver?
+     *  @param  index       index of the nameserver
+     *  @return bool
+     */
+    bool contacted(size_t index) const { return index < 64 ? (_contacted >> index) & 1 : _contacted == ~uint64_t(0); }
+
+    /**
+     *  Max number of datagrams to send
+     *  @return size_t
+     */
+    size_t attempts() const;
+
+    /**
+     *  Find a nameserver by its index
+     *  @param  index       index of the nameserver
+     *  @return Nameserver  the nameserver (or nullptr if there is no such nameserver)
+     */
+    Nameserver *nameserver(size_t index) const;
+
+    /**
+     *  Give up the slot in the window of the nameserver (the caller registers what happened to it)
+     *  @return Window      the window that held the slot (or nullptr if there was no slot)
+     */
+    Window *outstanding();
 
     /**
      *  Method that is called when a dgram response is received
@@ -101,16 +186,42 @@ private:
     virtual bool execute(double now) override;
 
     /**
-     *  When does the job expire?
+     *  When does the job expire? (only meaningful when no more datagrams are sent)
      *  @return double
      */
     double expires() const;
 
+    /** 
+     *  Give up the job because its deadline passed
+     *  @return bool
+     */
+    bool expire();
+
     /** 
      *  Time out the job because no appropriate response was received in time
+     *  @param  now     current time
      *  @return bool
      */
-    bool timeout();
+    bool timeout(double now);
+
+    /**
+     *  Is anybody still waiting for the result? (our own handler or one of the followers)
+     *  @return bool
+     */
+    bool waiting() const;
+
+    /**
+     *  Time at which userspace has waited long enough, and an expired response may be reported
+     *  @return double      the time (or zero if no expired response is going to be reported)
+     */
+    double patience() const;
+
+    /**
+     *  Report an expired response from the cache, while the lookup keeps running to refresh the cache
+     *  @param  now     current time
+     *  @return bool    should the lookup be rescheduled?
+     */
+    bool fallback(double now);
 
     /**
      *  Wait for internal buffers to catch up (dns-cpp uses an internal buffer
@@ -145,12 +256,40 @@ private:
      */
     DNS::Handler *cleanup();
 
+    /**
+     *  Cleanup the object and report to userspace (to our own handler and to the followers)
+     *  @param  callback    function that reports to userspace
+     */
+    template <typename CALLBACK>
+    void notify(const CALLBACK &callback);
+
+    /**
+     *  Finish the lookup: remove it from the core, report to userspace and destruct it
+     *  @param  callback    function that reports to userspace
+     */
+    template <typename CALLBACK>
+    void finish(const CALLBACK &callback);
+
+    /**
+     *  Pass a response to a handler (the ID is changed if it does not match the query of the operation)
+     *  @param  handler     the handler to notify
+     *  @param  operation   the operation for which the response is reported
+     *  @param  response    the received response
+     */
+    static void received(DNS::Handler *handler, const Operation *operation, const Response &response);
+
     /**
      *  How many credits are left (meaning: how many datagrams do we still have to send?)
      *  @return size_t      number of attempts
      */
     virtual size_t credits() const override;
 
+    /**
+     *  Try to admit the lookup
+     *  @return bool        was the lookup admitted?
+     */
+    virtual bool admit() override;
+
     /**
      *  Cancel the operation
      */
@@ -160,12 +299,14 @@ public:
     /**
      *  Constructor
      *  @param  core        dns core object
+     *  @param  key         the key under which the response is cached and shared
      *  @param  domain      the domain of the lookup
      *  @param  type        type of records to look for
      *  @param  bits        the bits to include in the request
+     *  @param  options     scheduling options
      *  @param  handler     user space object interested in the result
      */
-    RemoteLookup(Core *core, const char *domain, ns_type type, const Bits &bits, DNS::Handler *handler);
+    RemoteLookup(Core *core, const std::string &key, const char *domain, ns_type type, const Bits &bits, const Options &options, DNS::Handler *handler);
     
     /**
      *  No copying
@@ -178,6 +319,49 @@ public:
      */
     virtual ~RemoteLookup();
 
+    /**
+     *  The key under which identical lookups are shared
+     *  @param  domain      the domain of the lookup
+     *  @param  type        type of records to look for
+     *  @param  bits        the bits to include in the request
+     *  @return std::string
+     */
+    static std::string key(const char *domain, ns_type type, const Bits &bits);
+
+    /**
+     *  The key under which a NXDOMAIN response is cached (it applies to all types)
+     *  @param  key         the key of the lookup
+     *  @return std::string
+     */
+    static std::string nxdomain(const std::string &key);
+
+    /**
+     *  Make the lookup available to identical lookups that are started later
+     */
+    void publish();
+
+    /**
+     *  Attach an operation for an identical lookup, that shares our result
+     *  @param  domain      the domain of the lookup
+     *  @param  type        type of records to look for
+     *  @param  bits        the bits to include in the request
+     *  @param  handler     user space object interested in the result
+     *  @return Operation
+     *  @throws std::runtime_error
+     */
+    Operation *follow(const char *domain, ns_type type, const Bits &bits, DNS::Handler *handler);
+
+    /**
+     *  Detach a follower that was cancelled
+     *  @param  follower
+     */
+    void detach(Follower *follower);
+    
+    /**
+     *  Did the lookup already report an expired response? (identical lookups can then do the same)
+     *  @return bool
+     */
+    bool stale() const { return _stale; }
 };
 
 /**
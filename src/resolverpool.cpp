@@ -0,0 +1,91 @@
+/**
+ *  ResolverPool.cpp
+ *
+ *  Implementation file for the ResolverPool class
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/resolverpool.h"
+#include "worker.h"
+#include <ctype.h>
+#include <string.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Constructor
+ *  @param  loop        the event loop of the calling thread
+ *  @param  threads     number of worker threads
+ *  @param  defaults    should the contexts load the system settings?
+ *  @param  setup       function that is called in each worker thread to configure its context
+ *  @param  pin         should the worker threads be bound to a cpu each?
+ *  @throws std::runtime_error
+ */
+ResolverPool::ResolverPool(Loop *loop, size_t threads, bool defaults, const std::function<void(Context *)> &setup, bool pin)
+{
+    // number of cpus to spread the threads over
+    size_t cpus = std::max(std::thread::hardware_concurrency(), 1u);
+
+    // starting the workers can fail
+    try
+    {
+        // start the workers (they create their contexts in parallel)
+        for (size_t i = 0; i < std::max(threads, size_t(1)); ++i) _workers.emplace_back(new Worker(i, defaults, setup, pin ? int(i % cpus) : -1));
+
+        // wait until all of them are ready (this throws if a context could not be created or configured)
+        for (auto &worker : _workers) worker->wait();
+    }
+    catch (...)
+    {
+        // stop the workers that did start (this waits for the threads), and pass on the error
+        _workers.clear(); throw;
+    }
+
+    // the channel through which the owning thread submits queries
+    _channel.reset(new Channel(this, loop));
+}
+
+/**
+ *  Destructor
+ */
+ResolverPool::~ResolverPool()
+{
+    // the operations of the owning thread that are still in progress are cancelled (their handlers are notified)
+    _channel.reset();
+
+    // stop the workers (this waits for the threads)
+    _workers.clear();
+}
+
+/**
+ *  The worker that handles a certain domain
+ *  Names are compared case-insensitive, and with or without a trailing dot
+ *  @param  domain      the domain
+ *  @return Worker
+ */
+Worker *ResolverPool::route(const char *domain) const
+{
+    // size of the name, without the trailing dot
+    size_t size = strlen(domain);
+    if (size > 0 && domain[size - 1] == '.') size -= 1;
+
+    // fnv-1a hash of the lowercase name
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) hash = (hash ^ (unsigned char)tolower(domain[i])) * 1099511628211ULL;
+
+    // find the worker
+    return _workers[hash % _workers.size()].get();
+}
+
+/**
+ *  End of namespace
+ */
+}
+
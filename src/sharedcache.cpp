@@ -0,0 +1,760 @@
+/**
+ *  SharedCache.cpp
+ *
+ *  Implementation file for the SharedCache class
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/sharedcache.h"
+#include "../include/dnscpp/response.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <iterator>
+#include <functional>
+#include <new>
+#include <stdlib.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  The marker that is left behind in the hash table when an entry is removed
+ *  @var Entry
+ */
+SharedCache::Entry SharedCache::_removed;
+
+/**
+ *  Constructor of a reader
+ *  The reader registers itself in the counter of the current generation. If the
+ *  writer started a new generation in the meantime, it tries again, so that the
+ *  writer never misses a reader that could still see what it removed
+ *  @param  shard       the shard to read
+ */
+SharedCache::Reader::Reader(Shard &shard) : _shard(shard)
+{
+    // keep trying until the generation did not change while we registered
+    while (true)
+    {
+        // the current generation
+        size_t generation = shard.generation.load();
+
+        // register in its counter
+        _parity = generation & 1; shard.readers[_parity].fetch_add(1);
+
+        // check if the generation is still the same
+        if (shard.generation.load() == generation) return;
+
+        // try again
+        shard.readers[_parity].fetch_sub(1);
+    }
+}
+
+/**
+ *  Allocate objects that are aligned to cache lines
+ *  @param  count       number of objects
+ *  @return TYPE        the constructed objects
+ *  @throws std::bad_alloc
+ */
+template <typename TYPE>
+static TYPE *allocate(size_t count)
+{
+    // the memory (operator new does not respect the alignment of the type before C++17)
+    void *memory = nullptr;
+    if (posix_memalign(&memory, alignof(TYPE), count * sizeof(TYPE)) != 0) throw std::bad_alloc();
+
+    // construct the objects
+    for (size_t i = 0; i < count; ++i) new ((TYPE *)memory + i) TYPE();
+
+    // expose the objects
+    return (TYPE *)memory;
+}
+
+/**
+ *  Destruct and deallocate objects that were allocated with allocate()
+ *  @param  objects     the objects
+ *  @param  count       number of objects
+ */
+template <typename TYPE>
+static void deallocate(TYPE *objects, size_t count)
+{
+    // destruct the objects
+    for (size_t i = 0; i < count; ++i) objects[i].~TYPE();
+
+    // release the memory
+    free(objects);
+}
+
+/**
+ *  Constructor
+ *  @param  capacity    max number of bytes to use (zero to disable the cache)
+ *  @param  shards      number of shards
+ */
+SharedCache::SharedCache(size_t capacity, size_t shards) :
+    _shards(allocate<Shard>(std::max(shards, size_t(1)))), _count(std::max(shards, size_t(1))), _statistics(nullptr), _total(0), _keep(0.0)
+{
+    // the statistics can not be allocated in the initializer list, because the shards would leak if that fails
+    try { _statistics = allocate<Statistics>(STRIPES); } catch (...) { deallocate(_shards, _count); throw; }
+
+    // divide the capacity over the shards
+    this->capacity(capacity);
+}
+
+/**
+ *  Destructor
+ */
+SharedCache::~SharedCache()
+{
+    // deallocate the shards and the statistics
+    deallocate(_shards, _count); deallocate(_statistics, STRIPES);
+}
+
+/**
+ *  The stripe with statistics of the calling thread
+ *  @return Statistics
+ */
+SharedCache::Statistics &SharedCache::statistics() const
+{
+    // the number of threads that looked up something so far
+    static std::atomic<size_t> threads(0);
+
+    // every thread gets the next stripe (when there are more threads than stripes, some of them share one)
+    static thread_local size_t stripe = threads.fetch_add(1, std::memory_order_relaxed) % STRIPES;
+
+    // expose the stripe
+    return _statistics[stripe];
+}
+
+/**
+ *  Find the shard that holds a key
+ *  Only the name is hashed (and not the type and bits at the end of the key), so
+ *  that the responses for the same name, including the NXDOMAIN response that
+ *  applies to all types, end up in the same shard
+ *  @param  key         the key
+ *  @return Shard
+ */
+SharedCache::Shard &SharedCache::shard(const std::string &key) const
+{
+    // the name is followed by a separator, two bytes for the type and one byte for the bits
+    size_t size = key.size() > 4 ? key.size() - 4 : 0;
+
+    // fnv-1a hash of the name
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) hash = (hash ^ (unsigned char)key[i]) * 1099511628211ULL;
+
+    // find the shard
+    return _shards[hash % _count];
+}
+
+/**
+ *  Find an entry in the hash table
+ *  @param  shard       the shard
+ *  @param  key         the key to look for
+ *  @param  hash        hash of the key
+ *  @return Entry       the entry (or nullptr if there is no such entry)
+ */
+SharedCache::Entry *SharedCache::find(Shard &shard, const std::string &key, size_t hash)
+{
+    // the current table
+    Table *table = shard.table.load(std::memory_order_acquire);
+
+    // the table is created when the first entry is stored
+    if (table == nullptr) return nullptr;
+
+    // follow the probe sequence (there is always an empty slot, because the table is at most half full)
+    for (size_t i = hash & table->mask; ; i = (i + 1) & table->mask)
+    {
+        // the entry in this slot
+        Entry *entry = table->slots[i].load(std::memory_order_acquire);
+
+        // an empty slot ends the sequence
+        if (entry == nullptr) return nullptr;
+
+        // check if this is the entry that we are looking for
+        if (entry != &_removed && entry->hash == hash && entry->key == key) return entry;
+    }
+}
+
+/**
+ *  Find an entry that has not yet expired, and copy its response
+ *  @param  shard       the shard
+ *  @param  key         the key to look for
+ *  @param  now         current time
+ *  @param  result      buffer that is filled with the response
+ *  @return Entry       the entry (or nullptr if there is no such entry)
+ */
+SharedCache::Entry *SharedCache::copy(Shard &shard, const std::string &key, double now, std::vector<unsigned char> &result)
+{
+    // find the entry
+    auto *entry = find(shard, key, std::hash<std::string>()(key));
+
+    // expired entries are no longer used (the writer removes them)
+    if (entry == nullptr || entry->expires <= now) return nullptr;
+
+    // the entry is used once more (it does not matter if an update by another reader is lost)
+    uint8_t frequency = entry->frequency.load(std::memory_order_relaxed);
+    if (frequency < 3) entry->frequency.store(frequency + 1, std::memory_order_relaxed);
+
+    // copy the response with decremented ttls
+    Cache::expose(entry->data, entry->ttls, entry->limit, Cache::age(entry->stored, now), result);
+
+    // expose the entry
+    return entry;
+}
+
+/**
+ *  Publish an entry in the hash table
+ *  @param  shard       the shard
+ *  @param  entry       the entry to publish
+ */
+void SharedCache::publish(Shard &shard, Entry *entry)
+{
+    // the current table
+    Table *table = shard.table.load(std::memory_order_relaxed);
+
+    // the table should stay at most half full, so that the readers always find an empty slot
+    if (table == nullptr || (table->used + 1) * 2 > table->mask + 1)
+    {
+        // a table for four times the number of entries (the entry itself is already in the queue)
+        size_t count = shard.smallqueue.size() + shard.mainqueue.size(), size = 16;
+        while (size < count * 4) size *= 2;
+
+        // the new table
+        Table *bigger = new Table(size);
+
+        // copy the entries (but not the tombstones)
+        for (size_t i = 0; table != nullptr && i <= table->mask; ++i)
+        {
+            // the entry in this slot
+            Entry *current = table->slots[i].load(std::memory_order_relaxed);
+
+            // copy it
+            if (current != nullptr && current != &_removed) bigger->place(current);
+        }
+
+        // readers use the new table from now on
+        shard.table.store(bigger, std::memory_order_release);
+
+        // the old table can be deallocated when the readers are done with it
+        if (table) shard.tables[shard.generation.load(std::memory_order_relaxed) & 1].emplace_back(table);
+
+        // use the new table
+        table = bigger;
+    }
+
+    // store the entry
+    table->place(entry);
+}
+
+/**
+ *  Remove an entry from the hash table and the queues
+ *  @param  shard       the shard
+ *  @param  entry       the entry to remove
+ */
+void SharedCache::erase(Shard &shard, Entry *entry)
+{
+    // the slot that holds the entry (there is none when it was just replaced)
+    auto *slot = shard.table.load(std::memory_order_relaxed)->locate(entry);
+
+    // leave a tombstone behind
+    if (slot) slot->store(&_removed, std::memory_order_release);
+
+    // size of the entry
+    size_t bytes = entry->bytes();
+
+    // update the bookkeeping
+    shard.bytes -= bytes; if (!entry->main) shard.small -= bytes;
+
+    // remove it from its queue
+    (entry->main ? shard.mainqueue : shard.smallqueue).erase(entry->position);
+
+    // the entry can be deallocated when the readers are done with it
+    shard.entries[shard.generation.load(std::memory_order_relaxed) & 1].emplace_back(entry);
+}
+
+/**
+ *  Remember the key of an entry that is evicted from the small queue
+ *  @param  shard       the shard
+ *  @param  key         the key
+ */
+void SharedCache::haunt(Shard &shard, const std::string &key)
+{
+    // add to the front of the ghost queue
+    shard.ghostqueue.push_front(key); shard.ghosts[key] = shard.ghostqueue.begin();
+
+    // we remember at most as many keys as there are entries in the shard
+    while (shard.ghostqueue.size() > std::max(shard.smallqueue.size() + shard.mainqueue.size(), size_t(1)))
+    {
+        // forget the oldest ghost
+        shard.ghosts.erase(shard.ghostqueue.back()); shard.ghostqueue.pop_back();
+    }
+}
+
+/**
+ *  Evict entries until the shard fits in its capacity
+ *  @param  shard       the shard
+ */
+void SharedCache::shrink(Shard &shard)
+{
+    // keep evicting while the shard is too big
+    while (shard.bytes > shard.capacity)
+    {
+        // entries are evicted from the small queue when it is bigger than its share (or when there is nothing else)
+        if (!shard.smallqueue.empty() && (shard.small * 100 > shard.capacity * Cache::SMALL || shard.mainqueue.empty()))
+        {
+            // the oldest entry of the small queue
+            auto *entry = shard.smallqueue.back();
+
+            // if the entry was used again, it is promoted to the main queue
+            if (entry->frequency.load(std::memory_order_relaxed) > 0)
+            {
+                // the entry is no longer part of the small queue
+                shard.small -= entry->bytes(); entry->main = true; entry->frequency.store(0, std::memory_order_relaxed);
+
+                // move it to the front of the main queue
+                shard.mainqueue.splice(shard.mainqueue.begin(), shard.smallqueue, entry->position);
+            }
+            else
+            {
+                // the entry is evicted, but we remember that it was there
+                haunt(shard, entry->key); erase(shard, entry);
+            }
+        }
+        else
+        {
+            // the oldest entry of the main queue
+            auto *entry = shard.mainqueue.back();
+
+            // the number of times it was used
+            uint8_t frequency = entry->frequency.load(std::memory_order_relaxed);
+
+            // entries that were used get another round (but with a lower frequency)
+            if (frequency > 0) { entry->frequency.store(frequency - 1, std::memory_order_relaxed); shard.mainqueue.splice(shard.mainqueue.begin(), shard.mainqueue, entry->position); }
+
+            // others are evicted
+            else erase(shard, entry);
+        }
+    }
+}
+
+/**
+ *  Remove the entries at the back of the queues that expired too long ago
+ *  @param  shard       the shard
+ *  @param  now         current time
+ */
+void SharedCache::reap(Shard &shard, double now)
+{
+    // number of seconds that expired responses are kept
+    double retention = _keep.load(std::memory_order_relaxed);
+
+    // check both queues
+    for (auto *queue : { &shard.smallqueue, &shard.mainqueue })
+    {
+        // remove the oldest entries for as long as they are no longer of use
+        while (!queue->empty() && queue->back()->expires + retention <= now) erase(shard, queue->back());
+    }
+}
+
+/**
+ *  Deallocate the entries and tables that can no longer be read
+ *  The entries that were removed in generation N can only be seen by readers
+ *  that registered in generation N or earlier. A new generation is only started
+ *  when no readers of the previous generation are left, so when generation N+2
+ *  starts, all readers that could see the entries removed in N are gone
+ *  @param  shard       the shard
+ */
+void SharedCache::reclaim(Shard &shard)
+{
+    // the current generation
+    size_t generation = shard.generation.load(std::memory_order_relaxed);
+
+    // the counter of the previous generation (which is also the counter of the next generation)
+    size_t parity = (generation + 1) & 1;
+
+    // there are still readers of the previous generation
+    if (shard.readers[parity].load() > 0) return;
+
+    // the entries and tables that were removed two generations ago can no longer be read
+    shard.entries[parity].clear(); shard.tables[parity].clear();
+
+    // start the next generation
+    shard.generation.store(generation + 1);
+}
+
+/**
+ *  Store an entry, in the back of its queue
+ *  @param  shard       the shard
+ *  @param  entry       the entry to store
+ *  @return bool        was the entry stored?
+ */
+bool SharedCache::restore(Shard &shard, std::unique_ptr<Entry> entry)
+{
+    // entries that are already in the cache are newer
+    if (find(shard, entry->key, entry->hash) != nullptr) return false;
+
+    // entries that do not fit are skipped
+    size_t bytes = entry->bytes(); if (shard.bytes + bytes > shard.capacity) return false;
+
+    // the queue in which it should be stored
+    auto &queue = entry->main ? shard.mainqueue : shard.smallqueue;
+
+    // update the bookkeeping
+    shard.bytes += bytes; if (!entry->main) shard.small += bytes;
+
+    // store the entry at the back of its queue
+    queue.push_back(entry.get()); entry->position = std::prev(queue.end());
+
+    // publish it to the readers
+    publish(shard, entry.release());
+
+    // the entry was stored
+    return true;
+}
+
+/**
+ *  Change the max number of bytes to use
+ *  @param  value       the new capacity (zero to disable the cache)
+ */
+void SharedCache::capacity(size_t value)
+{
+    // remember the total
+    _total = value;
+
+    // every shard gets an equal part
+    for (size_t i = 0; i < _count; ++i)
+    {
+        // lock the shard
+        std::lock_guard<std::mutex> lock(_shards[i].mutex);
+
+        // update its capacity, and evict what no longer fits
+        _shards[i].capacity = value / _count; shrink(_shards[i]); reclaim(_shards[i]);
+    }
+}
+
+/**
+ *  Number of lookups that were answered from the cache
+ *  @return size_t
+ */
+size_t SharedCache::hits() const
+{
+    // the result variable
+    size_t result = 0;
+
+    // add up the counters of all stripes
+    for (size_t i = 0; i < STRIPES; ++i) result += _statistics[i].hits.load(std::memory_order_relaxed);
+
+    // done
+    return result;
+}
+
+/**
+ *  Number of lookups that could not be answered from the cache
+ *  @return size_t
+ */
+size_t SharedCache::misses() const
+{
+    // the result variable
+    size_t result = 0;
+
+    // add up the counters of all stripes
+    for (size_t i = 0; i < STRIPES; ++i) result += _statistics[i].misses.load(std::memory_order_relaxed);
+
+    // done
+    return result;
+}
+
+/**
+ *  Number of lookups that were answered with an expired response
+ *  @return size_t
+ */
+size_t SharedCache::stale() const
+{
+    // the result variable
+    size_t result = 0;
+
+    // add up the counters of all stripes
+    for (size_t i = 0; i < STRIPES; ++i) result += _statistics[i].stale.load(std::memory_order_relaxed);
+
+    // done
+    return result;
+}
+
+/**
+ *  Store a response
+ *  @param  key         the key under which it is stored
+ *  @param  response    the response to store
+ *  @param  now         current time
+ *  @return bool        was the response stored?
+ */
+bool SharedCache::insert(const std::string &key, const Response &response, double now)
+{
+    // nothing is stored when the cache is disabled
+    if (!enabled()) return false;
+
+    // the new entry (it is prepared before the lock is taken)
+    std::unique_ptr<Entry> entry(new Entry());
+
+    // find the ttls (responses without a ttl should not be cached)
+    uint32_t ttl = Cache::parse(response, entry->ttls); if (ttl == 0) return false;
+
+    // fill the entry
+    entry->key = key;
+    entry->hash = std::hash<std::string>()(key);
+    entry->data.assign(response.data(), response.data() + response.size());
+    entry->stored = now;
+    entry->expires = now + ttl;
+    if (response.answers() == 0) entry->limit = ttl;
+
+    // find the shard
+    auto &shard = this->shard(key);
+
+    // lock it
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // entries that would not even fit in an empty shard are not stored
+    if (entry->bytes() > shard.capacity) return false;
+
+    // if the key is already in the cache, the old entry is replaced (but it keeps its place)
+    auto *found = find(shard, key, entry->hash);
+    if (found) { entry->main = found->main; entry->frequency.store(found->frequency.load(std::memory_order_relaxed), std::memory_order_relaxed); }
+
+    // if the key was evicted from the small queue recently, it goes straight to the main queue
+    auto ghost = shard.ghosts.find(key);
+    if (ghost != shard.ghosts.end()) { entry->main = true; shard.ghostqueue.erase(ghost->second); shard.ghosts.erase(ghost); }
+
+    // the old entry is swapped for the new one in the hash table, so that readers always find one of them
+    if (found) { shard.table.load(std::memory_order_relaxed)->locate(found)->store(entry.get(), std::memory_order_release); erase(shard, found); }
+
+    // size of the entry, and the queue in which it should be stored
+    size_t bytes = entry->bytes();
+    auto &queue = entry->main ? shard.mainqueue : shard.smallqueue;
+
+    // update the bookkeeping
+    shard.bytes += bytes; if (!entry->main) shard.small += bytes;
+
+    // store the entry
+    queue.push_front(entry.get()); entry->position = queue.begin();
+
+    // publish it to the readers (unless it took the place of the old entry)
+    if (found) entry.release(); else publish(shard, entry.release());
+
+    // remove what expired, make sure that the shard fits in its capacity, and deallocate what can no longer be read
+    reap(shard, now); shrink(shard); reclaim(shard);
+
+    // done
+    return true;
+}
+
+/**
+ *  Look up a response
+ *  @param  key         the key to look for
+ *  @param  now         current time
+ *  @param  result      buffer that is filled with the response
+ *  @param  remaining   optional variable that is filled with the part of the TTL that is left
+ *  @return bool        was the response found?
+ */
+bool SharedCache::lookup(const std::string &key, double now, std::vector<unsigned char> &result, double *remaining)
+{
+    // nothing is found when the cache is disabled
+    if (!enabled()) return false;
+
+    // find the shard
+    auto &shard = this->shard(key);
+
+    // register as reader, so that the entries are not deallocated while we copy them
+    Reader reader(shard);
+
+    // find the entry and copy it
+    auto *entry = copy(shard, key, now, result);
+
+    // the response is not in the cache
+    if (entry == nullptr) { statistics().misses.fetch_add(1, std::memory_order_relaxed); return false; }
+
+    // one more hit
+    statistics().hits.fetch_add(1, std::memory_order_relaxed);
+
+    // the caller may want to know how long the response remains valid (another thread may have stored it after our "now")
+    if (remaining) *remaining = std::min((entry->expires - now) / (entry->expires - entry->stored), 1.0);
+
+    // done
+    return true;
+}
+
+/**
+ *  Look up a response that can be stored under two keys
+ *  @param  key         the key to look for first
+ *  @param  fallback    the key to look for next (for the same name)
+ *  @param  now         current time
+ *  @param  result      buffer that is filled with the response
+ *  @return bool        was the response found?
+ */
+bool SharedCache::lookup(const std::string &key, const std::string &fallback, double now, std::vector<unsigned char> &result)
+{
+    // nothing is found when the cache is disabled
+    if (!enabled()) return false;
+
+    // find the shard (both keys are for the same name, so they are in the same shard)
+    auto &shard = this->shard(key);
+
+    // register as reader, so that the entries are not deallocated while we copy them
+    Reader reader(shard);
+
+    // the response is not in the cache under either key
+    if (copy(shard, key, now, result) == nullptr && copy(shard, fallback, now, result) == nullptr) { statistics().misses.fetch_add(1, std::memory_order_relaxed); return false; }
+
+    // one more hit
+    statistics().hits.fetch_add(1, std::memory_order_relaxed);
+
+    // done
+    return true;
+}
+
+/**
+ *  Look up a response that has expired, but that is still retained
+ *  @param  key         the key to look for
+ *  @param  now         current time
+ *  @param  result      buffer that is filled with the response
+ *  @return bool        was an expired response found?
+ */
+bool SharedCache::expired(const std::string &key, double now, std::vector<unsigned char> &result)
+{
+    // number of seconds that expired responses are kept
+    double retention = _keep.load(std::memory_order_relaxed);
+
+    // nothing is found when the cache is disabled or when expired responses are not kept
+    if (!enabled() || retention == 0.0) return false;
+
+    // find the shard
+    auto &shard = this->shard(key);
+
+    // register as reader, so that the entries are not deallocated while we copy them
+    Reader reader(shard);
+
+    // find the entry
+    auto *entry = find(shard, key, std::hash<std::string>()(key));
+
+    // the response is not in the cache, it has not yet expired, or it expired too long ago
+    if (entry == nullptr || entry->expires > now || entry->expires + retention <= now) return false;
+
+    // copy the response (with short ttls)
+    Cache::exposestale(entry->data, entry->ttls, entry->limit, result);
+
+    // one more lookup was answered with an expired response
+    statistics().stale.fetch_add(1, std::memory_order_relaxed);
+
+    // done
+    return true;
+}
+
+/**
+ *  Remove all responses
+ */
+void SharedCache::clear()
+{
+    // clear all shards
+    for (size_t i = 0; i < _count; ++i)
+    {
+        // the shard
+        auto &shard = _shards[i];
+
+        // lock it
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        // the removed entries and table are deallocated when the readers are done with them
+        auto &entries = shard.entries[shard.generation.load(std::memory_order_relaxed) & 1];
+        auto &tables = shard.tables[shard.generation.load(std::memory_order_relaxed) & 1];
+
+        // readers no longer find anything
+        Table *table = shard.table.exchange(nullptr); if (table) tables.emplace_back(table);
+
+        // forget all entries and ghosts
+        for (auto *entry : shard.smallqueue) entries.emplace_back(entry);
+        for (auto *entry : shard.mainqueue) entries.emplace_back(entry);
+        shard.smallqueue.clear(); shard.mainqueue.clear();
+        shard.ghostqueue.clear(); shard.ghosts.clear();
+
+        // nothing is in use any more
+        shard.bytes = shard.small = 0;
+
+        // deallocate what can no longer be read
+        reclaim(shard);
+    }
+}
+
+/**
+ *  Write all responses to a snapshot file
+ *  @param  filename    the file to write
+ *  @return bool        was the snapshot written?
+ */
+bool SharedCache::save(const char *filename) const
+{
+    // write the file
+    return Snapshot::save(filename, [this](std::ostream &stream) {
+
+        // write all shards
+        for (size_t i = 0; i < _count; ++i)
+        {
+            // lock the shard (this only blocks the writers)
+            std::lock_guard<std::mutex> lock(_shards[i].mutex);
+
+            // the main queue comes first, so that the most valuable entries are loaded first when the capacity is smaller
+            for (auto *queue : { &_shards[i].mainqueue, &_shards[i].smallqueue })
+            {
+                // write all entries in the queue (most recent first)
+                for (auto *entry : *queue) Snapshot::write(stream, entry->key, entry->data, entry->ttls, entry->stored, entry->expires, entry->limit, entry->frequency.load(std::memory_order_relaxed), entry->main);
+            }
+        }
+    });
+}
+
+/**
+ *  Load the responses from a snapshot file
+ *  @param  filename    the file to read
+ *  @param  now         current time
+ *  @return size_t      number of responses that were loaded
+ */
+size_t SharedCache::load(const char *filename, double now)
+{
+    // nothing is loaded when the cache is disabled
+    if (!enabled()) return 0;
+
+    // read the file
+    return Snapshot::load(filename, now, retention(), [this](Snapshot::Record &&record) -> bool {
+
+        // the new entry
+        std::unique_ptr<Entry> entry(new Entry());
+
+        // fill the entry
+        entry->hash = std::hash<std::string>()(record.key);
+        entry->key = std::move(record.key);
+        entry->data = std::move(record.data);
+        entry->ttls = std::move(record.ttls);
+        entry->stored = record.stored;
+        entry->expires = record.expires;
+        entry->limit = record.limit;
+        entry->frequency.store(record.frequency, std::memory_order_relaxed);
+        entry->main = record.main;
+
+        // find the shard
+        auto &shard = this->shard(entry->key);
+
+        // lock it
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        // store the entry, and deallocate what can no longer be read
+        bool stored = restore(shard, std::move(entry)); reclaim(shard);
+
+        // done
+        return stored;
+    });
+}
+
+/**
+ *  End of namespace
+ */
+}
@@ -0,0 +1,262 @@
+/**
+ *  Snapshot.h
+ *
+ *  The file format in which caches are written to disk. The file starts with
+ *  magic bytes (the last byte is the version of the format) and a marker of
+ *  the byte order and layout of the machine that wrote it, followed by the
+ *  entries. Every entry has a fixed-size part, followed by the key, the
+ *  response and the offsets of the ttls.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+class Snapshot
+{
+private:
+    /**
+     *  The fixed-size part of an entry (the padding is explicit, so that no
+     *  uninitialized bytes end up in the file)
+     */
+    struct Fixed
+    {
+        double stored;
+        double expires;
+        uint32_t limit;
+        uint16_t key;
+        uint16_t data;
+        uint16_t ttls;
+        uint8_t frequency;
+        uint8_t main;
+        uint8_t padding[4];
+    };
+
+    /**
+     *  The padding is explicit, so the fixed-size part should not have any padding of its own
+     */
+    static_assert(sizeof(Fixed) == 32, "unexpected layout of snapshot entries");
+
+    /**
+     *  The entries are written in the byte order and layout of the machine, so
+     *  this follows the magic bytes, and files with another layout are not loaded
+     */
+    struct Layout
+    {
+        uint32_t order = 0x01020304;
+        uint32_t size = sizeof(Fixed);
+
+        /**
+         *  Compare with another layout
+         *  @param  that
+         *  @return bool
+         */
+        bool operator==(const Layout &that) const { return order == that.order && size == that.size; }
+    };
+
+    /**
+     *  The first bytes of a snapshot file (the last byte is the version of the format)
+     *  @return const char *
+     */
+    static const char *magic() { return "DNSCACH\x02"; }
+
+public:
+    /**
+     *  An entry that was read from a snapshot file
+     */
+    struct Record
+    {
+        std::string key;
+        std::vector<unsigned char> data;
+        std::vector<uint16_t> ttls;
+        double stored;
+        double expires;
+        uint32_t limit;
+        uint8_t frequency;
+        bool main;
+    };
+
+    /**
+     *  Write a snapshot file
+     *  The file is first written under a temporary name, and then moved into place,
+     *  so that a process that crashes halfway does not leave a broken snapshot behind
+     *  @param  filename    the file to write
+     *  @param  callback    function that writes the entries to the stream (via write())
+     *  @return bool        was the snapshot written?
+     */
+    template <typename CALLBACK>
+    static bool save(const char *filename, const CALLBACK &callback)
+    {
+        // the temporary file
+        std::string temporary = std::string(filename) + ".tmp";
+
+        // open it
+        std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+
+        // check if the file could be opened
+        if (!stream.is_open()) return false;
+
+        // the layout of the entries
+        Layout layout;
+
+        // the file starts with the magic bytes and the layout, followed by the entries
+        stream.write(magic(), 8); stream.write((const char *)&layout, sizeof(layout)); callback(stream);
+
+        // flush the file, and check if everything was written
+        stream.close(); if (stream.fail()) { unlink(temporary.c_str()); return false; }
+
+        // move it into place
+        return rename(temporary.c_str(), filename) == 0;
+    }
+
+    /**
+     *  Write a single entry
+     *  @param  stream      the file to write to
+     *  @param  key         the key under which the response is stored
+     *  @param  data        the response
+     *  @param  ttls        offsets of the ttls in the response
+     *  @param  stored      time at which the response was stored
+     *  @param  expires     time at which the response expires
+     *  @param  limit       upper limit for the ttls
+     *  @param  frequency   number of times the entry was used
+     *  @param  main        is the entry in the main queue?
+     */
+    static void write(std::ostream &stream, const std::string &key, const std::vector<unsigned char> &data, const std::vector<uint16_t> &ttls, double stored, double expires, uint32_t limit, uint8_t frequency, bool main)
+    {
+        // the fixed-size part
+        Fixed fixed{ stored, expires, limit, uint16_t(key.size()), uint16_t(data.size()), uint16_t(ttls.size()), frequency, main, {} };
+
+        // write it, followed by the variable-size parts
+        stream.write((const char *)&fixed, sizeof(fixed));
+        stream.write(key.data(), key.size());
+        stream.write((const char *)data.data(), data.size());
+        stream.write((const char *)ttls.data(), ttls.size() * sizeof(uint16_t));
+    }
+
+    /**
+     *  Read a snapshot file
+     *  The file is mapped into memory and the entries are copied as they are,
+     *  without parsing the responses (they were parsed when they were stored).
+     *  Every entry is still copied into its own buffers, so the cost is a few
+     *  allocations per entry on top of a pass over the file. Entries that are
+     *  damaged, or that expired too long ago, are skipped
+     *  @param  filename    the file to read
+     *  @param  now         current time
+     *  @param  retention   number of seconds that expired entries are kept
+     *  @param  callback    function that is called for every entry, and that returns whether it was stored
+     *  @return size_t      number of entries that were stored
+     */
+    template <typename CALLBACK>
+    static size_t load(const char *filename, double now, double retention, const CALLBACK &callback)
+    {
+        // open the file
+        int fd = open(filename, O_RDONLY | O_CLOEXEC);
+
+        // check if the file could be opened
+        if (fd < 0) return 0;
+
+        // find out the size of the file
+        struct stat info; if (fstat(fd, &info) != 0 || size_t(info.st_size) < 8 + sizeof(Layout)) { close(fd); return 0; }
+
+        // map the file into memory (the descriptor is no longer needed then)
+        void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0); close(fd);
+
+        // check if the file could be mapped
+        if (mapped == MAP_FAILED) return 0;
+
+        // the first and last byte of the file
+        const unsigned char *current = (const unsigned char *)mapped, *end = current + info.st_size;
+
+        // number of stored entries
+        size_t count = 0;
+
+        // the layout of the entries in the file
+        Layout layout; memcpy(&layout, current + 8, sizeof(layout));
+
+        // the file should be a snapshot in the format that we understand, written by a similar machine
+        if (memcmp(current, magic(), 8) == 0 && layout == Layout()) current += 8 + sizeof(Layout); else current = end;
+
+        // process all entries
+        while (current + sizeof(Fixed) <= end)
+        {
+            // the fixed-size part (copied because the entries in the file are not aligned)
+            Fixed fixed; memcpy(&fixed, current, sizeof(fixed));
+
+            // the total size of the entry
+            size_t size = sizeof(Fixed) + fixed.key + fixed.data + fixed.ttls * sizeof(uint16_t);
+
+            // a truncated file ends here
+            if (current + size > end) break;
+
+            // the variable-size parts
+            const unsigned char *key = current + sizeof(Fixed), *data = key + fixed.key, *ttls = data + fixed.data;
+
+            // proceed to the next entry
+            current += size;
+
+            // entries that expired too long ago are skipped (written like this to skip damaged times too)
+            if (!(fixed.expires + retention > now)) continue;
+
+            // entries that were stored in the future, or that expired before they were stored, are damaged
+            if (!(fixed.stored <= now && fixed.stored < fixed.expires)) continue;
+
+            // the new record
+            Record record;
+
+            // fill the record
+            record.key.assign((const char *)key, fixed.key);
+            record.data.assign(data, data + fixed.data);
+            record.ttls.resize(fixed.ttls); memcpy(record.ttls.data(), ttls, fixed.ttls * sizeof(uint16_t));
+            record.stored = fixed.stored;
+            record.expires = fixed.expires;
+            record.limit = fixed.limit;
+            record.frequency = std::min(fixed.frequency, uint8_t(3));
+            record.main = fixed.main != 0;
+
+            // records that point outside the response are damaged
+            if (std::any_of(record.ttls.begin(), record.ttls.end(), [&record](uint16_t offset) { return offset + 4u > record.data.size(); })) continue;
+
+            // pass it on
+            if (callback(std::move(record))) count += 1;
+        }
+
+        // the file is no longer needed
+        munmap(mapped, info.st_size);
+
+        // expose the number of entries
+        return count;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
@@ -0,0 +1,163 @@
+/**
+ *  SpscQueue.h
+ *
+ *  Unbounded queue between exactly one producer thread and one consumer
+ *  thread. The messages are stored in rings of fixed size that are linked
+ *  together: adding a message is a plain store followed by the release of a
+ *  counter, and a new ring is only allocated when the current one is full.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <atomic>
+#include <utility>
+#include <stddef.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Class definition
+ */
+template <typename TYPE, size_t SIZE = 256>
+class SpscQueue
+{
+private:
+    /**
+     *  A ring of messages
+     */
+    struct Segment
+    {
+        /**
+         *  The messages
+         *  @var TYPE[]
+         */
+        TYPE messages[SIZE];
+
+        /**
+         *  Number of messages that were written by the producer
+         *  @var std::atomic
+         */
+        std::atomic<size_t> written;
+
+        /**
+         *  The next segment (set by the producer when this one is full)
+         *  @var std::atomic
+         */
+        std::atomic<Segment*> next;
+
+        /**
+         *  Constructor
+         */
+        Segment() : written(0), next(nullptr) {}
+    };
+
+    /**
+     *  The segment from which the consumer reads
+     *  @var Segment
+     */
+    Segment *_head;
+
+    /**
+     *  Number of messages that the consumer read from its segment
+     *  @var size_t
+     */
+    size_t _read = 0;
+
+    /**
+     *  The segment to which the producer writes
+     *  @var Segment
+     */
+    Segment *_tail;
+
+public:
+    /**
+     *  Constructor
+     */
+    SpscQueue() : _head(new Segment()), _tail(_head) {}
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    SpscQueue(const SpscQueue &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~SpscQueue()
+    {
+        // remove all segments
+        while (_head) { auto *next = _head->next.load(); delete _head; _head = next; }
+    }
+
+    /**
+     *  Add a message (this should only be called by the producer)
+     *  @param  value       the message
+     */
+    void push(TYPE &&value)
+    {
+        // the position to write to
+        size_t index = _tail->written.load(std::memory_order_relaxed);
+
+        // if the segment is full we continue in a new one
+        if (index == SIZE)
+        {
+            // create it and pass it to the consumer
+            auto *segment = new Segment(); _tail->next.store(segment, std::memory_order_release);
+
+            // this is now where we write
+            _tail = segment; index = 0;
+        }
+
+        // store the message, and publish it
+        _tail->messages[index] = std::move(value); _tail->written.store(index + 1, std::memory_order_release);
+    }
+
+    /**
+     *  Take out the oldest message (this should only be called by the consumer)
+     *  @param  value       where the message is stored
+     *  @return bool        was there a message?
+     */
+    bool pop(TYPE &value)
+    {
+        // if we read the entire segment, we continue with the next one (if the producer already made it)
+        if (_read == SIZE)
+        {
+            // the next segment
+            auto *next = _head->next.load(std::memory_order_acquire);
+
+            // check if there is one
+            if (next == nullptr) return false;
+
+            // the old segment is no longer used by the producer either
+            delete _head; _head = next; _read = 0;
+        }
+
+        // check if the producer wrote a new message
+        if (_read == _head->written.load(std::memory_order_acquire)) return false;
+
+        // take it out
+        value = std::move(_head->messages[_read++]);
+
+        // done
+        return true;
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
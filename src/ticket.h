@@ -0,0 +1,152 @@
+/**
+ *  Ticket.h
+ *
+ *  The operation that userspace gets back when it starts a query via the
+ *  resolver pool. The lookup itself runs in one of the worker threads, and
+ *  the result is reported through the ticket in the thread of the caller.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <vector>
+#include "../include/dnscpp/operation.h"
+#include "../include/dnscpp/handler.h"
+#include "../include/dnscpp/response.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Ticket;
+
+/**
+ *  The result of a lookup, as it is passed from the worker thread to the caller
+ */
+struct Result
+{
+    /**
+     *  What happened to the lookup
+     */
+    enum Status { received, timeout, expired, cancelled };
+
+    /**
+     *  The ticket for which the lookup ran
+     *  @var Ticket
+     */
+    Ticket *ticket;
+
+    /**
+     *  What happened to the lookup
+     *  @var Status
+     */
+    Status status;
+
+    /**
+     *  The response (only when it was received)
+     *  @var std::vector
+     */
+    std::vector<unsigned char> response;
+};
+
+/**
+ *  Class definition
+ */
+class Ticket : public Operation
+{
+private:
+    /**
+     *  Cancel the operation (the lookup in the worker thread keeps running, but its result is ignored)
+     */
+    virtual void cancel() override
+    {
+        // if already reported back to user-space
+        if (_handler == nullptr) return;
+
+        // remember the handler
+        auto *handler = _handler;
+
+        // get rid of the handler to avoid that the result is reported
+        _handler = nullptr;
+
+        // report it back to user-space
+        handler->onCancelled(this);
+    }
+
+public:
+    /**
+     *  Constructor
+     *  @param  handler     user space object interested in the result
+     *  @param  domain      the domain of the lookup
+     *  @param  type        type of records to look for
+     *  @param  bits        the bits to include in the request
+     *  @throws std::runtime_error
+     */
+    Ticket(Handler *handler, const char *domain, ns_type type, const Bits &bits) :
+        Operation(handler, ns_o_query, domain, type, bits) {}
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Ticket(const Ticket &that) = delete;
+
+    /**
+     *  Destructor
+     *  If the ticket is destructed before the result came in, the pool was destructed
+     */
+    virtual ~Ticket()
+    {
+        // let the handler know
+        if (_handler) _handler->onCancelled(this);
+    }
+
+    /**
+     *  Report the result to userspace
+     *  @param  result      the result from the worker thread
+     */
+    void report(Result &result)
+    {
+        // if the ticket was cancelled, nobody is interested in the result
+        if (_handler == nullptr) return;
+
+        // remember the handler
+        auto *handler = _handler;
+
+        // forget the handler so that the operation can no longer be cancelled
+        _handler = nullptr;
+
+        // check what happened
+        switch (result.status) {
+        case Result::received:
+            // the response should match our own query, the id is stored in network byte order in the first two bytes
+            result.response[0] = _query.id() >> 8; result.response[1] = _query.id() & 0xff;
+
+            // pass on the response
+            return handler->onReceived(this, Response(result.response.data(), result.response.size()));
+
+        case Result::timeout:   return handler->onTimeout(this);
+        case Result::expired:   return handler->onExpired(this);
+        case Result::cancelled: return handler->onCancelled(this);
+        }
+    }
+};
+
+/**
+ *  End of namespace
+ */
+}
+
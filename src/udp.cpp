@@ -16,17 +16,24 @@
 #include "../include/dnscpp/query.h"
 #include "../include/dnscpp/core.h"
 #include "../include/dnscpp/now.h"
+#include "uring.h"
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <stdexcept>
 #include <unistd.h>
 #include <poll.h>
+#include <errno.h>
 
 /**
  *  Begin of namespace
  */
 namespace DNS {
 
+/**
+ *  Definitions of the constants (they are passed by reference)
+ */
+const size_t Udp::BATCH;
+
 /**
  *  Constructor
  *  @param  core        core object
@@ -70,13 +77,15 @@ bool Udp::open(int version)
     // if already open
     if (_fd >= 0) return true;
     
-    // try to open it (note that we do not set the NONBLOCK option, because we have not implemented 
-    // buffering for the sendto() call (this could be a future optimization)
-    _fd = socket(version == 6 ? AF_INET6 : AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    // try to open it (datagrams that cannot be sent right away stay in the queue until the socket is writable)
+    _fd = socket(version == 6 ? AF_INET6 : AF_INET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
     
     // check for success
     if (_fd < 0) return false;
 
+    // the slots in which datagrams are received (they are kept when the socket is closed and opened again)
+    if (!_ring) _ring.reset(new unsigned char[BATCH * Query::PAYLOAD]);
+
     // if there is a buffer size to set, do so
     if (_core->buffersize() > 0)
     {
@@ -85,8 +94,11 @@ bool Udp::open(int version)
         setintopt(SO_RCVBUF, _core->buffersize());
     }
 
-    // we want to be notified when the socket receives data
-    _identifier = _core->loop()->add(_fd, 1, this);
+    // if the core uses io_uring, the datagrams are received through it
+    if ((_uring = _core->uring()) != nullptr && (_receiver = _uring->receive(_fd, this)) != nullptr) return true;
+
+    // otherwise we want to be notified when the socket receives data
+    _uring = nullptr; _identifier = _core->loop()->add(_fd, 1, this);
     
     // done
     return true;
@@ -101,14 +113,17 @@ bool Udp::close()
     // if already closed
     if (_fd < 0) return false;
 
-    // tell the event loop that we no longer are interested in notifications
-    _core->loop()->remove(_identifier, _fd, this);
+    // stop receiving through io_uring, or tell the event loop that we no longer are interested in notifications
+    if (_uring) _uring->stop(_receiver); else _core->loop()->remove(_identifier, _fd, this);
     
     // close the socket
     ::close(_fd);
     
-    // remember that socket is closed
-    _fd = -1; _identifier = nullptr;
+    // the queued datagrams can no longer be sent
+    _pending.clear();
+
+    // remember that socket is closed (and no longer full)
+    _fd = -1; _identifier = nullptr; _uring = nullptr; _receiver = nullptr; _blocked = false;
     
     // done
     return true;
@@ -143,39 +158,76 @@ void Udp::notify()
 {
     // do nothing if there is no socket (how is that possible!?)
     if (_fd < 0) return;
+
+    // if we were waiting for the socket to become writable, we try to send the queued datagrams
+    if (_blocked) flush();
     
-    // the buffer to receive the response in
-    // @todo use a macro
-    unsigned char buffer[65536];
+    // descriptions of the messages that are received with a single system call
+    struct mmsghdr headers[BATCH];
+    struct iovec vectors[BATCH];
+
+    // structures will hold the source addresses (we use an ipv6 struct because that is also big enough for ipv4)
+    struct sockaddr_in6 addresses[BATCH];
 
-    // structure will hold the source address (we use an ipv6 struct because that is also big enough for ipv4)
-    struct sockaddr_in6 from; socklen_t fromlen = sizeof(from);
+    // the messages that are passed to the handler
+    std::list<Received> responses;
 
     // get current time
     Now now;
 
     // we want to get as much messages at onces as possible, but not run forever
-    // @todo use scatter-gather io to optimize this further
-    for (size_t messages = 0; messages < 1024; ++messages)
+    for (size_t messages = 0; messages < 1024; )
     {
-        // reveive the message (the DONTWAIT option is needed because this is a blocking socket, but we dont want to block now)
-        auto bytes = recvfrom(_fd, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr *)&from, &fromlen);
-        
-        // if there were no bytes, leap out
-        if (bytes <= 0) break;
+        // point the descriptions to the slots
+        for (size_t i = 0; i < BATCH; ++i)
+        {
+            // the buffer of the slot
+            vectors[i].iov_base = _ring.get() + i * Query::PAYLOAD;
+            vectors[i].iov_len = Query::PAYLOAD;
+
+            // the rest of the description
+            headers[i].msg_hdr = msghdr{ &addresses[i], sizeof(addresses[i]), &vectors[i], 1, nullptr, 0, 0 };
+        }
+
+        // receive the messages
+        int count = recvmmsg(_fd, headers, BATCH, MSG_DONTWAIT, nullptr);
+
+        // if there were no messages, leap out
+        if (count <= 0) return;
+
+        // copy the messages out of the slots, so that the slots can be used for the next batch
+        for (int i = 0; i < count; ++i)
+        {
+            // datagrams that are bigger than we advertised are skipped
+            if (headers[i].msg_hdr.msg_flags & MSG_TRUNC) continue;
+
+            // add to the responses
+            responses.emplace_back((struct sockaddr *)&addresses[i], _ring.get() + i * Query::PAYLOAD, headers[i].msg_len);
+        }
+
+        // pass to the handler (it moves out the messages that it wants to keep)
+        _handler->onReceived(this, now, responses); responses.clear();
 
-        // pass to the handler
-        _handler->onReceived(now, (struct sockaddr *)&from, buffer, bytes);
-    } 
+        // update the counter
+        messages += count;
+
+        // if the batch was not full, the socket has been emptied
+        if (size_t(count) < BATCH) return;
+    }
+
+    // there may be more messages, event loops that are edge-triggered only notify us
+    // again if they are asked to check the socket once more
+    if (_fd >= 0) _identifier = _core->loop()->update(_identifier, _fd, _blocked ? 3 : 1, this);
 }
 
 /**
  *  Send a query to a nameserver (+open the socket when needed)
  *  @param  ip      IP address of the nameserver
+ *  @param  port    the port on which it listens
  *  @param  query   the query to send
  *  @return bool
  */
-bool Udp::send(const Ip &ip, const Query &query)
+bool Udp::send(const Ip &ip, uint16_t port, const Query &query)
 {
     // if the socket is not yet open we need to open it
     if (_fd < 0 && !open(ip.version())) return false;
@@ -188,7 +240,7 @@ bool Udp::send(const Ip &ip, const Query &query)
 
         // fill the members
         info.sin6_family = AF_INET6;
-        info.sin6_port = htons(53);
+        info.sin6_port = htons(port);
         info.sin6_flowinfo = 0;
         info.sin6_scope_id = 0;
 
@@ -205,7 +257,7 @@ bool Udp::send(const Ip &ip, const Query &query)
 
         // fill the members
         info.sin_family = AF_INET;
-        info.sin_port = htons(53);
+        info.sin_port = htons(port);
 
         // copy address
         memcpy(&info.sin_addr, (const struct in_addr *)ip, sizeof(struct in_addr));
@@ -216,7 +268,7 @@ bool Udp::send(const Ip &ip, const Query &query)
 }
 
 /**
- *  Send a query to a certain nameserver
+ *  Queue a query for a certain nameserver
  *  @param  address     target address
  *  @param  size        size of the address
  *  @param  query       query to send
@@ -224,9 +276,108 @@ bool Udp::send(const Ip &ip, const Query &query)
  */
 bool Udp::send(const struct sockaddr *address, size_t size, const Query &query)
 {
-    // send over the socket
-    // @todo include MSG_DONTWAIT + implement non-blocking????
-    return sendto(_fd, query.data(), query.size(), MSG_NOSIGNAL, address, size) >= 0;
+    // with io_uring the datagram is queued, and sent together with the others at the end of the iteration
+    if (_uring && _uring->send(_fd, address, size, query.data(), query.size())) return true;
+
+    // the datagram to queue
+    Pending pending{ &query, {}, socklen_t(std::min(size, sizeof(struct sockaddr_in6))) };
+
+    // copy the address
+    memcpy(&pending.address, address, pending.size);
+
+    // it is sent together with the others at the end of the iteration
+    _pending.push_back(pending);
+
+    // done
+    return true;
+}
+
+/**
+ *  Forget a query that was queued but not yet sent
+ *  @param  query   the query
+ */
+void Udp::cancel(const Query &query)
+{
+    // remove the datagrams for this query
+    _pending.erase(std::remove_if(_pending.begin(), _pending.end(), [&query](const Pending &pending) { return pending.query == &query; }), _pending.end());
+}
+
+/**
+ *  Send all queued queries (with as few system calls as possible)
+ */
+void Udp::flush()
+{
+    // nothing to do if there is no socket
+    if (_fd < 0) return;
+
+    // descriptions of the messages that are sent with a single system call
+    struct mmsghdr headers[BATCH];
+    struct iovec vectors[BATCH];
+
+    // the number of datagrams that have been sent
+    size_t sent = 0;
+
+    // send until all datagrams are gone
+    while (sent < _pending.size())
+    {
+        // number of datagrams in this batch
+        size_t count = std::min(_pending.size() - sent, BATCH);
+
+        // describe the datagrams (the buffers of the queries are used directly)
+        for (size_t i = 0; i < count; ++i)
+        {
+            // the datagram
+            auto &pending = _pending[sent + i];
+
+            // the data
+            vectors[i].iov_base = (void *)pending.query->data();
+            vectors[i].iov_len = pending.query->size();
+
+            // the rest of the description
+            headers[i].msg_hdr = msghdr{ &pending.address, pending.size, &vectors[i], 1, nullptr, 0, 0 };
+        }
+
+        // send the datagrams
+        int result = sendmmsg(_fd, headers, count, MSG_NOSIGNAL);
+
+        // an interrupted call is simply repeated
+        if (result < 0 && errno == EINTR) continue;
+
+        // if the socket is full (or the kernel ran out of buffers) we stop, and wait until it is writable again
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) return block(sent);
+
+        // if the first datagram could not be sent because of an error of its own (for example because the
+        // destination is unreachable) it is skipped, like a failed sendto() it is simply lost
+        sent += result > 0 ? result : 1;
+    }
+
+    // all datagrams are gone
+    _pending.clear();
+
+    // if we were waiting for the socket to become writable, we no longer have to
+    if (!_blocked) return;
+
+    // only readability has to be monitored from now on
+    _blocked = false; _identifier = _core->loop()->update(_identifier, _fd, 1, this);
+
+    // the core can admit lookups again
+    _core->unblocked();
+}
+
+/**
+ *  Wait for the socket to become writable because it is full
+ *  @param  sent        number of queued datagrams that were sent
+ */
+void Udp::block(size_t sent)
+{
+    // forget the datagrams that were sent
+    _pending.erase(_pending.begin(), _pending.begin() + sent);
+
+    // if we were already waiting there is nothing to change
+    if (_blocked) return;
+
+    // we want to be notified when the socket is writable (as well as readable)
+    _blocked = true; _identifier = _core->loop()->update(_identifier, _fd, 3, this);
 }
 
 /**
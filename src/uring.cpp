@@ -0,0 +1,504 @@
+/**
+ *  Uring.cpp
+ *
+ *  Implementation file for the Uring class
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "uring.h"
+#include "../include/dnscpp/loop.h"
+#include "../include/dnscpp/udp.h"
+#include "../include/dnscpp/now.h"
+#include <stdexcept>
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/**
+ *  The transport is only compiled when the kernel headers support it (see uring.h)
+ */
+#ifdef DNSCPP_URING
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Tags that are stored in the lowest bits of the user data of an operation
+ *  @var uint64_t
+ */
+static const uint64_t RECEIVE = 0;
+static const uint64_t SEND = 1;
+static const uint64_t CANCEL = 2;
+
+/**
+ *  Check whether an operation is supported by the kernel
+ *  @param  probe       the result of the probe
+ *  @param  op          the operation
+ *  @return bool
+ */
+static bool supported(const struct io_uring_probe *probe, unsigned op)
+{
+    // the operation must be known, and supported
+    return op < probe->ops_len && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+}
+
+/**
+ *  Constructor
+ *  @param  loop        the event loop
+ *  @throws std::runtime_error  when io_uring is not (fully) supported
+ */
+Uring::Uring(Loop *loop) : _loop(loop)
+{
+    // the parameters, we want a completion queue that can hold many responses
+    struct io_uring_params params; memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE; params.cq_entries = 4096;
+
+    // create the io_uring instance
+    _fd = syscall(__NR_io_uring_setup, 256, &params);
+
+    // check for failure (old kernels, or io_uring is disabled)
+    if (_fd < 0) throw std::runtime_error("io_uring is not supported");
+
+    // the supported operations
+    unsigned char buffer[sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op)] = {};
+    auto *operations = (struct io_uring_probe *)buffer;
+
+    // ask the kernel for the operations that we use
+    if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PROBE, operations, 256) < 0 || !supported(operations, IORING_OP_RECVMSG) ||
+        !supported(operations, IORING_OP_SENDMSG) || !supported(operations, IORING_OP_ASYNC_CANCEL))
+    {
+        // we cannot use this kernel
+        cleanup(); throw std::runtime_error("io_uring does not support recvmsg and sendmsg");
+    }
+
+    // size of the rings (older kernels map them separately)
+    _sqringsize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cqringsize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) _sqringsize = _cqringsize = std::max(_sqringsize, _cqringsize);
+
+    // map the submission ring, the completion ring and the submission entries
+    _sqring = mmap(nullptr, _sqringsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    _cqring = (params.features & IORING_FEAT_SINGLE_MMAP) ? _sqring : mmap(nullptr, _cqringsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+    _sqes = (struct io_uring_sqe *)mmap(nullptr, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+
+    // the number of entries is needed to unmap them
+    _sqentries = params.sq_entries;
+
+    // check for failure
+    if (_sqring == MAP_FAILED || _cqring == MAP_FAILED || _sqes == MAP_FAILED) { cleanup(); throw std::runtime_error("failed to map io_uring"); }
+
+    // the fields of the submission queue
+    _sqhead = (unsigned *)((char *)_sqring + params.sq_off.head);
+    _sqtail = (unsigned *)((char *)_sqring + params.sq_off.tail);
+    _sqarray = (unsigned *)((char *)_sqring + params.sq_off.array);
+    _sqmask = *(unsigned *)((char *)_sqring + params.sq_off.ring_mask);
+
+    // the fields of the completion queue
+    _cqhead = (unsigned *)((char *)_cqring + params.cq_off.head);
+    _cqtail = (unsigned *)((char *)_cqring + params.cq_off.tail);
+    _cqmask = *(unsigned *)((char *)_cqring + params.cq_off.ring_mask);
+    _cqes = (struct io_uring_cqe *)((char *)_cqring + params.cq_off.cqes);
+
+    // the ring with buffers (this must be page aligned) and the buffers themselves
+    _buffers = (struct io_uring_buf *)mmap(nullptr, BUFFERS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    _memory = (unsigned char *)malloc(BUFFERS * BUFFERSIZE);
+
+    // check for failure
+    if (_buffers == MAP_FAILED || _memory == nullptr) { cleanup(); throw std::runtime_error("failed to allocate io_uring buffers"); }
+
+    // register the buffer ring as group 0
+    struct io_uring_buf_reg registration; memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t)_buffers; registration.ring_entries = BUFFERS; registration.bgid = 0;
+
+    // pass it to the kernel
+    if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) { cleanup(); throw std::runtime_error("io_uring does not support buffer rings"); }
+
+    // hand out all buffers
+    for (size_t i = 0; i < BUFFERS; ++i) recycle(i);
+
+    // the multishot flag of recvmsg() and synchronous cancellation can not be probed like operations, so we try them out
+    if (!probe()) { cleanup(); throw std::runtime_error("io_uring does not support multishot recvmsg"); }
+
+    // we want to be notified when operations complete
+    _identifier = _loop->add(_fd, 1, this);
+}
+
+/**
+ *  Destructor
+ */
+Uring::~Uring()
+{
+    // we no longer want to be notified
+    _loop->remove(_identifier, _fd, this);
+
+    // cancel everything that still runs, so that the kernel no longer uses our buffers
+    cancel(0);
+
+    // release the resources
+    cleanup();
+}
+
+/**
+ *  Cancel operations right away, without going through the submission queue
+ *  The call returns when the operations are cancelled, their completions are
+ *  still added to the completion queue
+ *  @param  userdata    the user data of the operation to cancel (or zero to cancel everything)
+ *  @return bool        was the request accepted by the kernel?
+ */
+bool Uring::cancel(uint64_t userdata)
+{
+    // describe what to cancel (there is no timeout)
+    struct io_uring_sync_cancel_reg request; memset(&request, 0, sizeof(request));
+    request.addr = userdata; request.fd = -1; request.timeout.tv_sec = request.timeout.tv_nsec = -1;
+
+    // without user data, everything is cancelled
+    if (userdata == 0) request.flags = IORING_ASYNC_CANCEL_ANY;
+
+    // cancel it (when nothing was found, the operation already completed)
+    return syscall(__NR_io_uring_register, _fd, IORING_REGISTER_SYNC_CANCEL, &request, 1) >= 0 || errno == ENOENT;
+}
+
+/**
+ *  Check whether the kernel supports multishot recvmsg() and synchronous cancellation
+ *  A multishot recvmsg() is started on a socket that never gets any data, and
+ *  it is then cancelled: older kernels reject the flag, or the cancellation
+ *  @return bool
+ */
+bool Uring::probe()
+{
+    // a socket that nobody sends to
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+    // check for failure
+    if (fd < 0) return false;
+
+    // a receiver to pass to the kernel (it never gets a datagram)
+    Receiver receiver; memset(&receiver, 0, sizeof(Receiver)); receiver.fd = fd;
+
+    // start receiving
+    arm(&receiver); flush();
+
+    // the operation should be submitted and then cancelled (both fail on kernels that are too old)
+    bool result = receiver.armed && _pending == 0 && cancel(0);
+
+    // wait for the completion of the operation (it completed right away if the flag was rejected)
+    if (result) syscall(__NR_io_uring_enter, _fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+    // the operation should have been cancelled, and not been rejected
+    for (unsigned head = *_cqhead; head != __atomic_load_n(_cqtail, __ATOMIC_ACQUIRE); ++head)
+    {
+        // check the result
+        if (_cqes[head & _cqmask].res == -EINVAL) result = false;
+
+        // the kernel can reuse the entry
+        __atomic_store_n(_cqhead, head + 1, __ATOMIC_RELEASE);
+    }
+
+    // the socket is no longer needed
+    close(fd);
+
+    // expose the result
+    return result;
+}
+
+/**
+ *  Release the resources
+ */
+void Uring::cleanup()
+{
+    // close the instance
+    close(_fd);
+
+    // unmap the rings
+    if (_sqes != nullptr && _sqes != MAP_FAILED) munmap(_sqes, _sqentries * sizeof(struct io_uring_sqe));
+    if (_cqring != nullptr && _cqring != MAP_FAILED && _cqring != _sqring) munmap(_cqring, _cqringsize);
+    if (_sqring != nullptr && _sqring != MAP_FAILED) munmap(_sqring, _sqringsize);
+
+    // release the buffers
+    if (_buffers != nullptr && _buffers != MAP_FAILED) munmap(_buffers, BUFFERS * sizeof(struct io_uring_buf));
+    free(_memory);
+}
+
+/**
+ *  Get a submission queue entry to fill in
+ *  @return io_uring_sqe        (nullptr when the submission queue is full)
+ */
+struct io_uring_sqe *Uring::sqe()
+{
+    // the position where the entry goes
+    unsigned tail = *_sqtail;
+
+    // if the queue is full, we first submit what we have
+    if (tail - __atomic_load_n(_sqhead, __ATOMIC_ACQUIRE) >= _sqentries) flush();
+
+    // check if this helped
+    if (tail - __atomic_load_n(_sqhead, __ATOMIC_ACQUIRE) >= _sqentries) return nullptr;
+
+    // the entry to fill in
+    auto *sqe = &_sqes[tail & _sqmask]; memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+    // add it to the queue (the kernel only looks at it when we submit, so it can be filled in after this)
+    _sqarray[tail & _sqmask] = tail & _sqmask; __atomic_store_n(_sqtail, tail + 1, __ATOMIC_RELEASE);
+
+    // one more entry to submit
+    _pending += 1;
+
+    // expose the entry
+    return sqe;
+}
+
+/**
+ *  Submit all queued operations to the kernel
+ */
+void Uring::flush()
+{
+    // submit until everything is submitted
+    while (_pending > 0)
+    {
+        // pass the entries to the kernel
+        int result = syscall(__NR_io_uring_enter, _fd, _pending, 0, 0, nullptr, 0);
+
+        // on failure we try again the next time
+        if (result <= 0) return;
+
+        // these were submitted
+        _pending -= std::min(unsigned(result), _pending);
+    }
+}
+
+/**
+ *  Give a buffer back to the kernel
+ *  @param  id          the buffer id
+ */
+void Uring::recycle(uint16_t id)
+{
+    // the slot in the ring
+    auto *buffer = &_buffers[_buffertail & (BUFFERS - 1)];
+
+    // describe the buffer
+    buffer->addr = (uint64_t)(_memory + id * BUFFERSIZE); buffer->len = BUFFERSIZE; buffer->bid = id;
+
+    // publish it (the tail of the ring overlays the reserved field of the first slot)
+    __atomic_store_n(&_buffers[0].resv, ++_buffertail, __ATOMIC_RELEASE);
+}
+
+/**
+ *  Start (or restart) receiving on a socket
+ *  @param  receiver    the receiver
+ */
+void Uring::arm(Receiver *receiver)
+{
+    // the entry for the operation
+    auto *sqe = this->sqe();
+
+    // if the queue is full, the socket no longer receives
+    if (sqe == nullptr) { receiver->armed = false; return; }
+
+    // receive many messages, with buffers from group 0
+    sqe->opcode = IORING_OP_RECVMSG; sqe->fd = receiver->fd; sqe->addr = (uint64_t)&receiver->header; sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT; sqe->flags = IOSQE_BUFFER_SELECT; sqe->buf_group = 0;
+    sqe->user_data = (uint64_t)receiver | RECEIVE;
+
+    // the operation runs
+    receiver->armed = true;
+}
+
+/**
+ *  Start receiving datagrams on a socket
+ *  @param  fd          the filedescriptor
+ *  @param  udp         the socket that gets the datagrams
+ *  @return void*       identifier to stop receiving (or nullptr on failure)
+ */
+void *Uring::receive(int fd, Udp *udp)
+{
+    // recycle a receiver, or add a new one
+    Receiver *receiver = nullptr;
+    if (_idle.empty()) { _receivers.emplace_back(); receiver = &_receivers.back(); }
+    else { receiver = _idle.back(); _idle.pop_back(); }
+
+    // set it up, we want room for the address of the sender in front of each message
+    memset(receiver, 0, sizeof(Receiver)); receiver->udp = udp; receiver->fd = fd;
+    receiver->header.msg_namelen = sizeof(struct sockaddr_in6);
+
+    // start receiving right away
+    arm(receiver); flush();
+
+    // check for failure
+    if (!receiver->armed) { _idle.push_back(receiver); return nullptr; }
+
+    // expose the receiver
+    return receiver;
+}
+
+/**
+ *  Stop receiving datagrams
+ *  @param  identifier  the identifier that was returned by receive()
+ */
+void Uring::stop(void *identifier)
+{
+    // the receiver
+    auto *receiver = (Receiver *)identifier;
+
+    // the socket no longer gets datagrams
+    receiver->udp = nullptr;
+
+    // if the operation is no longer running, the receiver can be reused right away
+    if (!receiver->armed) { _idle.push_back(receiver); return; }
+
+    // the entry to cancel the operation (the receiver is reused once the final completion comes in)
+    auto *sqe = this->sqe();
+
+    // when the submission queue is full even after flushing, the operation is cancelled right away
+    if (sqe == nullptr) { cancel((uint64_t)receiver | RECEIVE); return; }
+
+    // cancel the receive operation
+    sqe->opcode = IORING_OP_ASYNC_CANCEL; sqe->addr = (uint64_t)receiver | RECEIVE; sqe->user_data = CANCEL;
+
+    // do this right away, because the socket is about to be closed
+    flush();
+}
+
+/**
+ *  Queue a datagram
+ *  @param  fd          the filedescriptor
+ *  @param  address     the address to send to
+ *  @param  size        size of the address
+ *  @param  data        the data to send
+ *  @param  length      size of the data
+ *  @return bool        was it queued?
+ */
+bool Uring::send(int fd, const struct sockaddr *address, size_t size, const unsigned char *data, size_t length)
+{
+    // check if the message fits
+    if (length > sizeof(Sender::data) || size > sizeof(struct sockaddr_in6)) return false;
+
+    // the entry for the operation
+    auto *sqe = this->sqe();
+    if (sqe == nullptr) return false;
+
+    // recycle a sender, or add a new one
+    Sender *sender = nullptr;
+    if (_available.empty()) { _senders.emplace_back(); sender = &_senders.back(); }
+    else { sender = _available.back(); _available.pop_back(); }
+
+    // copy the address and the data (the caller does not keep them)
+    memcpy(&sender->address, address, size); memcpy(sender->data, data, length);
+
+    // describe the message
+    sender->vector.iov_base = sender->data; sender->vector.iov_len = length;
+    memset(&sender->header, 0, sizeof(struct msghdr));
+    sender->header.msg_name = &sender->address; sender->header.msg_namelen = size;
+    sender->header.msg_iov = &sender->vector; sender->header.msg_iovlen = 1;
+
+    // send the message
+    sqe->opcode = IORING_OP_SENDMSG; sqe->fd = fd; sqe->addr = (uint64_t)&sender->header; sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL; sqe->user_data = (uint64_t)sender | SEND;
+
+    // done
+    return true;
+}
+
+/**
+ *  Handle a completion of a receive operation
+ *  @param  receiver    the receiver
+ *  @param  cqe         the completion
+ *  @param  now         current time
+ */
+void Uring::received(Receiver *receiver, const struct io_uring_cqe *cqe, time_t now)
+{
+    // if a datagram was received, it is in one of our buffers
+    if (cqe->flags & IORING_CQE_F_BUFFER)
+    {
+        // the buffer
+        uint16_t id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        auto *buffer = _memory + id * BUFFERSIZE;
+
+        // the buffer starts with a description of the message
+        auto *message = (struct io_uring_recvmsg_out *)buffer;
+
+        // pass it on (if the socket still wants it, and if it was not truncated)
+        if (receiver->udp != nullptr && cqe->res >= 0 && (message->flags & MSG_TRUNC) == 0 && message->namelen <= receiver->header.msg_namelen)
+        {
+            // the address of the sender, and the datagram
+            auto *address = buffer + sizeof(struct io_uring_recvmsg_out);
+            auto *payload = address + receiver->header.msg_namelen + receiver->header.msg_controllen;
+
+            // pass it to the socket
+            receiver->udp->received(now, (const struct sockaddr *)address, payload, message->payloadlen);
+        }
+
+        // the kernel can use the buffer again
+        recycle(id);
+    }
+
+    // nothing else to do if the operation keeps running
+    if (cqe->flags & IORING_CQE_F_MORE) return;
+
+    // the operation stopped
+    receiver->armed = false;
+
+    // if the socket is no longer interested, the receiver can be reused
+    if (receiver->udp == nullptr) { _idle.push_back(receiver); return; }
+
+    // restart the operation (it also stops when it ran out of buffers)
+    if (cqe->res >= 0 || cqe->res == -ENOBUFS || cqe->res == -EINTR) arm(receiver);
+}
+
+/**
+ *  Method that is called when the completion queue has entries
+ */
+void Uring::notify()
+{
+    // the current time
+    Now now;
+
+    // the first entry that we did not yet look at
+    unsigned head = *_cqhead;
+
+    // keep going while the kernel adds entries
+    while (true)
+    {
+        // the position after the last entry
+        unsigned tail = __atomic_load_n(_cqtail, __ATOMIC_ACQUIRE);
+
+        // leap out when everything was handled
+        if (head == tail) break;
+
+        // handle the entries
+        for (; head != tail; ++head)
+        {
+            // the entry
+            auto *cqe = &_cqes[head & _cqmask];
+
+            // what kind of operation completed?
+            switch (cqe->user_data & 3) {
+            case RECEIVE:   received((Receiver *)(cqe->user_data & ~uint64_t(3)), cqe, now); break;
+            case SEND:      _available.push_back((Sender *)(cqe->user_data & ~uint64_t(3))); break;
+            default:        break;
+            }
+        }
+
+        // the kernel can reuse the entries
+        __atomic_store_n(_cqhead, head, __ATOMIC_RELEASE);
+    }
+
+    // submit the receive operations that were restarted
+    flush();
+}
+
+/**
+ *  End of namespace
+ */
+}
+
+#endif
@@ -0,0 +1,366 @@
+/**
+ *  Uring.h
+ *
+ *  Transport for the udp sockets that is based on io_uring. Incoming
+ *  datagrams are received with a multishot recvmsg() operation that picks
+ *  its buffers from a ring that is shared with the kernel, so that a single
+ *  submission keeps delivering responses. Outgoing datagrams are queued as
+ *  sendmsg() operations that are submitted in one system call at the end of
+ *  each iteration of the core. The completion queue is monitored through
+ *  the event loop of the user.
+ *
+ *  The kernel must support provided buffer rings, multishot recvmsg() and
+ *  synchronous cancellation (Linux 6.0 and up), otherwise the constructor
+ *  throws and the sockets keep using the regular system calls.
+ *
+ *  The transport is only compiled when the kernel headers are recent enough
+ *  (and it is not switched off with -DDNSCPP_NO_URING, for example with
+ *  "make URING=0"). Otherwise a stub is compiled whose constructor always
+ *  throws, so that Context::uring(true) returns false.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <deque>
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <stdexcept>
+#include "../include/dnscpp/monitor.h"
+
+/**
+ *  The io_uring headers are only used when they are available, and when they
+ *  are recent enough to know about multishot recvmsg() (the other features
+ *  that we use were added in the same or an earlier release)
+ */
+#if defined(__linux__) && !defined(DNSCPP_NO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_RECV_MULTISHOT)
+#define DNSCPP_URING 1
+#endif
+#endif
+#endif
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Loop;
+class Udp;
+
+#ifdef DNSCPP_URING
+
+/**
+ *  Class definition
+ */
+class Uring : private Monitor
+{
+private:
+    /**
+     *  A socket from which datagrams are received
+     */
+    struct Receiver
+    {
+        /**
+         *  The socket that gets the datagrams (nullptr when it stopped)
+         *  @var Udp
+         */
+        Udp *udp;
+
+        /**
+         *  The filedescriptor
+         *  @var int
+         */
+        int fd;
+
+        /**
+         *  Is the recvmsg() operation still running in the kernel?
+         *  @var bool
+         */
+        bool armed;
+
+        /**
+         *  Description of the messages to receive (only the sizes of the parts are used)
+         *  @var struct msghdr
+         */
+        struct msghdr header;
+    };
+
+    /**
+     *  A datagram that is being sent
+     */
+    struct Sender
+    {
+        /**
+         *  Description of the message
+         *  @var struct msghdr
+         */
+        struct msghdr header;
+
+        /**
+         *  The data of the message
+         *  @var struct iovec
+         */
+        struct iovec vector;
+
+        /**
+         *  The address to send to
+         *  @var struct sockaddr_in6
+         */
+        struct sockaddr_in6 address;
+
+        /**
+         *  Copy of the query (queries are never bigger than this)
+         *  @var unsigned char[]
+         */
+        unsigned char data[512];
+    };
+
+    /**
+     *  Number of buffers that the kernel can pick from, and the size of each buffer
+     *  @var size_t
+     */
+    static const size_t BUFFERS = 512;
+    static const size_t BUFFERSIZE = 2048;
+
+    /**
+     *  The event loop
+     *  @var Loop
+     */
+    Loop *_loop;
+
+    /**
+     *  The io_uring filedescriptor, and its identifier in the event loop
+     *  @var int
+     */
+    int _fd;
+    void *_identifier = nullptr;
+
+    /**
+     *  The mapped memory of the rings
+     *  @var void*
+     */
+    void *_sqring = nullptr;
+    void *_cqring = nullptr;
+    size_t _sqringsize = 0;
+    size_t _cqringsize = 0;
+
+    /**
+     *  The submission queue
+     */
+    unsigned *_sqhead = nullptr;
+    unsigned *_sqtail = nullptr;
+    unsigned *_sqarray = nullptr;
+    unsigned _sqmask = 0;
+    unsigned _sqentries = 0;
+    struct io_uring_sqe *_sqes = nullptr;
+
+    /**
+     *  The completion queue
+     */
+    unsigned *_cqhead = nullptr;
+    unsigned *_cqtail = nullptr;
+    unsigned _cqmask = 0;
+    struct io_uring_cqe *_cqes = nullptr;
+
+    /**
+     *  Number of operations that were queued but not yet submitted
+     *  @var unsigned
+     */
+    unsigned _pending = 0;
+
+    /**
+     *  The ring with buffers that the kernel picks from, and the memory of the buffers
+     */
+    struct io_uring_buf *_buffers = nullptr;
+    unsigned char *_memory = nullptr;
+    uint16_t _buffertail = 0;
+
+    /**
+     *  Storage for receivers and senders (their addresses are passed to the kernel, a deque
+     *  never moves its elements), and the ones that can be recycled
+     */
+    std::deque<Receiver> _receivers;
+    std::deque<Sender> _senders;
+    std::vector<Receiver *> _idle;
+    std::vector<Sender *> _available;
+
+    /**
+     *  Get a submission queue entry to fill in (it is submitted by the next call to flush())
+     *  @return io_uring_sqe
+     */
+    struct io_uring_sqe *sqe();
+
+    /**
+     *  Give a buffer back to the kernel
+     *  @param  id          the buffer id
+     */
+    void recycle(uint16_t id);
+
+    /**
+     *  Start (or restart) receiving on a socket
+     *  @param  receiver    the receiver
+     */
+    void arm(Receiver *receiver);
+
+    /**
+     *  Cancel operations right away, without going through the submission queue
+     *  @param  userdata    the user data of the operation to cancel (or zero to cancel everything)
+     *  @return bool        was the request accepted by the kernel?
+     */
+    bool cancel(uint64_t userdata);
+
+    /**
+     *  Check whether the kernel supports multishot recvmsg() and synchronous cancellation
+     *  @return bool
+     */
+    bool probe();
+
+    /**
+     *  Handle a completion of a receive operation
+     *  @param  receiver    the receiver
+     *  @param  cqe         the completion
+     *  @param  now         current time
+     */
+    void received(Receiver *receiver, const struct io_uring_cqe *cqe, time_t now);
+
+    /**
+     *  Method that is called when the completion queue has entries
+     */
+    virtual void notify() override;
+
+    /**
+     *  Release the resources
+     */
+    void cleanup();
+
+public:
+    /**
+     *  Constructor
+     *  @param  loop        the event loop
+     *  @throws std::runtime_error  when io_uring is not (fully) supported
+     */
+    Uring(Loop *loop);
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Uring(const Uring &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Uring();
+
+    /**
+     *  Start receiving datagrams on a socket
+     *  @param  fd          the filedescriptor
+     *  @param  udp         the socket that gets the datagrams
+     *  @return void*       identifier to stop receiving
+     */
+    void *receive(int fd, Udp *udp);
+
+    /**
+     *  Stop receiving datagrams (this must be called before the socket is closed)
+     *  @param  identifier  the identifier that was returned by receive()
+     */
+    void stop(void *identifier);
+
+    /**
+     *  Queue a datagram (it is sent by the next call to flush())
+     *  @param  fd          the filedescriptor
+     *  @param  address     the address to send to
+     *  @param  size        size of the address
+     *  @param  data        the data to send
+     *  @param  length      size of the data
+     *  @return bool        was it queued? (false when the data does not fit)
+     */
+    bool send(int fd, const struct sockaddr *address, size_t size, const unsigned char *data, size_t length);
+
+    /**
+     *  Submit all queued operations to the kernel
+     */
+    void flush();
+};
+
+#else
+
+/**
+ *  Class definition of the stub that is used when io_uring is not compiled in
+ */
+class Uring
+{
+public:
+    /**
+     *  Constructor
+     *  @param  loop        the event loop
+     *  @throws std::runtime_error  always
+     */
+    Uring(Loop *loop) { throw std::runtime_error("io_uring is not available in this build"); }
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Uring(const Uring &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Uring() = default;
+
+    /**
+     *  Start receiving datagrams on a socket
+     *  @param  fd          the filedescriptor
+     *  @param  udp         the socket that gets the datagrams
+     *  @return void*       identifier to stop receiving (always nullptr)
+     */
+    void *receive(int fd, Udp *udp) { return nullptr; }
+
+    /**
+     *  Stop receiving datagrams
+     *  @param  identifier  the identifier that was returned by receive()
+     */
+    void stop(void *identifier) {}
+
+    /**
+     *  Queue a datagram
+     *  @param  fd          the filedescriptor
+     *  @param  address     the address to send to
+     *  @param  size        size of the address
+     *  @param  data        the data to send
+     *  @param  length      size of the data
+     *  @return bool        was it queued? (always false)
+     */
+    bool send(int fd, const struct sockaddr *address, size_t size, const unsigned char *data, size_t length) { return false; }
+
+    /**
+     *  Submit all queued operations to the kernel
+     */
+    void flush() {}
+};
+
+#endif
+
+/**
+ *  End of namespace
+ */
+}
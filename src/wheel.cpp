@@ -0,0 +1,263 @@
+/**
+ *  Wheel.cpp
+ *
+ *  Implementation file for the Wheel class
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "../include/dnscpp/wheel.h"
+#include "../include/dnscpp/lookup.h"
+#include "../include/dnscpp/now.h"
+#include <math.h>
+#include <algorithm>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Constructor
+ */
+Wheel::Wheel() : _tick(floor(Now() * 1000.0))
+{
+    // no slots are in use
+    for (size_t level = 0; level < LEVELS; ++level) _occupied[level] = 0;
+}
+
+/**
+ *  Convert a time to a tick (rounded up, so that entries never expire too early)
+ *  @param  time        time in seconds
+ *  @return uint64_t
+ */
+uint64_t Wheel::ticks(double time)
+{
+    // one tick per millisecond
+    return ceil(time * 1000.0);
+}
+
+/**
+ *  Store a lookup in the slot that matches its expire-tick
+ *  @param  lookup      the lookup to store
+ */
+void Wheel::place(Lookup *lookup)
+{
+    // lookups that already expired are due right away
+    if (lookup->_expires < _tick) return _due.push_back(lookup);
+
+    // number of ticks until the lookup expires
+    uint64_t delta = lookup->_expires - _tick;
+
+    // lookups that are too far in the future are stored in the last slot that we can reach
+    if (delta >= (uint64_t(1) << (LEVELS * BITS))) lookup->_expires = _tick + (uint64_t(1) << (LEVELS * BITS)) - 1;
+
+    // find the lowest level that covers the delta
+    size_t level = 0;
+    while (level < LEVELS - 1 && delta >= (uint64_t(1) << ((level + 1) * BITS))) level += 1;
+
+    // the slot on that level
+    size_t index = (lookup->_expires >> (level * BITS)) & (SLOTS - 1);
+
+    // store the lookup and mark the slot as occupied
+    _slots[level][index].push_back(lookup);
+    _occupied[level] |= uint64_t(1) << index;
+
+    // one more lookup in the slots
+    _size += 1;
+}
+
+/**
+ *  Move all lookups from one of the slots on a higher level to the lower levels
+ *  @param  level       the level of the slot
+ *  @param  index       index of the slot
+ */
+void Wheel::cascade(size_t level, size_t index)
+{
+    // the slot is going to be emptied
+    _occupied[level] &= ~(uint64_t(1) << index);
+
+    // put each lookup back in the wheel (they end up on a lower level)
+    while (auto *lookup = _slots[level][index].pop_front()) { _size -= 1; place(lookup); }
+}
+
+/**
+ *  Add a lookup that should be processed right away
+ *  @param  lookup      the lookup to add
+ *  @param  active      does the lookup still have credits?
+ */
+void Wheel::push(Lookup *lookup, bool active)
+{
+    // remember whether the lookup is active
+    lookup->_active = active;
+    if (active) _active += 1;
+
+    // add to the due lookups
+    _due.push_back(lookup);
+}
+
+/**
+ *  Add a lookup that should be processed at a certain time
+ *  @param  lookup      the lookup to add
+ *  @param  expires     time at which it should run
+ *  @param  active      does the lookup still have credits?
+ */
+void Wheel::insert(Lookup *lookup, double expires, bool active)
+{
+    // remember whether the lookup is active
+    lookup->_active = active;
+    if (active) _active += 1;
+
+    // store in the appropriate slot
+    lookup->_expires = ticks(expires);
+    place(lookup);
+}
+
+/**
+ *  Remove a lookup from the wheel
+ *  @param  lookup      the lookup to remove
+ *  @return bool        was it stored in the wheel?
+ */
+bool Wheel::remove(Lookup *lookup)
+{
+    // the list that holds the lookup
+    auto *list = lookup->_list;
+
+    // if the lookup is not stored in one of our slots, it could be in the due list
+    if (list < &_slots[0][0] || list >= &_slots[0][0] + LEVELS * SLOTS)
+    {
+        // it must be in the due list
+        if (!_due.remove(lookup)) return false;
+    }
+    else
+    {
+        // remove from the slot
+        list->remove(lookup);
+
+        // one lookup less in the slots
+        _size -= 1;
+
+        // position of the slot
+        size_t position = list - &_slots[0][0];
+
+        // if the slot became empty, we update the bitmap
+        if (list->empty()) _occupied[position / SLOTS] &= ~(uint64_t(1) << (position % SLOTS));
+    }
+
+    // update bookkeeping
+    if (lookup->_active) _active -= 1;
+
+    // done
+    return true;
+}
+
+/**
+ *  Move all lookups that expired before a certain time to the list of due lookups
+ *  @param  now         current time
+ */
+void Wheel::advance(double now)
+{
+    // the last tick that should be processed
+    uint64_t target = floor(now * 1000.0);
+
+    // process all ticks up to the target
+    while (_tick <= target)
+    {
+        // if there is nothing stored in the slots we can jump to the target right away
+        if (_size == 0) { _tick = target + 1; return; }
+
+        // if the lowest level is empty, we can skip to the point where the next cascade takes place
+        if (_occupied[0] == 0 && (_tick & (SLOTS - 1)) != 0) { _tick = std::min(target + 1, (_tick | (SLOTS - 1)) + 1); continue; }
+
+        // when we are at a boundary of a level, the slot from the level above it has to be cascaded
+        for (size_t level = 1; level < LEVELS; ++level)
+        {
+            // only if all lower bits are zero
+            if ((_tick & ((uint64_t(1) << (level * BITS)) - 1)) != 0) break;
+
+            // cascade the slot
+            cascade(level, (_tick >> (level * BITS)) & (SLOTS - 1));
+        }
+
+        // the slot on the lowest level that expires now
+        size_t index = _tick & (SLOTS - 1);
+
+        // the slot is going to be emptied
+        _occupied[0] &= ~(uint64_t(1) << index);
+
+        // move the lookups to the due list
+        while (auto *lookup = _slots[0][index].pop_front()) { _size -= 1; _due.push_back(lookup); }
+
+        // proceed with the next tick
+        _tick += 1;
+    }
+}
+
+/**
+ *  Take the next lookup that is due (the oldest one of the most urgent priority class)
+ *  @return Lookup      the lookup (or nullptr if nothing is due)
+ */
+Lookup *Wheel::pop()
+{
+    // take the first lookup from the due list
+    auto *lookup = _due.pop_front();
+
+    // update bookkeeping
+    if (lookup && lookup->_active) _active -= 1;
+
+    // expose the lookup
+    return lookup;
+}
+
+/**
+ *  Number of seconds until the next lookup is due
+ *  @param  now         current time
+ *  @return double      delay in seconds (or < 0 if the wheel is empty)
+ */
+double Wheel::next(double now) const
+{
+    // if entries are due, we must run right away
+    if (!_due.empty()) return 0.0;
+
+    // if there is nothing in the wheel there is no need to run at all
+    if (_size == 0) return -1.0;
+
+    // the first tick at which something happens
+    uint64_t best = UINT64_MAX;
+
+    // check all levels
+    for (size_t level = 0; level < LEVELS; ++level)
+    {
+        // skip empty levels
+        if (_occupied[level] == 0) continue;
+
+        // the number of bits that are covered by the levels below
+        size_t shift = level * BITS;
+
+        // the current position on this level
+        size_t current = (_tick >> shift) & (SLOTS - 1);
+
+        // rotate the bitmap so that the current position is at bit zero
+        uint64_t rotated = current == 0 ? _occupied[level] : (_occupied[level] >> current) | (_occupied[level] << (SLOTS - current));
+
+        // on the higher levels the current slot was already cascaded, unless we're exactly at the boundary
+        if (level > 0 && (_tick & ((uint64_t(1) << shift) - 1)) != 0) rotated &= ~uint64_t(1);
+
+        // number of slots until the first occupied slot (the slot at the current position wraps around)
+        uint64_t distance = rotated == 0 ? SLOTS : __builtin_ctzll(rotated);
+
+        // the tick at which this slot is processed
+        best = std::min(best, ((_tick >> shift) + distance) << shift);
+    }
+
+    // convert to a delay
+    return std::max(best / 1000.0 - now, 0.0);
+}
+
+/**
+ *  End of namespace
+ */
+}
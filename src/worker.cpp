@@ -0,0 +1,215 @@
+/**
+ *  Worker.cpp
+ *
+ *  Implementation file for the Worker class
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include "worker.h"
+#include "../include/dnscpp/context.h"
+#include "../include/dnscpp/epollloop.h"
+#include <pthread.h>
+#include <sched.h>
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Handler that passes the result of a lookup back to the thread of the caller
+ */
+class Relay : public Handler
+{
+private:
+    /**
+     *  The worker that runs the lookup
+     *  @var Worker
+     */
+    Worker *_worker;
+
+    /**
+     *  The ticket that gets the result
+     *  @var Ticket
+     */
+    Ticket *_ticket;
+
+    /**
+     *  The inbox to which the result is posted
+     *  @var std::shared_ptr
+     */
+    std::shared_ptr<Inbox> _inbox;
+
+    /**
+     *  Post the result and destruct the relay
+     *  @param  status      what happened to the lookup
+     *  @param  response    the response (if there was one)
+     */
+    void post(Result::Status status, const Response *response = nullptr)
+    {
+        // construct the result
+        Result result{ _ticket, status, {} };
+
+        // the response is copied, because the buffer is gone when the caller gets it
+        if (response) result.response.assign(response->data(), response->data() + response->size());
+
+        // pass it on
+        _inbox->post(_worker->_index, std::move(result));
+
+        // the relay is no longer needed
+        delete this;
+    }
+
+    /**
+     *  Methods that are called by the context
+     *  @param  operation   the operation that finished
+     *  @param  response    the received response
+     */
+    virtual void onReceived(const Operation *operation, const Response &response) override { post(Result::received, &response); }
+    virtual void onTimeout(const Operation *operation) override { post(Result::timeout); }
+    virtual void onExpired(const Operation *operation) override { post(Result::expired); }
+    virtual void onCancelled(const Operation *operation) override { post(Result::cancelled); }
+
+public:
+    /**
+     *  Constructor
+     *  @param  worker      the worker that runs the lookup
+     *  @param  job         the lookup (the relay takes over its inbox)
+     */
+    Relay(Worker *worker, Job &job) : _worker(worker), _ticket(job.ticket), _inbox(std::move(job.inbox))
+    {
+        // the relay is in use
+        _worker->_relays.insert(this);
+    }
+
+    /**
+     *  Report that the lookup could not be started (this destructs the relay)
+     */
+    void fail() { post(Result::cancelled); }
+
+    /**
+     *  Destructor
+     */
+    virtual ~Relay()
+    {
+        // the relay is no longer in use
+        _worker->_relays.erase(this);
+    }
+};
+
+/**
+ *  Constructor
+ *  @param  index       index of the worker in the pool
+ *  @param  defaults    should the context load the system settings?
+ *  @param  setup       function to configure the context (called in the worker thread)
+ *  @param  cpu         the cpu to run on (or -1 to run anywhere)
+ *  @throws std::system_error
+ */
+Worker::Worker(size_t index, bool defaults, const std::function<void(Context *)> &setup, int cpu) : _index(index)
+{
+    // the promise that the thread fulfills when it is ready
+    std::promise<void> started;
+
+    // we wait for it later
+    _started = started.get_future();
+
+    // start the thread
+    _thread = std::thread(&Worker::run, this, defaults, setup, cpu, std::move(started));
+}
+
+/**
+ *  Destructor
+ */
+Worker::~Worker()
+{
+    // tell the thread to stop, and wait for it
+    _jobs.post(Job{ nullptr, nullptr, std::string(), ns_t_invalid, Bits(), true }); _thread.join();
+}
+
+/**
+ *  The function that runs in the thread
+ *  @param  defaults    should the context load the system settings?
+ *  @param  setup       function to configure the context
+ *  @param  cpu         the cpu to run on (or -1 to run anywhere)
+ *  @param  started     promise that is fulfilled when the context is ready
+ */
+void Worker::run(bool defaults, const std::function<void(Context *)> &setup, int cpu, std::promise<void> started)
+{
+    // bind the thread to its cpu
+    if (cpu >= 0) { cpu_set_t set; CPU_ZERO(&set); CPU_SET(cpu, &set); pthread_setaffinity_np(pthread_self(), sizeof(set), &set); }
+
+    // the event loop and the context of this thread (the loop outlives the context)
+    std::unique_ptr<EpollLoop> loop;
+    std::unique_ptr<Context> context;
+
+    // creating the context or configuring it can fail (an exception must not escape from the thread)
+    try
+    {
+        // create the loop and the context
+        loop.reset(new EpollLoop()); context.reset(new Context(loop.get(), defaults));
+
+        // let userspace configure the context
+        if (setup) setup(context.get());
+    }
+    catch (...)
+    {
+        // pass the exception to the constructor of the pool (the thread stops)
+        started.set_exception(std::current_exception()); return;
+    }
+
+    // the context can now be used
+    _context = context.get();
+
+    // we want to be notified when lookups are posted
+    void *identifier = loop->add(_jobs.fd(), 1, this);
+
+    // the pool may now start passing lookups
+    started.set_value();
+
+    // run the loop until the worker is stopped
+    while (!_stop) loop->step();
+
+    // we no longer want to be notified
+    loop->remove(identifier, _jobs.fd(), this);
+
+    // the context is destructed
+    _context = nullptr; context.reset();
+
+    // the lookups that were still running are gone, and so are their results (the channels take care of the tickets)
+    while (!_relays.empty()) delete *_relays.begin();
+}
+
+/**
+ *  Method that is called when jobs were posted
+ */
+void Worker::notify()
+{
+    // take out the jobs
+    _buffer.clear(); _jobs.take(_buffer);
+
+    // start all lookups
+    for (auto &job : _buffer)
+    {
+        // a job without a ticket means that we should stop
+        if (job.ticket == nullptr) { _stop = true; continue; }
+
+        // the handler that passes the result back
+        auto *relay = new Relay(this, job);
+
+        // start the lookup
+        auto *operation = job.defaults ? _context->query(job.domain.data(), job.type, relay) : _context->query(job.domain.data(), job.type, job.bits, relay);
+
+        // if the lookup could not be started, the ticket gets cancelled
+        if (operation == nullptr) relay->fail();
+    }
+}
+
+/**
+ *  End of namespace
+ */
+}
+
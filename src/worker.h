@@ -0,0 +1,205 @@
+/**
+ *  Worker.h
+ *
+ *  A thread of the resolver pool. Each worker has its own event loop and its
+ *  own context, and it runs the lookups that the channels pass to it. The
+ *  results are put in the inbox of the channel that submitted the lookup, in
+ *  a queue that only this worker writes to and only the thread of the channel
+ *  reads from, after which that thread is woken up.
+ *
+ *  This is an internal class that is not accessible from user space.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <string>
+#include <thread>
+#include <future>
+#include <functional>
+#include <unordered_set>
+#include "../include/dnscpp/monitor.h"
+#include "../include/dnscpp/bits.h"
+#include "mailbox.h"
+#include "inbox.h"
+
+/**
+ *  Begin of namespace
+ */
+namespace DNS {
+
+/**
+ *  Forward declarations
+ */
+class Context;
+class Relay;
+
+/**
+ *  A lookup, as it is passed from the caller to the worker thread
+ */
+struct Job
+{
+    /**
+     *  The ticket that gets the result (nullptr to stop the worker)
+     *  @var Ticket
+     */
+    Ticket *ticket;
+
+    /**
+     *  The inbox of the channel that gets the result
+     *  @var std::shared_ptr
+     */
+    std::shared_ptr<Inbox> inbox;
+
+    /**
+     *  The domain to look up
+     *  @var std::string
+     */
+    std::string domain;
+
+    /**
+     *  Type of records to look for
+     *  @var ns_type
+     */
+    ns_type type;
+
+    /**
+     *  The bits to include in the request
+     *  @var Bits
+     */
+    Bits bits;
+
+    /**
+     *  Should the default bits of the context be used instead?
+     *  @var bool
+     */
+    bool defaults;
+};
+
+/**
+ *  Class definition
+ */
+class Worker : private Monitor
+{
+private:
+    /**
+     *  The lookups that the worker should run
+     *  @var Mailbox
+     */
+    Mailbox<Job> _jobs;
+
+    /**
+     *  Index of the worker in the pool (and of its queue in the inboxes)
+     *  @var size_t
+     */
+    const size_t _index;
+
+    /**
+     *  Should the thread stop? (only accessed from the worker thread)
+     *  @var bool
+     */
+    bool _stop = false;
+
+    /**
+     *  The context (only accessed from the worker thread, while it runs)
+     *  @var Context
+     */
+    Context *_context = nullptr;
+
+    /**
+     *  The handlers of the lookups that are running (only accessed from the worker thread)
+     *  @var std::unordered_set
+     */
+    std::unordered_set<Relay*> _relays;
+
+    /**
+     *  Buffer for the jobs that are taken out of the mailbox
+     *  @var std::vector
+     */
+    std::vector<Job> _buffer;
+
+    /**
+     *  Becomes ready when the thread created its context (or failed to do so)
+     *  @var std::future
+     */
+    std::future<void> _started;
+
+    /**
+     *  The thread
+     *  @var std::thread
+     */
+    std::thread _thread;
+
+    /**
+     *  Method that is called when jobs were posted
+     */
+    virtual void notify() override;
+
+    /**
+     *  The function that runs in the thread
+     *  @param  defaults    should the context load the system settings?
+     *  @param  setup       function to configure the context
+     *  @param  cpu         the cpu to run on (or -1 to run anywhere)
+     *  @param  started     promise that is fulfilled when the context is ready (or that gets the exception when it failed)
+     */
+    void run(bool defaults, const std::function<void(Context *)> &setup, int cpu, std::promise<void> started);
+
+    /**
+     *  The relay keeps track of itself in the worker
+     */
+    friend class Relay;
+
+public:
+    /**
+     *  Constructor
+     *  This starts the thread, but it does not wait for it, call wait() for that
+     *  @param  index       index of the worker in the pool
+     *  @param  defaults    should the context load the system settings?
+     *  @param  setup       function to configure the context (called in the worker thread)
+     *  @param  cpu         the cpu to run on (or -1 to run anywhere)
+     *  @throws std::system_error
+     */
+    Worker(size_t index, bool defaults, const std::function<void(Context *)> &setup, int cpu);
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    Worker(const Worker &that) = delete;
+
+    /**
+     *  Destructor (this stops the thread)
+     */
+    virtual ~Worker();
+
+    /**
+     *  Wait until the thread created and configured its context (this should be called once)
+     *  @throws the exception of the thread, when the context could not be created or configured (the thread has stopped then)
+     */
+    void wait() { _started.get(); }
+
+    /**
+     *  Index of the worker in the pool
+     *  @return size_t
+     */
+    size_t index() const { return _index; }
+
+    /**
+     *  Pass a lookup to the worker (this can be called from any thread)
+     *  @param  job         the lookup to run
+     */
+    void post(Job &&job) { _jobs.post(std::move(job)); }
+};
+
+/**
+ *  End of namespace
+ */
+}
+
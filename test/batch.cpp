@@ -0,0 +1,166 @@
+/**
+ *  Batch.cpp
+ *
+ *  Test-program for batches: all queries in a batch must be reported to
+ *  their own handler, and the completion callback must be called exactly
+ *  once, after the last handler, whatever the queries ended with (also
+ *  when they were invalid or cancelled).
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "server.h"
+#include "outcome.h"
+
+/**
+ *  Check a batch with queries that end in different ways
+ *  @param  context     the context
+ *  @param  loop        the event loop
+ */
+static void mixed(DNS::Context &context, DNS::EpollLoop &loop)
+{
+    // number of names that are resolved
+    const size_t count = 40;
+
+    // the names (they must stay valid until the batch is submitted), and the handlers
+    std::vector<std::string> names;
+    std::vector<Outcome> outcomes(count + 3);
+
+    // the names that are resolved
+    for (size_t i = 0; i < count; ++i) names.push_back("host" + std::to_string(i) + ".example.com");
+
+    // a name that does not exist, one that is not answered, and a name that is invalid (the label is too long)
+    names.push_back("nx1.example.com");
+    names.push_back("drop1.example.com");
+    names.push_back(std::string(70, 'x') + ".example.com");
+
+    // the unanswered query gives up soon
+    DNS::Options options; options.deadline(DNS::Now() + 0.3);
+
+    // fill the batch
+    DNS::Batch batch(names.size());
+    for (size_t i = 0; i < names.size(); ++i) batch.add(names[i].c_str(), ns_t_a, DNS::Bits(), i == count + 1 ? options : DNS::Options(), &outcomes[i]);
+
+    // number of calls to the completion callback, and the number of handlers that were called by then
+    size_t completed = 0, reported = 0;
+
+    // install the callback
+    batch.onCompleted([&]() {
+
+        // count the call, and the handlers that were called before it
+        completed += 1;
+        for (auto &outcome : outcomes) reported += outcome.done() ? 1 : 0;
+    });
+
+    // submit the batch: all queries but the invalid one are started
+    CHECK(context.query(batch) == names.size() - 1);
+    CHECK(batch[count + 2].operation == nullptr);
+    for (size_t i = 0; i < count + 2; ++i) CHECK(batch[i].operation != nullptr);
+
+    // the batch is not completed yet
+    CHECK(completed == 0);
+
+    // wait for the callback
+    CHECK(settle(loop, [&]() { return completed > 0; }));
+
+    // all valid queries were reported before the callback
+    CHECK(reported == count + 2);
+
+    // the queries ended the way they should
+    for (size_t i = 0; i < count; ++i) CHECK(outcomes[i].kind() == Outcome::resolved && outcomes[i].address() == TestServer::address(i));
+    CHECK(outcomes[count].kind() == Outcome::failure && outcomes[count].rcode() == ns_r_nxdomain);
+    CHECK(outcomes[count + 1].kind() == Outcome::expired);
+    CHECK(!outcomes[count + 2].done());
+
+    // the callback is not called again
+    settle(loop, []() { return false; }, 0.2);
+    CHECK(completed == 1);
+}
+
+/**
+ *  Check a batch whose queries are cancelled
+ *  @param  context     the context
+ *  @param  loop        the event loop
+ */
+static void cancelled(DNS::Context &context, DNS::EpollLoop &loop)
+{
+    // the handlers
+    Outcome first, second;
+
+    // a batch with queries that are never answered
+    DNS::Batch batch;
+    batch.add("drop2.example.com", ns_t_a, DNS::Bits(), &first);
+    batch.add("drop3.example.com", ns_t_a, DNS::Bits(), &second);
+
+    // number of calls to the completion callback
+    size_t completed = 0;
+    batch.onCompleted([&]() { completed += 1; });
+
+    // submit the batch
+    CHECK(context.query(batch) == 2);
+
+    // cancel one of the queries, the batch is not done yet
+    batch[0].operation->cancel();
+    CHECK(first.kind() == Outcome::cancelled);
+    settle(loop, []() { return false; }, 0.1);
+    CHECK(completed == 0);
+
+    // cancel the other one, now the batch is done
+    batch[1].operation->cancel();
+    CHECK(second.kind() == Outcome::cancelled);
+    CHECK(settle(loop, [&]() { return completed > 0; }, 1.0));
+    CHECK(completed == 1);
+}
+
+/**
+ *  Check a batch of which no query could be started
+ *  @param  context     the context
+ */
+static void invalid(DNS::Context &context)
+{
+    // a batch with an invalid name only
+    std::string name = std::string(70, 'x') + ".example.com";
+    Outcome outcome;
+    DNS::Batch batch;
+    batch.add(name.c_str(), ns_t_a, DNS::Bits(), &outcome);
+
+    // number of calls to the completion callback
+    size_t completed = 0;
+    batch.onCompleted([&]() { completed += 1; });
+
+    // nothing is started, and the callback is called right away
+    CHECK(context.query(batch) == 0);
+    CHECK(completed == 1);
+    CHECK(!outcome.done());
+}
+
+/**
+ *  Main procedure
+ *  @return int
+ */
+int main()
+{
+    // the nameserver, and an event loop
+    TestServer server;
+    DNS::EpollLoop loop;
+
+    // a context that only talks to the test nameserver
+    DNS::Context context(&loop, false);
+    context.nameserver(DNS::Ip("127.0.0.1"), server.port());
+
+    // run the tests
+    mixed(context, loop);
+    cancelled(context, loop);
+    invalid(context);
+
+    // done
+    std::cout << "batch: ok" << std::endl;
+    return 0;
+}
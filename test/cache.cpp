@@ -0,0 +1,162 @@
+/**
+ *  Cache.cpp
+ *
+ *  Test-program for the cache of responses: the TTLs of the responses must
+ *  be decremented by the time they spent in the cache, they must disappear
+ *  when they expire, and a scan of names that are used only once must not
+ *  push the names that are used again out of the cache (S3-FIFO), not even
+ *  a name that comes back shortly after it was evicted (the ghost queue).
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "server.h"
+
+/**
+ *  Store the response for a name in the cache
+ *  @param  cache       the cache
+ *  @param  name        the name (the response is stored under this key)
+ *  @param  now         current time
+ *  @return bool        was it stored?
+ */
+static bool store(DNS::Cache &cache, const std::string &name, double now)
+{
+    // create the response that the test nameserver would send
+    unsigned char buffer[512];
+    size_t size = TestServer::respond(name.c_str(), buffer);
+
+    // store it
+    return cache.insert(name, DNS::Response(buffer, size), now);
+}
+
+/**
+ *  Check whether a name is in the cache (this counts as a use of the name)
+ *  @param  cache       the cache
+ *  @param  name        the name
+ *  @param  now         current time
+ *  @return bool
+ */
+static bool cached(DNS::Cache &cache, const std::string &name, double now)
+{
+    // the buffer for the response
+    std::vector<unsigned char> result;
+
+    // look it up
+    return cache.lookup(name, now, result);
+}
+
+/**
+ *  Check that the TTLs are decremented, and that responses expire
+ */
+static void ttl()
+{
+    // a cache that is big enough
+    DNS::Cache cache(1024 * 1024);
+
+    // the current time
+    double now = DNS::Now();
+
+    // store a response (the test nameserver uses a TTL of 300 seconds)
+    CHECK(store(cache, "host1.example.com", now));
+
+    // look it up a little later
+    std::vector<unsigned char> result; double remaining = 0.0;
+    CHECK(cache.lookup("host1.example.com", now + 100.0, result, &remaining));
+
+    // parse the response
+    DNS::Response response(result.data(), result.size());
+    DNS::Answer record(response, 0);
+
+    // the TTL was decremented, and it tells how much of the TTL is left
+    CHECK(record.ttl() == 200);
+    CHECK(remaining > 0.66 && remaining < 0.67);
+
+    // the address is still the same
+    CHECK(DNS::A(response, record).ip() == DNS::Ip(TestServer::address(1).c_str()));
+
+    // it is gone when the TTL is over
+    CHECK(!cached(cache, "host1.example.com", now + 300.5));
+
+    // responses that were never stored are not found either
+    CHECK(!cached(cache, "host2.example.com", now));
+
+    // one hit and two misses
+    CHECK(cache.hits() == 1 && cache.misses() == 2);
+}
+
+/**
+ *  Check that a scan does not push the popular names out of the cache
+ */
+static void scan()
+{
+    // the current time
+    double now = DNS::Now();
+
+    // find out how many bytes an entry takes (all names have the same length)
+    DNS::Cache measure(1024 * 1024);
+    store(measure, "host100000.example.com", now);
+    size_t entry = measure.bytes();
+
+    // a cache that holds a hundred entries
+    DNS::Cache cache(100 * entry);
+
+    // names that are used again after they were stored
+    for (size_t i = 0; i < 20; ++i) CHECK(store(cache, "host" + std::to_string(100000 + i) + ".example.com", now));
+    for (size_t i = 0; i < 20; ++i) CHECK(cached(cache, "host" + std::to_string(100000 + i) + ".example.com", now));
+
+    // a scan of names that are used only once
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        // store the name
+        CHECK(store(cache, "host" + std::to_string(200000 + i) + ".example.com", now));
+
+        // the cache never grows beyond its capacity
+        CHECK(cache.bytes() <= cache.capacity() && cache.size() <= 100);
+    }
+
+    // the popular names are still there
+    for (size_t i = 0; i < 20; ++i) CHECK(cached(cache, "host" + std::to_string(100000 + i) + ".example.com", now));
+
+    // the oldest names of the scan are not
+    CHECK(!cached(cache, "host200000.example.com", now));
+
+    // a name that is stored once more after it was evicted from the small queue
+    std::string ghost = "host201000.example.com";
+    CHECK(store(cache, ghost, now));
+
+    // another scan pushes it out (it was never used)
+    for (size_t i = 0; i < 100; ++i) store(cache, "host" + std::to_string(300000 + i) + ".example.com", now);
+    CHECK(!cached(cache, ghost, now));
+
+    // when it is stored again, it is remembered as a name that came back
+    CHECK(store(cache, ghost, now));
+
+    // so it survives the next scan
+    for (size_t i = 0; i < 1000; ++i) store(cache, "host" + std::to_string(400000 + i) + ".example.com", now);
+    CHECK(cached(cache, ghost, now));
+
+    // and so do the popular names
+    for (size_t i = 0; i < 20; ++i) CHECK(cached(cache, "host" + std::to_string(100000 + i) + ".example.com", now));
+}
+
+/**
+ *  Main procedure
+ *  @return int
+ */
+int main()
+{
+    // run the tests
+    ttl();
+    scan();
+
+    // done
+    std::cout << "cache: ok" << std::endl;
+    return 0;
+}
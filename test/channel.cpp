@@ -0,0 +1,162 @@
+/**
+ *  Channel.cpp
+ *
+ *  Test-program for channels: several threads submit queries to the same
+ *  resolver pool, each through its own channel. The program checks that
+ *  every query completes, that it gets the address that belongs to the name,
+ *  and that the result is reported in the thread that submitted the query.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <iostream>
+#include <thread>
+#include <string>
+#include <vector>
+#include "server.h"
+
+/**
+ *  Handler that checks the results of one thread
+ */
+class Checker : public DNS::Handler
+{
+private:
+    /**
+     *  The thread that submits the queries
+     *  @var std::thread::id
+     */
+    std::thread::id _thread = std::this_thread::get_id();
+
+    /**
+     *  Number of finished lookups, and the number with the right answer
+     *  @var size_t
+     */
+    size_t _finished = 0;
+    size_t _correct = 0;
+
+    /**
+     *  Method that is called when a valid, successful, response was received.
+     *  @param  operation       the operation that finished
+     *  @param  response        the received response
+     */
+    virtual void onResolved(const DNS::Operation *operation, const DNS::Response &response) override
+    {
+        // update counter
+        _finished += 1;
+
+        // the result must be reported in the thread that submitted the query
+        if (std::this_thread::get_id() != _thread || response.answers() != 1) return;
+
+        // parse the record
+        DNS::Answer record(response, 0);
+
+        // it should be an A record
+        if (record.type() != ns_t_a) return;
+
+        // the number in the name of the record ("host1234.example.com")
+        uint32_t number = std::stoul(record.name() + 4);
+
+        // compare the address
+        if (DNS::A(response, record).ip() == DNS::Ip(TestServer::address(number).c_str())) _correct += 1;
+    }
+
+    /**
+     *  Method that is called when a query could not be processed or answered.
+     *  @param  operation       the operation that finished
+     *  @param  rcode           the received rcode
+     */
+    virtual void onFailure(const DNS::Operation *operation, int rcode) override
+    {
+        // update counter
+        _finished += 1;
+    }
+
+public:
+    /**
+     *  Number of finished lookups
+     *  @return size_t
+     */
+    size_t finished() const { return _finished; }
+
+    /**
+     *  Number of lookups with the right answer
+     *  @return size_t
+     */
+    size_t correct() const { return _correct; }
+};
+
+/**
+ *  Submit queries from a thread, and wait for the results
+ *  @param  pool        the resolver pool
+ *  @param  first       number of the first name to look up
+ *  @param  count       number of queries
+ *  @param  correct     where the number of correct answers is stored
+ */
+static void submit(DNS::ResolverPool *pool, size_t first, size_t count, size_t *correct)
+{
+    // the event loop of this thread, and the channel to the pool
+    DNS::EpollLoop loop;
+    DNS::Channel channel(pool, &loop);
+
+    // handler for the lookups
+    Checker checker;
+
+    // start all queries (the names of the threads do not overlap)
+    for (size_t i = first; i < first + count; ++i) channel.query(("host" + std::to_string(i) + ".example.com").c_str(), ns_t_a, &checker);
+
+    // run the loop until all results are in
+    while (checker.finished() < count) loop.step(1.0);
+
+    // report the result
+    *correct = checker.correct();
+}
+
+/**
+ *  Main procedure
+ *  @return int
+ */
+int main()
+{
+    // the nameserver
+    TestServer server(2);
+
+    // the event loop of the main thread (the pool needs one, but the results come in via the channels)
+    DNS::EpollLoop loop;
+
+    // the pool, with every context talking to the test nameserver
+    DNS::ResolverPool pool(&loop, 4, false, [&server](DNS::Context *context) {
+
+        // use the test nameserver
+        context->nameserver(DNS::Ip("127.0.0.1"), server.port());
+
+        // allow many lookups at the same time
+        context->capacity(1000);
+    });
+
+    // number of submitting threads, and the number of queries per thread
+    const size_t threads = 8, count = 5000;
+
+    // the number of correct answers per thread
+    std::vector<size_t> correct(threads, 0);
+
+    // start the threads
+    std::vector<std::thread> submitters;
+    for (size_t i = 0; i < threads; ++i) submitters.emplace_back(submit, &pool, i * count, count, &correct[i]);
+
+    // wait for them to finish
+    for (auto &thread : submitters) thread.join();
+
+    // every thread should have gotten all its answers right
+    for (size_t i = 0; i < threads; ++i) CHECK(correct[i] == count);
+
+    // every name went to the nameserver (at least once, there may have been retries)
+    CHECK(server.total() >= threads * count);
+
+    // done
+    std::cout << "channel: ok" << std::endl;
+    return 0;
+}
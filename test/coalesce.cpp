@@ -0,0 +1,125 @@
+/**
+ *  Coalesce.cpp
+ *
+ *  Test-program for sharing lookups: identical queries that are started
+ *  while a lookup is in progress must share its single upstream exchange,
+ *  each of them must still be reported to its own handler (and can be
+ *  cancelled on its own), and a waiting lookup that is shared by a query
+ *  of a higher class must move up to that class.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "server.h"
+#include "outcome.h"
+
+/**
+ *  Check that identical queries share a single exchange
+ *  @param  server      the test nameserver
+ *  @param  context     the context
+ *  @param  loop        the event loop
+ */
+static void share(TestServer &server, DNS::Context &context, DNS::EpollLoop &loop)
+{
+    // number of identical queries
+    const size_t count = 20;
+
+    // the handlers, and the operations
+    std::vector<Outcome> outcomes(count);
+    std::vector<DNS::Operation *> operations;
+
+    // start the identical queries
+    for (auto &outcome : outcomes) operations.push_back(context.query("host5.example.com", ns_t_a, &outcome));
+
+    // every query got its own operation
+    for (size_t i = 0; i < count; ++i) for (size_t j = i + 1; j < count; ++j) CHECK(operations[i] != operations[j]);
+
+    // cancel the first query (the one that started the lookup) and one of the others
+    operations[0]->cancel();
+    operations[7]->cancel();
+
+    // those are reported right away
+    CHECK(outcomes[0].kind() == Outcome::cancelled);
+    CHECK(outcomes[7].kind() == Outcome::cancelled);
+
+    // wait until all the others are done
+    CHECK(settle(loop, [&]() { for (auto &outcome : outcomes) if (!outcome.done()) return false; return true; }));
+
+    // the others all got the answer
+    for (size_t i = 0; i < count; ++i) if (i != 0 && i != 7) CHECK(outcomes[i].kind() == Outcome::resolved && outcomes[i].address() == TestServer::address(5));
+
+    // every handler was called once
+    for (auto &outcome : outcomes) CHECK(outcome.calls() == 1);
+
+    // a single datagram was sent for all of them
+    CHECK(server.count("host5.example.com") == 1);
+}
+
+/**
+ *  Check that a waiting lookup is promoted when a query of a higher class shares it
+ *  @param  server      the test nameserver
+ *  @param  context     the context
+ *  @param  loop        the event loop
+ */
+static void promote(TestServer &server, DNS::Context &context, DNS::EpollLoop &loop)
+{
+    // a query that keeps the only slot of the context busy for a while (it has a deadline, so it is not shared)
+    DNS::Options blocker; blocker.deadline(DNS::Now() + 0.3);
+    Outcome blocked;
+    context.query("drop1.example.com", ns_t_a, blocker, &blocked);
+
+    // bulk queries that have to wait, the last one is shared by a normal query later
+    std::vector<Outcome> bulk(6);
+    for (size_t i = 0; i < bulk.size(); ++i) context.query(("host" + std::to_string(100 + i) + ".example.com").c_str(), ns_t_a, DNS::Options(DNS::Priority::bulk), &bulk[i]);
+
+    // the normal query for the same name as the last bulk query
+    Outcome normal;
+    context.query("host105.example.com", ns_t_a, DNS::Options(DNS::Priority::normal), &normal);
+
+    // wait until everything is done
+    CHECK(settle(loop, [&]() { for (auto &outcome : bulk) if (!outcome.done()) return false; return normal.done() && blocked.done(); }));
+
+    // everything got its answer
+    CHECK(blocked.kind() == Outcome::expired);
+    for (size_t i = 0; i < bulk.size(); ++i) CHECK(bulk[i].kind() == Outcome::resolved && bulk[i].address() == TestServer::address(100 + i));
+    CHECK(normal.kind() == Outcome::resolved && normal.address() == TestServer::address(105));
+
+    // the shared lookup went out once, and before the bulk queries that were submitted earlier
+    CHECK(server.count("host105.example.com") == 1);
+    for (size_t i = 0; i < 5; ++i) CHECK(server.position("host105.example.com") < server.position("host" + std::to_string(100 + i) + ".example.com"));
+}
+
+/**
+ *  Main procedure
+ *  @return int
+ */
+int main()
+{
+    // the nameserver, and an event loop
+    TestServer server;
+    DNS::EpollLoop loop;
+
+    // a context that only talks to the test nameserver, without caches (so that every lookup goes to the network)
+    DNS::Context context(&loop, false);
+    context.nameserver(DNS::Ip("127.0.0.1"), server.port());
+    context.cache(0);
+    context.negativecache(0);
+
+    // one lookup at a time, so that the others have to wait in their class
+    context.capacity(1);
+
+    // run the tests
+    share(server, context, loop);
+    promote(server, context, loop);
+
+    // done
+    std::cout << "coalesce: ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ *  Deadline.cpp
+ *
+ *  Test-program for per-operation deadlines and attempts: a query that is
+ *  not answered must be given up (with onExpired()) when its own deadline
+ *  passes, and not when the timeout of the context ends much later, and
+ *  an operation never sends more datagrams than its own max allows.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <iostream>
+#include "server.h"
+#include "outcome.h"
+
+/**
+ *  Main procedure
+ *  @return int
+ */
+int main()
+{
+    // the nameserver, and an event loop
+    TestServer server;
+    DNS::EpollLoop loop;
+
+    // a context that only talks to the test nameserver, with a long timeout and many attempts
+    DNS::Context context(&loop, false);
+    context.nameserver(DNS::Ip("127.0.0.1"), server.port());
+    context.timeout(5.0);
+    context.interval(0.1);
+    context.attempts(10);
+
+    // the start time
+    double start = DNS::Now();
+
+    // a query that is never answered, with a deadline that is much sooner than the timeout
+    DNS::Options short_deadline; short_deadline.deadline(start + 0.3);
+    Outcome dropped;
+    CHECK(context.query("drop1.example.com", ns_t_a, short_deadline, &dropped) != nullptr);
+
+    // a query that is never answered, that may only send a single datagram
+    DNS::Options single; single.attempts(1); single.deadline(start + 0.6);
+    Outcome once;
+    CHECK(context.query("drop2.example.com", ns_t_a, single, &once) != nullptr);
+
+    // a query that is answered well before its deadline
+    DNS::Options long_deadline; long_deadline.deadline(start + 2.0);
+    Outcome answered;
+    CHECK(context.query("host7.example.com", ns_t_a, long_deadline, &answered) != nullptr);
+
+    // wait until all of them are done
+    CHECK(settle(loop, [&]() { return dropped.done() && once.done() && answered.done(); }));
+
+    // the answered query was resolved with the right address
+    CHECK(answered.kind() == Outcome::resolved && answered.address() == TestServer::address(7));
+
+    // the unanswered query expired at its deadline (not before it, and not at the end of the timeout)
+    CHECK(dropped.kind() == Outcome::expired);
+    CHECK(dropped.time() >= start + 0.3 && dropped.time() < start + 1.0);
+
+    // it was given up before it used all the attempts of the context
+    CHECK(server.count("drop1.example.com") >= 1 && server.count("drop1.example.com") < 10);
+
+    // the query with a single attempt sent a single datagram, and it expired too
+    CHECK(once.kind() == Outcome::expired);
+    CHECK(server.count("drop2.example.com") == 1);
+
+    // every handler was called exactly once
+    CHECK(dropped.calls() == 1 && once.calls() == 1 && answered.calls() == 1);
+
+    // done
+    std::cout << "deadline: ok" << std::endl;
+    return 0;
+}
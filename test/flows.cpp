@@ -0,0 +1,154 @@
+/**
+ *  Flows.cpp
+ *
+ *  Test-program for the per-tenant queues of lookups that wait to be
+ *  admitted: a tenant with a large backlog must not starve a tenant that
+ *  only has a few lookups, the lookups of a tenant keep their order, and a
+ *  tenant whose lookups cannot be admitted must not block the others.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <dnscpp/flows.h>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "server.h"
+
+/**
+ *  Lookup that does nothing, it is only stored in the flows
+ */
+class DummyLookup : public DNS::Lookup
+{
+public:
+    /**
+     *  Constructor
+     *  @param  tenant      the tenant of the lookup
+     */
+    DummyLookup(uint64_t tenant) : DNS::Lookup(nullptr, DNS::Options(DNS::Priority::normal, tenant), nullptr, ns_o_query, "example.com", ns_t_a, DNS::Bits()) {}
+
+    /**
+     *  Destructor
+     */
+    virtual ~DummyLookup() = default;
+
+    /**
+     *  Methods that the flows never call
+     */
+    virtual size_t credits() const override { return 1; }
+    virtual double delay(double now) const override { return 0.0; }
+    virtual bool admit() override { return true; }
+    virtual bool execute(double now) override { return false; }
+};
+
+/**
+ *  Create lookups for a tenant and add them to the flows
+ *  @param  flows       the flows
+ *  @param  lookups     where the lookups are stored
+ *  @param  tenant      the tenant
+ *  @param  count       number of lookups
+ */
+static void add(DNS::Flows &flows, std::vector<std::unique_ptr<DummyLookup>> &lookups, uint64_t tenant, size_t count)
+{
+    // create and add the lookups
+    for (size_t i = 0; i < count; ++i) { lookups.emplace_back(new DummyLookup(tenant)); flows.push_back(lookups.back().get()); }
+}
+
+/**
+ *  Check that a small tenant is served while a big tenant has a large backlog
+ */
+static void fairness()
+{
+    // the flows, and the lookups of a big tenant (1) and a small tenant (2)
+    DNS::Flows flows;
+    std::vector<std::unique_ptr<DummyLookup>> big, small;
+
+    // the big tenant was first, and has a lot more lookups
+    add(flows, big, 1, 1000);
+    add(flows, small, 2, 8);
+    CHECK(flows.size() == 1008);
+
+    // everything can be admitted
+    auto always = [](DNS::Lookup *lookup) { return true; };
+
+    // number of lookups taken out of each tenant
+    size_t bigs = 0, smalls = 0;
+
+    // the small tenant only has to wait for a few turns of the big tenant
+    for (size_t i = 0; i < 16; ++i)
+    {
+        // take out a lookup
+        auto *lookup = flows.pop_front(always);
+
+        // the lookups of each tenant come out in the order in which they were added
+        if (lookup->options().tenant() == 1) CHECK(lookup == big[bigs++].get());
+        else CHECK(lookup == small[smalls++].get());
+    }
+
+    // the tenants got an equal share
+    CHECK(bigs == 8 && smalls == 8);
+
+    // the rest belongs to the big tenant
+    while (auto *lookup = flows.pop_front(always)) CHECK(lookup == big[bigs++].get());
+    CHECK(bigs == 1000 && flows.empty());
+}
+
+/**
+ *  Check that a tenant whose lookups cannot be admitted does not block the others
+ */
+static void blocked()
+{
+    // the flows, and the lookups of three tenants
+    DNS::Flows flows;
+    std::vector<std::unique_ptr<DummyLookup>> lookups;
+
+    // tenant 1 is first in line
+    add(flows, lookups, 1, 10);
+    add(flows, lookups, 2, 10);
+    add(flows, lookups, 3, 10);
+
+    // tenant 1 is at its capacity
+    auto capped = [](DNS::Lookup *lookup) { return lookup->options().tenant() != 1; };
+
+    // the other tenants are served
+    for (size_t i = 0; i < 20; ++i)
+    {
+        // take out a lookup
+        auto *lookup = flows.pop_front(capped);
+
+        // it must be there, but it cannot come from the blocked tenant
+        CHECK(lookup != nullptr && lookup->options().tenant() != 1);
+    }
+
+    // only the lookups of the blocked tenant are left, and they cannot be taken out
+    CHECK(flows.size() == 10);
+    CHECK(flows.pop_front(capped) == nullptr);
+
+    // lookups can be removed from a flow, also the last one of a flow
+    CHECK(flows.remove(lookups[3].get()));
+    CHECK(!flows.remove(lookups[3].get()));
+    for (size_t i = 0; i < 10; ++i) if (i != 3) CHECK(flows.remove(lookups[i].get()));
+
+    // nothing is left
+    CHECK(flows.empty());
+    CHECK(flows.pop_front(capped) == nullptr);
+}
+
+/**
+ *  Main procedure
+ *  @return int
+ */
+int main()
+{
+    // run the tests
+    fairness();
+    blocked();
+
+    // done
+    std::cout << "flows: ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,116 @@
+/**
+ *  Negative.cpp
+ *
+ *  Test-program for the cache of negative responses (RFC 2308): NXDOMAIN
+ *  and NODATA responses are only cached when they hold a SOA record, for
+ *  no longer than the minimum field of that record, and a NXDOMAIN response
+ *  is used for all record types of the name.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "server.h"
+#include "outcome.h"
+
+/**
+ *  Check the rules for storing negative responses
+ */
+static void rules()
+{
+    // a cache that is big enough, and the current time
+    DNS::Cache cache(1024 * 1024);
+    double now = DNS::Now();
+
+    // the NXDOMAIN response of the test nameserver (with a SOA record with a TTL of 300, and a minimum of 60)
+    unsigned char buffer[512];
+    size_t size = TestServer::respond("nx1.example.com", buffer);
+
+    // it is stored
+    CHECK(cache.insert("nx1", DNS::Response(buffer, size), now));
+
+    // it can be used a little later, but the TTL of the SOA record is limited by the minimum field
+    std::vector<unsigned char> result;
+    CHECK(cache.lookup("nx1", now + 30.0, result));
+    DNS::Response response(result.data(), result.size());
+    CHECK(response.rcode() == ns_r_nxdomain && response.answers() == 0 && response.nameservers() == 1);
+    CHECK(DNS::Record(response, ns_s_ns, 0).ttl() <= 30);
+
+    // it expires after the minimum of the SOA record (long before the TTL of the SOA record itself)
+    CHECK(!cache.lookup("nx1", now + 61.0, result));
+
+    // the NODATA response is stored the same way
+    size = TestServer::respond("nodata1.example.com", buffer);
+    CHECK(cache.insert("nodata1", DNS::Response(buffer, size), now));
+    CHECK(cache.lookup("nodata1", now + 59.0, result));
+    CHECK(!cache.lookup("nodata1", now + 61.0, result));
+
+    // without the SOA record (only the header and the question are left) the response is not stored
+    size = TestServer::respond("nx2.example.com", buffer);
+    buffer[9] = 0; size -= 34;
+    CHECK(!cache.insert("nx2", DNS::Response(buffer, size), now));
+    CHECK(!cache.lookup("nx2", now, result));
+}
+
+/**
+ *  Check that a context answers repeated negative lookups from the cache
+ */
+static void repeat()
+{
+    // the nameserver, and an event loop
+    TestServer server;
+    DNS::EpollLoop loop;
+
+    // a context that only talks to the test nameserver
+    DNS::Context context(&loop, false);
+    context.nameserver(DNS::Ip("127.0.0.1"), server.port());
+    context.cache(1024 * 1024);
+    context.negativecache(1024 * 1024);
+
+    // look up a name that does not exist, and one that has no records
+    Outcome nx, nodata;
+    context.query("nx1.example.com", ns_t_a, &nx);
+    context.query("nodata1.example.com", ns_t_a, &nodata);
+    CHECK(settle(loop, [&]() { return nx.done() && nodata.done(); }));
+
+    // they failed, or had no answer
+    CHECK(nx.kind() == Outcome::failure && nx.rcode() == ns_r_nxdomain);
+    CHECK(nodata.kind() == Outcome::resolved && nodata.address().empty());
+
+    // look them up again, also for another record type (a name that does not exist has no records of any type)
+    Outcome nx2, nxaaaa, nodata2;
+    context.query("nx1.example.com", ns_t_a, &nx2);
+    context.query("nx1.example.com", ns_t_aaaa, &nxaaaa);
+    context.query("nodata1.example.com", ns_t_a, &nodata2);
+    CHECK(settle(loop, [&]() { return nx2.done() && nxaaaa.done() && nodata2.done(); }));
+
+    // they got the same result
+    CHECK(nx2.kind() == Outcome::failure && nx2.rcode() == ns_r_nxdomain);
+    CHECK(nxaaaa.kind() == Outcome::failure && nxaaaa.rcode() == ns_r_nxdomain);
+    CHECK(nodata2.kind() == Outcome::resolved && nodata2.address().empty());
+
+    // but without asking the nameserver again
+    CHECK(server.count("nx1.example.com") == 1);
+    CHECK(server.count("nodata1.example.com") == 1);
+}
+
+/**
+ *  Main procedure
+ *  @return int
+ */
+int main()
+{
+    // run the tests
+    rules();
+    repeat();
+
+    // done
+    std::cout << "negative: ok" << std::endl;
+    return 0;
+}
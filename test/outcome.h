@@ -0,0 +1,187 @@
+/**
+ *  Outcome.h
+ *
+ *  Handler for the test programs that remembers how a single operation
+ *  ended: which method was called, when it was called, and the address in
+ *  the answer. Every query in a test gets its own outcome object.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <string>
+#include <sstream>
+
+/**
+ *  Class definition
+ */
+class Outcome : public DNS::Handler
+{
+public:
+    /**
+     *  The ways in which an operation can end
+     */
+    enum Kind { pending, resolved, failure, timeout, expired, cancelled };
+
+private:
+    /**
+     *  How the operation ended
+     *  @var Kind
+     */
+    Kind _kind = pending;
+
+    /**
+     *  The rcode (only for failures)
+     *  @var int
+     */
+    int _rcode = 0;
+
+    /**
+     *  The time at which the operation ended
+     *  @var double
+     */
+    double _time = 0.0;
+
+    /**
+     *  The address in the first answer (only when resolved)
+     *  @var std::string
+     */
+    std::string _address;
+
+    /**
+     *  Number of times that the handler was called (should never be more than one)
+     *  @var size_t
+     */
+    size_t _calls = 0;
+
+    /**
+     *  Remember how the operation ended
+     *  @param  kind        how the operation ended
+     *  @param  rcode       the rcode
+     */
+    void set(Kind kind, int rcode = 0) { _kind = kind; _rcode = rcode; _time = DNS::Now(); _calls += 1; }
+
+    /**
+     *  Method that is called when a valid, successful, response was received.
+     *  @param  operation       the operation that finished
+     *  @param  response        the received response
+     */
+    virtual void onResolved(const DNS::Operation *operation, const DNS::Response &response) override
+    {
+        // remember the outcome
+        set(resolved);
+
+        // remember the address in the first A record
+        for (size_t i = 0; i < response.answers(); ++i)
+        {
+            // parse the record
+            DNS::Answer record(response, i);
+
+            // only A records are interesting
+            if (record.type() != ns_t_a) continue;
+
+            // remember the address
+            std::ostringstream stream; stream << DNS::A(response, record).ip(); _address = stream.str(); break;
+        }
+    }
+
+    /**
+     *  Method that is called when a query could not be processed or answered.
+     *  @param  operation       the operation that finished
+     *  @param  rcode           the received rcode
+     */
+    virtual void onFailure(const DNS::Operation *operation, int rcode) override { set(failure, rcode); }
+
+    /**
+     *  Method that is called when no response was received in time
+     *  @param  operation       the operation that timed out
+     */
+    virtual void onTimeout(const DNS::Operation *operation) override { set(timeout); }
+
+    /**
+     *  Method that is called when the deadline of the operation passed
+     *  @param  operation       the operation that expired
+     */
+    virtual void onExpired(const DNS::Operation *operation) override { set(expired); }
+
+    /**
+     *  Method that is called when the operation was cancelled
+     *  @param  operation       the operation that was cancelled
+     */
+    virtual void onCancelled(const DNS::Operation *operation) override { set(cancelled); }
+
+public:
+    /**
+     *  Constructor
+     */
+    Outcome() = default;
+
+    /**
+     *  Destructor
+     */
+    virtual ~Outcome() = default;
+
+    /**
+     *  Did the operation end?
+     *  @return bool
+     */
+    bool done() const { return _kind != pending; }
+
+    /**
+     *  How the operation ended
+     *  @return Kind
+     */
+    Kind kind() const { return _kind; }
+
+    /**
+     *  The rcode of a failure
+     *  @return int
+     */
+    int rcode() const { return _rcode; }
+
+    /**
+     *  The time at which the operation ended
+     *  @return double
+     */
+    double time() const { return _time; }
+
+    /**
+     *  The address in the answer
+     *  @return std::string
+     */
+    const std::string &address() const { return _address; }
+
+    /**
+     *  Number of times that the handler was called
+     *  @return size_t
+     */
+    size_t calls() const { return _calls; }
+};
+
+/**
+ *  Run an event loop until a condition holds, but no longer than a certain time
+ *  @param  loop        the event loop
+ *  @param  condition   the condition to wait for
+ *  @param  limit       max number of seconds to wait
+ *  @return bool        does the condition hold?
+ */
+template <typename CONDITION>
+static bool settle(DNS::EpollLoop &loop, const CONDITION &condition, double limit = 10.0)
+{
+    // when we give up
+    double end = DNS::Now() + limit;
+
+    // run the loop until the condition holds
+    while (!condition()) { if (DNS::Now() > end) return false; loop.step(0.05); }
+
+    // the condition holds
+    return true;
+}
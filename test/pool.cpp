@@ -0,0 +1,149 @@
+/**
+ *  Pool.cpp
+ *
+ *  Benchmark that shows how the number of queries per second scales with
+ *  the number of threads in a resolver pool. The queries are answered by a
+ *  small nameserver that runs in the same process (on a port of 127.0.0.1
+ *  that is picked by the operating system). The program fails when not all
+ *  queries were answered with the address that the nameserver hands out.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <iostream>
+#include <thread>
+#include <string>
+#include "server.h"
+
+/**
+ *  The handler class
+ */
+class MyHandler : public DNS::Handler
+{
+private:
+    /**
+     *  Number of finished lookups, and the number of successful ones
+     *  @var size_t
+     */
+    size_t _finished = 0;
+    size_t _success = 0;
+
+    /**
+     *  Method that is called when a valid, successful, response was received.
+     *  @param  operation       the operation that finished
+     *  @param  response        the received response
+     */
+    virtual void onResolved(const DNS::Operation *operation, const DNS::Response &response) override
+    {
+        // update counter
+        _finished += 1;
+
+        // the answer must hold the address that belongs to the name
+        if (response.answers() != 1) return;
+
+        // parse the record
+        DNS::Answer record(response, 0);
+
+        // it should be an A record
+        if (record.type() != ns_t_a) return;
+
+        // the number in the name of the record ("host1234.example.com")
+        uint32_t number = std::stoul(record.name() + 4);
+
+        // compare the address
+        if (DNS::A(response, record).ip() == DNS::Ip(TestServer::address(number).c_str())) _success += 1;
+    }
+
+    /**
+     *  Method that is called when a query could not be processed or answered.
+     *  @param  operation       the operation that finished
+     *  @param  rcode           the received rcode
+     */
+    virtual void onFailure(const DNS::Operation *operation, int rcode) override
+    {
+        // update counter
+        _finished += 1;
+    }
+
+public:
+    /**
+     *  Number of finished lookups
+     *  @return size_t
+     */
+    size_t finished() const { return _finished; }
+
+    /**
+     *  Number of successful lookups
+     *  @return size_t
+     */
+    size_t success() const { return _success; }
+};
+
+/**
+ *  Run the benchmark with a certain number of threads
+ *  @param  threads     number of threads in the pool
+ *  @param  port        port of the test nameserver
+ *  @param  count       number of queries
+ *  @return bool        were all queries answered correctly?
+ */
+static bool benchmark(size_t threads, uint16_t port, size_t count)
+{
+    // the event loop of this thread
+    DNS::EpollLoop loop;
+
+    // the pool, every context only talks to the test nameserver
+    DNS::ResolverPool pool(&loop, threads, false, [port](DNS::Context *context) {
+
+        // use the test nameserver
+        context->nameserver(DNS::Ip("127.0.0.1"), port);
+
+        // allow many lookups at the same time
+        context->capacity(1000);
+        context->buffersize(4 * 1024 * 1024);
+    });
+
+    // handler for the lookups
+    MyHandler handler;
+
+    // the start time
+    DNS::Now start;
+
+    // start all queries (all names are different, so nothing is shared or cached)
+    for (size_t i = 0; i < count; ++i) pool.query(("host" + std::to_string(i) + ".example.com").c_str(), ns_t_a, &handler);
+
+    // run the loop until all results are in
+    while (handler.finished() < count) loop.step(1.0);
+
+    // the time it took
+    double seconds = DNS::Now() - start;
+
+    // show the result
+    std::cout << threads << " threads: " << size_t(count / seconds) << " queries per second (" << handler.success() << "/" << count << " successful)" << std::endl;
+
+    // all queries should have been answered correctly
+    return handler.success() == count;
+}
+
+/**
+ *  Main procedure
+ *  @return int
+ */
+int main()
+{
+    // number of cpus
+    size_t cpus = std::max(std::thread::hardware_concurrency(), 1u);
+
+    // the nameserver
+    TestServer server(cpus);
+
+    // run the benchmark with an increasing number of threads
+    for (size_t threads = 1; threads <= cpus; threads *= 2) if (!benchmark(threads, server.port(), 50000)) return 1;
+
+    // done
+    return 0;
+}
+
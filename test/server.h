@@ -0,0 +1,348 @@
+/**
+ *  Server.h
+ *
+ *  Small nameserver that runs in the same process as a test program. It
+ *  listens on 127.0.0.1, on a port that is picked by the operating system
+ *  (so no special permissions are needed), and it has a thread per socket.
+ *  What it answers depends on the first label of the name in the question:
+ *
+ *      nx...       NXDOMAIN, with a SOA record in the authority section
+ *      nodata...   no error, but no records either (with a SOA record)
+ *      drop...     no answer at all
+ *      other       an A record, with the address 10.x.y.z in which x, y and z
+ *                  are the number in the first label (host1234 becomes 10.0.4.210)
+ *
+ *  The server counts how often each name was asked, so that tests can check
+ *  whether a query went to the network or was answered from a cache, and it
+ *  remembers the order in which the names came in.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Include guard
+ */
+#pragma once
+
+/**
+ *  Dependencies
+ */
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <unordered_map>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/nameser.h>
+#include <resolv.h>
+
+/**
+ *  Class definition
+ */
+class TestServer
+{
+private:
+    /**
+     *  The sockets
+     *  @var std::vector
+     */
+    std::vector<int> _fds;
+
+    /**
+     *  The threads
+     *  @var std::vector
+     */
+    std::vector<std::thread> _threads;
+
+    /**
+     *  The port to which the sockets are bound
+     *  @var uint16_t
+     */
+    uint16_t _port = 0;
+
+    /**
+     *  Should the threads stop?
+     *  @var std::atomic<bool>
+     */
+    std::atomic<bool> _stop;
+
+    /**
+     *  Total number of questions that came in
+     *  @var std::atomic<size_t>
+     */
+    std::atomic<size_t> _total;
+
+    /**
+     *  Number of questions per name, and the lock that protects it
+     */
+    std::unordered_map<std::string, size_t> _counters;
+    mutable std::mutex _mutex;
+
+    /**
+     *  The names in the order in which they came in (protected by the same lock)
+     *  @var std::vector
+     */
+    std::vector<std::string> _order;
+
+public:
+    /**
+     *  Create the response to a question (this is also useful to create responses
+     *  for tests that do not need the network)
+     *  @param  question    the question
+     *  @param  bytes       size of the question
+     *  @param  answer      buffer of 512 bytes in which the response is written
+     *  @param  name        filled with the name in the question (empty when it cannot be parsed)
+     *  @return size_t      size of the response (zero when the question is not answered)
+     */
+    static size_t respond(const unsigned char *question, size_t bytes, unsigned char *answer, std::string &name)
+    {
+        // nothing is parsed yet
+        name.clear();
+
+        // messages that are too small cannot be parsed
+        if (bytes < HFIXEDSZ) return 0;
+
+        // skip the name in the question (and copy it), and the type and class that follow it
+        size_t end = HFIXEDSZ;
+        while (end < size_t(bytes) && question[end] != 0)
+        {
+            // copy the label
+            if (!name.empty()) name.push_back('.');
+            name.append((const char *)question + end + 1, std::min(size_t(question[end]), size_t(bytes) - end - 1));
+
+            // proceed to the next label
+            end += question[end] + 1;
+        }
+        end += 5;
+
+        // skip questions that cannot be parsed (or whose response would not fit)
+        if (end > size_t(bytes) || end + 40 > 512) { name.clear(); return 0; }
+
+        // some questions are never answered
+        if (name.compare(0, 4, "drop") == 0) return 0;
+
+        // copy the question, and turn it into a response without records (the question may have had an edns record)
+        memcpy(answer, question, end); answer[2] = 0x81; answer[3] = 0x80;
+        answer[6] = answer[7] = answer[8] = answer[9] = answer[10] = answer[11] = 0;
+
+        // size of the response so far
+        size_t length = end;
+
+        // is this a negative response?
+        if (name.compare(0, 2, "nx") == 0 || name.compare(0, 6, "nodata") == 0)
+        {
+            // the rcode is NXDOMAIN for names that do not exist
+            if (name[0] == 'n' && name[1] == 'x') answer[3] = 0x83;
+
+            // the soa record: a pointer to the name, type SOA, class IN, ttl 300, and the data with a minimum of 60 seconds
+            const unsigned char record[] = { 0xc0, 0x0c, 0, 6, 0, 1, 0, 0, 1, 44, 0, 22, 0, 0, 0, 0, 0, 1, 0, 0, 14, 16, 0, 0, 7, 8, 0, 9, 58, 128, 0, 0, 0, 60 };
+            memcpy(answer + length, record, sizeof(record)); length += sizeof(record);
+
+            // it is in the authority section
+            answer[9] = 1;
+        }
+        else
+        {
+            // the number in the first label
+            uint32_t number = 0;
+            for (size_t i = 0; i < name.size() && name[i] != '.'; ++i) if (isdigit(name[i])) number = number * 10 + (name[i] - '0');
+
+            // the answer: a pointer to the name, type A, class IN, ttl 300, and the address
+            const unsigned char record[] = { 0xc0, 0x0c, 0, 1, 0, 1, 0, 0, 1, 44, 0, 4, 10, uint8_t(number >> 16), uint8_t(number >> 8), uint8_t(number) };
+            memcpy(answer + length, record, sizeof(record)); length += sizeof(record);
+
+            // it is in the answer section
+            answer[7] = 1;
+        }
+
+        // done
+        return length;
+    }
+
+    /**
+     *  Create the response to a question for an A record
+     *  @param  name        the name to ask for
+     *  @param  answer      buffer of 512 bytes in which the response is written
+     *  @return size_t      size of the response (zero when the question is not answered)
+     */
+    static size_t respond(const char *name, unsigned char *answer)
+    {
+        // create the question
+        unsigned char question[512];
+        int size = res_mkquery(ns_o_query, name, ns_c_in, ns_t_a, nullptr, 0, nullptr, question, sizeof(question));
+
+        // the name in the question
+        std::string parsed;
+
+        // create the response
+        return size < 0 ? 0 : respond(question, size, answer, parsed);
+    }
+
+private:
+    /**
+     *  Answer the questions that come in on a socket
+     *  @param  fd      the socket
+     */
+    void run(int fd)
+    {
+        // buffers for the question and the answer
+        unsigned char question[512], answer[512];
+
+        // keep answering
+        while (!_stop)
+        {
+            // the address of the sender
+            struct sockaddr_in from; socklen_t size = sizeof(from);
+
+            // receive a question (the socket has a receive timeout, so that we can stop)
+            ssize_t bytes = recvfrom(fd, question, sizeof(question), 0, (struct sockaddr *)&from, &size);
+
+            // skip errors
+            if (bytes <= 0) continue;
+
+            // the name in the question
+            std::string name;
+
+            // create the response (questions that cannot be parsed are skipped)
+            size_t length = respond(question, bytes, answer, name);
+            if (name.empty()) continue;
+
+            // count the question
+            _total += 1; { std::lock_guard<std::mutex> lock(_mutex); _counters[name] += 1; _order.push_back(name); }
+
+            // send the response (some questions are never answered)
+            if (length > 0) sendto(fd, answer, length, 0, (struct sockaddr *)&from, size);
+        }
+    }
+
+public:
+    /**
+     *  Constructor
+     *  @param  threads     number of threads (each thread has its own socket)
+     *  @throws std::runtime_error
+     */
+    TestServer(size_t threads = 1) : _stop(false), _total(0)
+    {
+        // create the sockets
+        for (size_t i = 0; i < threads; ++i)
+        {
+            // create a socket
+            int fd = socket(AF_INET, SOCK_DGRAM, 0), one = 1, buffer = 8 * 1024 * 1024;
+
+            // all sockets share the same port, and they get a big buffer
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+
+            // the receive timeout
+            struct timeval timeout{ 0, 100000 }; setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+            // the address to bind to (the first socket gets a port from the operating system, the others share it)
+            struct sockaddr_in address{}; address.sin_family = AF_INET; address.sin_port = htons(_port); address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+            // bind the socket
+            if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0) { close(fd); throw std::runtime_error("cannot bind to 127.0.0.1"); }
+
+            // remember the socket
+            _fds.push_back(fd);
+
+            // the port is already known for the other sockets
+            if (_port != 0) continue;
+
+            // find out which port we got
+            socklen_t size = sizeof(address); getsockname(fd, (struct sockaddr *)&address, &size); _port = ntohs(address.sin_port);
+        }
+
+        // start the threads
+        for (auto fd : _fds) _threads.emplace_back(&TestServer::run, this, fd);
+    }
+
+    /**
+     *  No copying
+     *  @param  that
+     */
+    TestServer(const TestServer &that) = delete;
+
+    /**
+     *  Destructor
+     */
+    virtual ~TestServer()
+    {
+        // stop the threads
+        _stop = true; for (auto &thread : _threads) thread.join();
+
+        // close the sockets
+        for (auto fd : _fds) close(fd);
+    }
+
+    /**
+     *  The port on which the server listens (on 127.0.0.1)
+     *  @return uint16_t
+     */
+    uint16_t port() const { return _port; }
+
+    /**
+     *  Total number of questions that came in
+     *  @return size_t
+     */
+    size_t total() const { return _total; }
+
+    /**
+     *  Number of times that a name was asked
+     *  @param  name        the name (without trailing dot)
+     *  @return size_t
+     */
+    size_t count(const std::string &name) const
+    {
+        // protect the counters
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        // look up the counter
+        auto iter = _counters.find(name);
+
+        // names that never came in were asked zero times
+        return iter == _counters.end() ? 0 : iter->second;
+    }
+
+    /**
+     *  Position of the first question for a name in the order of arrival
+     *  @param  name        the name (without trailing dot)
+     *  @return size_t      the position (or SIZE_MAX when the name was never asked)
+     */
+    size_t position(const std::string &name) const
+    {
+        // protect the order
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        // look for the name
+        for (size_t i = 0; i < _order.size(); ++i) if (_order[i] == name) return i;
+
+        // the name was never asked
+        return SIZE_MAX;
+    }
+
+    /**
+     *  The address that the server puts in the answer for a certain number
+     *  @param  number      the number in the first label
+     *  @return std::string
+     */
+    static std::string address(uint32_t number)
+    {
+        // the address is 10.x.y.z
+        return "10." + std::to_string((number >> 16) & 255) + "." + std::to_string((number >> 8) & 255) + "." + std::to_string(number & 255);
+    }
+};
+
+/**
+ *  Helper macro to check a condition: when it does not hold, the test
+ *  program reports the location and exits with a non-zero status
+ */
+#define CHECK(condition) do { if (!(condition)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); exit(1); } } while (0)
@@ -0,0 +1,232 @@
+/**
+ *  Snapshot.cpp
+ *
+ *  Test-program for cache snapshots: a cache that is written to a file and
+ *  loaded again must hold the same responses (with TTLs that include the
+ *  time that passed), and files that are damaged or that were not written
+ *  by us must be rejected, without loading the entries that are broken.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+#include "server.h"
+
+/**
+ *  Number of responses in the snapshot
+ *  @var size_t
+ */
+static const size_t COUNT = 50;
+
+/**
+ *  Store the response for a name in a cache
+ *  @param  cache       the cache (Cache or SharedCache)
+ *  @param  name        the name (the response is stored under this key)
+ *  @param  now         current time
+ *  @return bool        was it stored?
+ */
+template <typename CACHE>
+static bool store(CACHE &cache, const std::string &name, double now)
+{
+    // create the response that the test nameserver would send
+    unsigned char buffer[512];
+    size_t size = TestServer::respond(name.c_str(), buffer);
+
+    // store it
+    return cache.insert(name, DNS::Response(buffer, size), now);
+}
+
+/**
+ *  The TTL of the first record in a cached response (the answer, or the SOA record of a negative response)
+ *  @param  cache       the cache (Cache or SharedCache)
+ *  @param  name        the name
+ *  @param  now         current time
+ *  @return int64_t     the TTL (or -1 when the response is not in the cache)
+ */
+template <typename CACHE>
+static int64_t ttl(CACHE &cache, const std::string &name, double now)
+{
+    // look up the response
+    std::vector<unsigned char> result;
+    if (!cache.lookup(name, now, result)) return -1;
+
+    // parse it
+    DNS::Response response(result.data(), result.size());
+
+    // the first record
+    return response.answers() > 0 ? DNS::Record(response, ns_s_an, 0).ttl() : DNS::Record(response, ns_s_ns, 0).ttl();
+}
+
+/**
+ *  Overwrite some bytes of a file
+ *  @param  filename    the file
+ *  @param  offset      position of the bytes
+ *  @param  data        the new bytes
+ *  @param  size        number of bytes
+ */
+static void patch(const std::string &filename, size_t offset, const void *data, size_t size)
+{
+    // open the file for reading and writing
+    std::fstream stream(filename, std::ios::in | std::ios::out | std::ios::binary);
+
+    // overwrite the bytes
+    stream.seekp(offset); stream.write((const char *)data, size);
+}
+
+/**
+ *  Size of a file
+ *  @param  filename    the file
+ *  @return size_t
+ */
+static size_t filesize(const std::string &filename)
+{
+    // open the file at the end
+    std::ifstream stream(filename, std::ios::binary | std::ios::ate);
+
+    // the position is the size
+    return stream.tellg();
+}
+
+/**
+ *  Copy a file
+ *  @param  from        the source
+ *  @param  to          the destination
+ */
+static void copy(const std::string &from, const std::string &to)
+{
+    // open both files
+    std::ifstream input(from, std::ios::binary);
+    std::ofstream output(to, std::ios::binary | std::ios::trunc);
+
+    // copy the contents
+    output << input.rdbuf();
+}
+
+/**
+ *  Check that a snapshot holds the same responses as the cache that wrote it
+ *  @param  filename    the snapshot file
+ *  @param  now         the time at which the snapshot was written
+ */
+static void roundtrip(const std::string &filename, double now)
+{
+    // load it into a new cache, ten seconds later
+    DNS::Cache cache(1024 * 1024);
+    CHECK(cache.load(filename.c_str(), now + 10.0) == COUNT);
+    CHECK(cache.size() == COUNT);
+
+    // the responses are there, with the TTL that is left after those ten seconds
+    for (size_t i = 0; i < COUNT - 1; ++i) CHECK(ttl(cache, "host" + std::to_string(i) + ".example.com", now + 10.0) == 290);
+
+    // the limit of the negative response was kept too (the minimum of the SOA record is 60 seconds)
+    CHECK(ttl(cache, "nx1.example.com", now + 10.0) == 50);
+    CHECK(ttl(cache, "nx1.example.com", now + 61.0) == -1);
+
+    // the addresses are still right
+    std::vector<unsigned char> result;
+    CHECK(cache.lookup("host7.example.com", now + 10.0, result));
+    DNS::Response response(result.data(), result.size());
+    CHECK(DNS::A(response, DNS::Answer(response, 0)).ip() == DNS::Ip(TestServer::address(7).c_str()));
+
+    // responses that are already in a cache are not replaced
+    DNS::Cache partial(1024 * 1024);
+    CHECK(store(partial, "host3.example.com", now + 20.0));
+    CHECK(partial.load(filename.c_str(), now + 20.0) == COUNT - 1);
+    CHECK(ttl(partial, "host3.example.com", now + 20.0) == 300);
+
+    // the snapshot can also be loaded into a shared cache
+    DNS::SharedCache shared(1024 * 1024);
+    CHECK(shared.load(filename.c_str(), now + 10.0) == COUNT);
+    CHECK(ttl(shared, "host7.example.com", now + 10.0) == 290);
+
+    // responses that expired in the meantime are not loaded
+    DNS::Cache late(1024 * 1024);
+    CHECK(late.load(filename.c_str(), now + 100.0) == COUNT - 1);
+    CHECK(late.load(filename.c_str(), now + 400.0) == 0);
+}
+
+/**
+ *  Check that damaged snapshots are rejected
+ *  @param  filename    the snapshot file
+ *  @param  now         the time at which the snapshot was written
+ */
+static void corrupt(const std::string &filename, double now)
+{
+    // the file that is damaged (a copy of the snapshot)
+    std::string damaged = filename + ".damaged";
+
+    // the size of the header (the magic bytes, and the layout)
+    const size_t header = 16;
+
+    // files that do not exist, or that are empty, are not loaded
+    { DNS::Cache cache(1024 * 1024); CHECK(cache.load((filename + ".missing").c_str(), now) == 0); }
+    { std::ofstream empty(damaged, std::ios::trunc); }
+    { DNS::Cache cache(1024 * 1024); CHECK(cache.load(damaged.c_str(), now) == 0); }
+
+    // wrong magic bytes (for example another version of the format)
+    copy(filename, damaged); patch(damaged, 7, "\x7f", 1);
+    { DNS::Cache cache(1024 * 1024); CHECK(cache.load(damaged.c_str(), now) == 0 && cache.size() == 0); }
+
+    // written by a machine with the other byte order
+    uint32_t order = 0x04030201;
+    copy(filename, damaged); patch(damaged, 8, &order, sizeof(order));
+    { DNS::Cache cache(1024 * 1024); CHECK(cache.load(damaged.c_str(), now) == 0 && cache.size() == 0); }
+
+    // a truncated file only gives the entries that are complete
+    copy(filename, damaged); truncate(damaged.c_str(), filesize(filename) / 2);
+    { DNS::Cache cache(1024 * 1024); size_t count = cache.load(damaged.c_str(), now); CHECK(count > 0 && count < COUNT && cache.size() == count); }
+
+    // the first entry expires before it was stored, so it is damaged (the others are fine)
+    double expires = now - 1000.0;
+    copy(filename, damaged); patch(damaged, header + 8, &expires, sizeof(expires));
+    { DNS::Cache cache(1024 * 1024); CHECK(cache.load(damaged.c_str(), now) == COUNT - 1); }
+
+    // the first entry claims to have many ttls, which makes it (and everything after it) run past the end of the file
+    uint16_t ttls = 60000;
+    copy(filename, damaged); patch(damaged, header + 24, &ttls, sizeof(ttls));
+    { DNS::Cache cache(1024 * 1024); CHECK(cache.load(damaged.c_str(), now) == 0); }
+
+    // the file is no longer needed
+    unlink(damaged.c_str());
+}
+
+/**
+ *  Main procedure
+ *  @return int
+ */
+int main()
+{
+    // a file for the snapshot
+    char filename[] = "/tmp/dnscpp-snapshot-XXXXXX";
+    int fd = mkstemp(filename); CHECK(fd >= 0); close(fd);
+
+    // the current time
+    double now = DNS::Now();
+
+    // a cache with positive responses and a negative response
+    DNS::Cache cache(1024 * 1024);
+    for (size_t i = 0; i < COUNT - 1; ++i) CHECK(store(cache, "host" + std::to_string(i) + ".example.com", now));
+    CHECK(store(cache, "nx1.example.com", now));
+
+    // write it to the file
+    CHECK(cache.save(filename));
+
+    // run the tests
+    roundtrip(filename, now);
+    corrupt(filename, now);
+
+    // the file is no longer needed
+    unlink(filename);
+
+    // done
+    std::cout << "snapshot: ok" << std::endl;
+    return 0;
+}
@@ -13,8 +13,6 @@
  */
 #include <dnscpp.h>
 #include <iostream>
-#include <ev.h>
-#include <dnscpp/libev.h>
 #include <math.h>
 
 /**
@@ -220,18 +218,15 @@ int main()
 //    srand(time(nullptr));
     
     // the event loop
-    struct ev_loop *loop = EV_DEFAULT;
-
-    // wrap the loop to make it accessible by dns-cpp
-    DNS::LibEv myloop(loop);
+    DNS::EpollLoop loop;
     
     // create a dns context
-    DNS::Context context(&myloop);
+    DNS::Context context(&loop);
 
     context.buffersize(4 * 1024 * 1024);        // size of the input buffer (high lowers risk of package loss)
     context.interval(2.0);                      // number of seconds until the datagram is retried (possibly to next server) (this does not cancel previous requests)
     context.attempts(50);                       // number of attempts until failure / number of datagrams to send at most
-    context.capacity(1000);                     // max number of simultaneous lookups per dns-context (high increases speed but also risk of package-loss)
+    context.capacity(1000);                     // max number of simultaneous lookups per dns-context (each nameserver also adapts its own window to avoid package-loss)
     context.timeout(10.0);                      // time to wait for a response after the _last_ attempt
 
     // start with a domain
@@ -256,7 +251,7 @@ int main()
     while (!domain.first());
     
     // run the event loop
-    ev_run(loop);
+    loop.run();
     
     // done
     return 0;
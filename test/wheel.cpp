@@ -0,0 +1,193 @@
+/**
+ *  Wheel.cpp
+ *
+ *  Test-program for the timer wheel: lookups on different levels must
+ *  cascade down and become due at their own time (and not before it), a
+ *  lookup that is already due can still be removed, and next() must never
+ *  sleep past the moment that something has to happen.
+ *
+ *  @copyright 2021 Copernica BV
+ */
+
+/**
+ *  Dependencies
+ */
+#include <dnscpp.h>
+#include <dnscpp/wheel.h>
+#include <dnscpp/lookup.h>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "server.h"
+
+/**
+ *  Lookup that does nothing, it is only stored in the wheel
+ */
+class DummyLookup : public DNS::Lookup
+{
+public:
+    /**
+     *  Constructor
+     */
+    DummyLookup() : DNS::Lookup(nullptr, DNS::Options(), nullptr, ns_o_query, "example.com", ns_t_a, DNS::Bits()) {}
+
+    /**
+     *  Destructor
+     */
+    virtual ~DummyLookup() = default;
+
+    /**
+     *  Methods that the wheel never calls
+     */
+    virtual size_t credits() const override { return 1; }
+    virtual double delay(double now) const override { return 0.0; }
+    virtual bool admit() override { return true; }
+    virtual bool execute(double now) override { return false; }
+};
+
+/**
+ *  Check that lookups on all levels become due at their own time
+ *  @param  wheel       the wheel to use
+ *  @param  start       the start time
+ */
+static void cascade(DNS::Wheel &wheel, double start)
+{
+    // delays that end up on each of the levels (64 ms, 4 s, 262 s and 4.6 hours per level)
+    const std::vector<double> delays = { 0.010, 0.500, 5.0, 70.0, 300.0, 20000.0 };
+
+    // the lookups
+    std::vector<std::unique_ptr<DummyLookup>> lookups;
+
+    // add them in reverse order, so that the order of insertion does not help
+    for (size_t i = 0; i < delays.size(); ++i) lookups.emplace_back(new DummyLookup());
+    for (size_t i = delays.size(); i-- > 0; ) wheel.insert(lookups[i].get(), start + delays[i], i % 2 == 0);
+
+    // all lookups are stored, and half of them is active
+    CHECK(wheel.size() == delays.size());
+    CHECK(wheel.active() == delays.size() / 2);
+
+    // check the lookups one by one
+    for (size_t i = 0; i < delays.size(); ++i)
+    {
+        // a little before it expires, nothing is due
+        wheel.advance(start + delays[i] - 0.002);
+        CHECK(wheel.pop() == nullptr);
+
+        // right after it expires, only this lookup is due
+        wheel.advance(start + delays[i] + 0.002);
+        CHECK(wheel.pop() == lookups[i].get());
+        CHECK(wheel.pop() == nullptr);
+    }
+
+    // the wheel is empty again
+    CHECK(wheel.empty());
+    CHECK(wheel.active() == 0);
+}
+
+/**
+ *  Check that lookups can be removed, also when they are already due
+ *  @param  wheel       the wheel to use
+ *  @param  start       the start time
+ */
+static void remove(DNS::Wheel &wheel, double start)
+{
+    // a lookup that becomes due, one that stays in the wheel, and one that is never added
+    DummyLookup due, waiting, other;
+
+    // add them
+    wheel.insert(&due, start + 0.010, true);
+    wheel.insert(&waiting, start + 100.0, true);
+
+    // the first one becomes due
+    wheel.advance(start + 0.050);
+    CHECK(wheel.size() == 2);
+
+    // it can be removed from the list of due lookups
+    CHECK(wheel.remove(&due));
+    CHECK(wheel.size() == 1);
+    CHECK(wheel.active() == 1);
+
+    // so it is no longer returned
+    CHECK(wheel.pop() == nullptr);
+
+    // lookups that are not (or no longer) in the wheel cannot be removed
+    CHECK(!wheel.remove(&due));
+    CHECK(!wheel.remove(&other));
+
+    // the waiting lookup can be removed from its slot
+    CHECK(wheel.remove(&waiting));
+    CHECK(wheel.empty());
+    CHECK(wheel.active() == 0);
+
+    // and it never shows up
+    wheel.advance(start + 200.0);
+    CHECK(wheel.pop() == nullptr);
+}
+
+/**
+ *  Check that sleeping for the time returned by next() never oversleeps
+ *  @param  wheel       the wheel to use
+ *  @param  start       the start time
+ */
+static void next(DNS::Wheel &wheel, double start)
+{
+    // an empty wheel does not have to run
+    CHECK(wheel.next(start) < 0.0);
+
+    // a lookup that is due right away must run right away
+    DummyLookup now;
+    wheel.push(&now, false);
+    CHECK(wheel.next(start) == 0.0);
+    CHECK(wheel.pop() == &now);
+
+    // lookups at different distances
+    for (double delay : { 0.030, 2.0, 90.0 })
+    {
+        // add the lookup
+        DummyLookup lookup;
+        wheel.insert(&lookup, start + delay, true);
+
+        // the current time, and the number of wake-ups
+        double time = start; size_t wakeups = 0;
+
+        // keep sleeping for as long as next() tells us
+        while (true)
+        {
+            // time to sleep
+            double sleep = wheel.next(time);
+
+            // we should never be told that the wheel is empty, and never sleep past the expire time
+            CHECK(sleep >= 0.0);
+            CHECK(time + sleep <= start + delay + 0.002);
+
+            // wake up, and check if the lookup became due
+            time += sleep; wheel.advance(time);
+            if (wheel.pop() == &lookup) break;
+
+            // there are only a few wake-ups for cascades (plus rounding to milliseconds)
+            CHECK(++wakeups < 16);
+        }
+
+        // the lookup was not due too early
+        CHECK(time >= start + delay - 0.001);
+
+        // proceed from there
+        start = time;
+    }
+}
+
+/**
+ *  Main procedure
+ *  @return int
+ */
+int main()
+{
+    // run each test with a new wheel
+    { DNS::Wheel wheel; cascade(wheel, DNS::Now()); }
+    { DNS::Wheel wheel; remove(wheel, DNS::Now()); }
+    { DNS::Wheel wheel; next(wheel, DNS::Now()); }
+
+    // done
+    std::cout << "wheel: ok" << std::endl;
+    return 0;
+}